@@ -0,0 +1,108 @@
+#include "kasa_codec.h"
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Throughput of the Kasa autokey codec for typical frame sizes.
+//
+//   legacy  - per-call std::string built one byte at a time with +=
+//   scalar  - byte-at-a-time loop into a caller buffer
+//   codec   - KasaCodec::encrypt/decrypt fast path into a caller buffer
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+volatile uint8_t g_sink;
+
+std::string legacyEncrypt(const std::string& data) {
+    std::string result;
+    result.reserve(data.length());
+    uint8_t key = KasaCodec::kInitialKey;
+    for (size_t i = 0; i < data.length(); ++i) {
+        key = static_cast<uint8_t>(key ^ static_cast<uint8_t>(data[i]));
+        result += static_cast<char>(key);
+    }
+    return result;
+}
+
+double bytesPerNs(size_t size, const std::function<void()>& body) {
+    // Warm up, then run for roughly 100 ms
+    for (int i = 0; i < 100; ++i) {
+        body();
+    }
+
+    size_t iterations = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (elapsed < std::chrono::milliseconds(100)) {
+        for (int i = 0; i < 1000; ++i) {
+            body();
+        }
+        iterations += 1000;
+        elapsed = Clock::now() - start;
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    return static_cast<double>(size) * iterations / ns;
+}
+
+}
+
+int main() {
+    const size_t sizes[] = {64, 256, 1024, 4096, 16384};
+
+    std::cout << std::left << std::setw(8) << "size"
+              << std::setw(14) << "legacy enc" << std::setw(14) << "scalar enc"
+              << std::setw(14) << "codec enc" << std::setw(14) << "scalar dec"
+              << std::setw(14) << "codec dec" << "(bytes/ns)" << std::endl;
+
+    for (size_t size : sizes) {
+        std::string plain(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            plain[i] = "{\"system\":{\"get_sysinfo\":null}}"[i % 31];
+        }
+        std::vector<uint8_t> out(KasaCodec::frameSize(size));
+        std::vector<uint8_t> cipher(size);
+        KasaCodec::encrypt(reinterpret_cast<const uint8_t*>(plain.data()), cipher.data(), size);
+
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(plain.data());
+
+        double legacy = bytesPerNs(size, [&]() {
+            std::string result = legacyEncrypt(plain);
+            g_sink = static_cast<uint8_t>(result.back());
+        });
+        double scalarEnc = bytesPerNs(size, [&]() {
+            g_sink = KasaCodec::encryptScalar(in, out.data(), size);
+        });
+        double codecEnc = bytesPerNs(size, [&]() {
+            KasaCodec::encodeFrame(plain.data(), size, out.data(), out.size());
+            g_sink = out.back();
+        });
+        double scalarDec = bytesPerNs(size, [&]() {
+            g_sink = KasaCodec::decryptScalar(cipher.data(), out.data(), size);
+        });
+        double codecDec = bytesPerNs(size, [&]() {
+            g_sink = KasaCodec::decrypt(cipher.data(), out.data(), size);
+        });
+
+        // Sanity check the fast path against the reference
+        std::vector<uint8_t> check(size);
+        KasaCodec::decrypt(cipher.data(), check.data(), size);
+        if (memcmp(check.data(), plain.data(), size) != 0) {
+            std::cerr << "round trip mismatch at size " << size << std::endl;
+            return 1;
+        }
+
+        std::cout << std::fixed << std::setprecision(2) << std::left << std::setw(8) << size
+                  << std::setw(14) << legacy << std::setw(14) << scalarEnc
+                  << std::setw(14) << codecEnc << std::setw(14) << scalarDec
+                  << std::setw(14) << codecDec << std::endl;
+    }
+
+    return 0;
+}
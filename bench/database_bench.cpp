@@ -0,0 +1,347 @@
+#include "database.h"
+#include "tplink_device.h"
+#include <sqlite3.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Database read throughput on an in-memory SQLite database, and sustained
+// updateDeviceState throughput to a database file.
+//
+//   string SQL - queries built by concatenation, run through sqlite3_exec
+//                and decoded from text with std::stoi; every write its own
+//                transaction in the default rollback journal (the old path)
+//   Database   - reads served from Database's device cache; writes through
+//                the cache, queued and committed in batches to a WAL
+//                database by its writer thread with prepared statements
+//
+// A second table isolates the prepared statement cache: the same SQL on the
+// same in-memory connection, prepared and finalized on every call or
+// prepared once and reset, with no device cache or write queue involved.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t kFleetSize = 1000;
+const size_t kQueuedWrites = 200000;
+
+const char* kSchema = R"(
+    CREATE TABLE devices (
+        device_id TEXT PRIMARY KEY,
+        name TEXT NOT NULL,
+        ip TEXT NOT NULL,
+        port INTEGER NOT NULL,
+        model TEXT,
+        mac TEXT,
+        is_online INTEGER DEFAULT 0,
+        is_on INTEGER DEFAULT 0,
+        brightness INTEGER DEFAULT 0,
+        color_temp INTEGER DEFAULT 4000,
+        hue INTEGER DEFAULT 0,
+        saturation INTEGER DEFAULT 0,
+        created_at DATETIME DEFAULT CURRENT_TIMESTAMP,
+        updated_at DATETIME DEFAULT CURRENT_TIMESTAMP
+    )
+)";
+
+std::vector<DeviceInfo> makeFleet(size_t count) {
+    std::vector<DeviceInfo> fleet;
+    fleet.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        char id[41];
+        std::snprintf(id, sizeof(id), "8006%036zX", i * 2654435761u);
+        char ip[16];
+        std::snprintf(ip, sizeof(ip), "10.0.%zu.%zu", (i >> 8) & 0xFF, i & 0xFF);
+
+        DeviceInfo info{};
+        info.deviceId = id;
+        info.name = "Light " + std::to_string(i);
+        info.ip = ip;
+        info.port = 9999;
+        info.model = "KL130(US)";
+        info.mac = "50:C7:BF:00:00:00";
+        info.isOnline = true;
+        info.isOn = i % 2 == 0;
+        info.brightness = static_cast<int>(i % 101);
+        info.colorTemp = 2700;
+        info.hue = static_cast<int>(i % 361);
+        info.saturation = static_cast<int>(i % 101);
+        fleet.push_back(info);
+    }
+    return fleet;
+}
+
+// The Database before prepared statements and the cache, reduced to the three calls measured
+class StringSqlDatabase {
+public:
+    explicit StringSqlDatabase(const std::string& path) : db_(nullptr) {
+        sqlite3_open(path.c_str(), &db_);
+        sqlite3_exec(db_, kSchema, nullptr, nullptr, nullptr);
+    }
+    ~StringSqlDatabase() { sqlite3_close(db_); }
+
+    sqlite3* handle() const { return db_; }
+
+    void addDevice(const DeviceInfo& device) {
+        std::stringstream query;
+        query << "INSERT OR REPLACE INTO devices (device_id, name, ip, port, model, mac, "
+              << "is_online, is_on, brightness, color_temp, hue, saturation, updated_at) "
+              << "VALUES ('" << device.deviceId << "', '" << device.name << "', '"
+              << device.ip << "', " << device.port << ", '" << device.model << "', '"
+              << device.mac << "', " << (device.isOnline ? 1 : 0) << ", "
+              << (device.isOn ? 1 : 0) << ", " << device.brightness << ", "
+              << device.colorTemp << ", " << device.hue << ", " << device.saturation
+              << ", CURRENT_TIMESTAMP)";
+        sqlite3_exec(db_, query.str().c_str(), nullptr, nullptr, nullptr);
+    }
+
+    DeviceInfo getDevice(const std::string& deviceId) {
+        DeviceInfo device;
+        std::string query = "SELECT * FROM devices WHERE device_id = '" + deviceId + "'";
+        sqlite3_exec(db_, query.c_str(), readRow, &device, nullptr);
+        return device;
+    }
+
+    std::vector<DeviceInfo> getAllDevices() {
+        std::vector<DeviceInfo> devices;
+        sqlite3_exec(db_, "SELECT * FROM devices ORDER BY name",
+                     [](void* data, int argc, char** argv, char** colNames) -> int {
+                         DeviceInfo device;
+                         readRow(&device, argc, argv, colNames);
+                         static_cast<std::vector<DeviceInfo>*>(data)->push_back(device);
+                         return 0;
+                     }, &devices, nullptr);
+        return devices;
+    }
+
+    bool updateDeviceState(const std::string& deviceId, bool isOn, int brightness) {
+        std::stringstream query;
+        query << "UPDATE devices SET is_on = " << (isOn ? 1 : 0);
+        if (brightness >= 0) {
+            query << ", brightness = " << brightness;
+        }
+        query << ", updated_at = CURRENT_TIMESTAMP WHERE device_id = '" << deviceId << "'";
+        return sqlite3_exec(db_, query.str().c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    }
+
+private:
+    static int readRow(void* data, int argc, char** argv, char** /*colNames*/) {
+        DeviceInfo* device = static_cast<DeviceInfo*>(data);
+        if (argc >= 13) {
+            device->deviceId = argv[0] ? argv[0] : "";
+            device->name = argv[1] ? argv[1] : "";
+            device->ip = argv[2] ? argv[2] : "";
+            device->port = argv[3] ? std::stoi(argv[3]) : 9999;
+            device->model = argv[4] ? argv[4] : "";
+            device->mac = argv[5] ? argv[5] : "";
+            device->isOnline = argv[6] ? std::stoi(argv[6]) != 0 : false;
+            device->isOn = argv[7] ? std::stoi(argv[7]) != 0 : false;
+            device->brightness = argv[8] ? std::stoi(argv[8]) : 0;
+            device->colorTemp = argv[9] ? std::stoi(argv[9]) : 4000;
+            device->hue = argv[10] ? std::stoi(argv[10]) : 0;
+            device->saturation = argv[11] ? std::stoi(argv[11]) : 0;
+        }
+        return 0;
+    }
+
+    sqlite3* db_;
+};
+
+// One statement run either per call, prepared and finalized each time, or
+// from a copy prepared once and reset after use as Database's Query does
+class StatementBench {
+public:
+    StatementBench(sqlite3* db, const char* sql) : db_(db), sql_(sql), cached_(nullptr) {
+        sqlite3_prepare_v2(db_, sql_, -1, &cached_, nullptr);
+    }
+    ~StatementBench() { sqlite3_finalize(cached_); }
+    StatementBench(const StatementBench&) = delete;
+    StatementBench& operator=(const StatementBench&) = delete;
+
+    // bind(stmt) sets the parameters; returns the number of rows stepped
+    template <typename Bind>
+    int run(bool cached, Bind bind) {
+        sqlite3_stmt* stmt = cached_;
+        if (!cached && sqlite3_prepare_v2(db_, sql_, -1, &stmt, nullptr) != SQLITE_OK) {
+            return -1;
+        }
+        bind(stmt);
+        int rows = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            // Some columns read back, the same work on both sides
+            DeviceInfo device;
+            device.deviceId = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            device.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            device.brightness = sqlite3_column_int(stmt, 8);
+            rows++;
+        }
+        if (cached) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        } else {
+            sqlite3_finalize(stmt);
+        }
+        return rows;
+    }
+
+private:
+    sqlite3* db_;
+    const char* sql_;
+    sqlite3_stmt* cached_;
+};
+
+// Calls per second, each call being body(i) for a running i
+template <typename Body>
+double callsPerSecond(Body body) {
+    body(0);
+    size_t runs = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (elapsed < std::chrono::milliseconds(300)) {
+        body(runs);
+        runs++;
+        elapsed = Clock::now() - start;
+    }
+    return runs / std::chrono::duration<double>(elapsed).count();
+}
+
+void removeDatabase(const std::string& path) {
+    for (const char* suffix : {"", "-journal", "-wal", "-shm"}) {
+        std::filesystem::remove(path + suffix);
+    }
+}
+
+}
+
+int main() {
+    std::vector<DeviceInfo> fleet = makeFleet(kFleetSize);
+
+    StringSqlDatabase before(":memory:");
+    Database after(":memory:");
+    if (!after.initialize()) {
+        return 1;
+    }
+    for (const auto& info : fleet) {
+        before.addDevice(info);
+        after.addDevice(info);
+    }
+
+    const DeviceInfo& probe = fleet[kFleetSize / 2];
+    DeviceInfo a = before.getDevice(probe.deviceId);
+    DeviceInfo b = after.getDevice(probe.deviceId);
+    if (a.deviceId != b.deviceId || a.name != b.name || a.hue != b.hue || a.port != b.port ||
+        before.getAllDevices().size() != after.getAllDevices().size()) {
+        std::cerr << "string SQL and Database results disagree" << std::endl;
+        return 1;
+    }
+
+    struct Row {
+        const char* name;
+        double before;
+        double after;
+    };
+    std::vector<Row> rows = {
+        {"getDevice",
+         callsPerSecond([&](size_t i) { before.getDevice(fleet[i % kFleetSize].deviceId); }),
+         callsPerSecond([&](size_t i) { after.getDevice(fleet[i % kFleetSize].deviceId); })},
+        {"getAllDevices",
+         callsPerSecond([&](size_t) { before.getAllDevices(); }),
+         callsPerSecond([&](size_t) { after.getAllDevices(); })},
+    };
+
+    // Writes go to disk, where the journal and fsync dominate
+    std::string directory = std::filesystem::temp_directory_path().string();
+    std::string beforePath = directory + "/database_bench_before.db";
+    std::string afterPath = directory + "/database_bench_after.db";
+    removeDatabase(beforePath);
+    removeDatabase(afterPath);
+    {
+        StringSqlDatabase beforeDisk(beforePath);
+        Database afterDisk(afterPath);
+        if (!afterDisk.initialize()) {
+            return 1;
+        }
+        for (const auto& info : fleet) {
+            beforeDisk.addDevice(info);
+            afterDisk.addDevice(info);
+        }
+        afterDisk.flush();
+
+        double beforeWrites = callsPerSecond([&](size_t i) {
+            beforeDisk.updateDeviceState(fleet[i % kFleetSize].deviceId, i % 2 == 0, static_cast<int>(i % 101));
+        });
+        // Sustained: the clock stops once everything queued is committed
+        auto start = Clock::now();
+        for (size_t i = 0; i < kQueuedWrites; ++i) {
+            afterDisk.updateDeviceState(fleet[i % kFleetSize].deviceId, i % 2 == 0, static_cast<int>(i % 101));
+        }
+        afterDisk.flush();
+        double afterWrites = kQueuedWrites / std::chrono::duration<double>(Clock::now() - start).count();
+        rows.push_back({"updateDeviceState", beforeWrites, afterWrites});
+
+        DeviceInfo last = afterDisk.getDevice(fleet[(kQueuedWrites - 1) % kFleetSize].deviceId);
+        if (last.brightness != static_cast<int>((kQueuedWrites - 1) % 101)) {
+            std::cerr << "queued writes were not all committed" << std::endl;
+            return 1;
+        }
+    }
+    removeDatabase(beforePath);
+    removeDatabase(afterPath);
+
+    // Prepared statements alone, on the string SQL connection's table
+    StatementBench select(before.handle(),
+                          "SELECT device_id, name, ip, port, model, mac, is_online, is_on, brightness, "
+                          "color_temp, hue, saturation FROM devices WHERE device_id = ?1");
+    StatementBench update(before.handle(),
+                          "UPDATE devices SET is_on = ?2, brightness = ?3, updated_at = CURRENT_TIMESTAMP "
+                          "WHERE device_id = ?1");
+    auto bindId = [&](sqlite3_stmt* stmt, size_t i) {
+        const std::string& id = fleet[i % kFleetSize].deviceId;
+        sqlite3_bind_text(stmt, 1, id.data(), static_cast<int>(id.size()), SQLITE_STATIC);
+    };
+    auto selectOnce = [&](bool cached, size_t i) {
+        return select.run(cached, [&](sqlite3_stmt* stmt) { bindId(stmt, i); });
+    };
+    auto updateOnce = [&](bool cached, size_t i) {
+        return update.run(cached, [&](sqlite3_stmt* stmt) {
+            bindId(stmt, i);
+            sqlite3_bind_int(stmt, 2, i % 2 == 0);
+            sqlite3_bind_int(stmt, 3, static_cast<int>(i % 101));
+        });
+    };
+    if (selectOnce(false, 0) != 1 || selectOnce(true, 0) != 1 || updateOnce(false, 0) != 0 ||
+        updateOnce(true, 0) != 0) {
+        std::cerr << "prepared statement setup failed" << std::endl;
+        return 1;
+    }
+    std::vector<Row> statementRows = {
+        {"select by id",
+         callsPerSecond([&](size_t i) { selectOnce(false, i); }),
+         callsPerSecond([&](size_t i) { selectOnce(true, i); })},
+        {"update state",
+         callsPerSecond([&](size_t i) { updateOnce(false, i); }),
+         callsPerSecond([&](size_t i) { updateOnce(true, i); })},
+    };
+
+    auto print = [](const char* title, const char* beforeName, const char* afterName, const std::vector<Row>& table) {
+        std::cout << title << std::endl;
+        std::cout << std::left << std::setw(20) << "call" << std::setw(14) << beforeName
+                  << std::setw(14) << afterName << "speedup" << std::endl;
+        std::cout << std::fixed;
+        for (const auto& row : table) {
+            std::cout << std::setw(20) << row.name << std::setprecision(0) << std::setw(14) << row.before
+                      << std::setw(14) << row.after << std::setprecision(2) << row.after / row.before << "x"
+                      << std::endl;
+        }
+    };
+    print((std::to_string(kFleetSize) + " devices, calls/s").c_str(), "string SQL", "Database", rows);
+    std::cout << std::endl;
+    print("Same SQL, in-memory, no cache or queue, calls/s", "prepare/call", "cached stmt", statementRows);
+    return 0;
+}
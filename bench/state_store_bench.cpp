@@ -0,0 +1,144 @@
+#include "device_state_store.h"
+#include "tplink_device.h"
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Memory per device and online/on counting for a large fleet.
+//
+//   DeviceInfo   - std::vector<DeviceInfo>, as getAllDevices() returns it
+//   snapshot     - one shared DeviceInfo per device, as DeviceSnapshot holds it
+//   state store  - DeviceStateStore's structure of arrays
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t kFleetSize = 100000;
+
+const char* kModels[] = {"HS100(US)", "HS103(US)", "HS110(US)", "KL110(US)", "KL130(US)", "LB130(US)"};
+const char* kMacPrefixes[] = {"50:C7:BF", "B0:BE:76", "1C:3B:F3", "68:FF:7B"};
+const char* kRooms[] = {"Living Room", "Bedroom", "Kitchen", "Hallway", "Office", "Garage"};
+
+std::vector<DeviceInfo> makeFleet(size_t count) {
+    std::vector<DeviceInfo> fleet;
+    fleet.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        char id[41];
+        std::snprintf(id, sizeof(id), "8006%036zX", i * 2654435761u);
+        char ip[16];
+        std::snprintf(ip, sizeof(ip), "10.%zu.%zu.%zu", (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF);
+        char mac[18];
+        std::snprintf(mac, sizeof(mac), "%s:%02zX:%02zX:%02zX", kMacPrefixes[i % 4],
+                      (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF);
+
+        DeviceInfo info{};
+        info.deviceId = id;
+        info.name = std::string(kRooms[i % 6]) + " Light " + std::to_string(i);
+        info.ip = ip;
+        info.port = 9999;
+        info.model = kModels[i % 6];
+        info.mac = mac;
+        info.isOnline = i % 10 != 0;
+        info.isOn = i % 3 == 0;
+        info.brightness = static_cast<int>(i % 101);
+        info.colorTemp = 2700 + static_cast<int>(i % 3800);
+        info.hue = static_cast<int>(i % 361);
+        info.saturation = static_cast<int>(i % 101);
+        fleet.push_back(info);
+    }
+    return fleet;
+}
+
+size_t heapBytes(const std::string& value) {
+    return value.capacity() > std::string().capacity() ? value.capacity() + 1 : 0;
+}
+
+size_t infoHeapBytes(const DeviceInfo& info) {
+    return heapBytes(info.deviceId) + heapBytes(info.name) + heapBytes(info.ip) + heapBytes(info.model) +
+           heapBytes(info.mac);
+}
+
+template <typename Body>
+double nsPerRun(Body body) {
+    body();
+    size_t runs = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (elapsed < std::chrono::milliseconds(200)) {
+        body();
+        runs++;
+        elapsed = Clock::now() - start;
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+}
+
+}
+
+int main() {
+    std::vector<DeviceInfo> fleet = makeFleet(kFleetSize);
+
+    size_t vectorBytes = fleet.capacity() * sizeof(DeviceInfo);
+    for (const auto& info : fleet) {
+        vectorBytes += infoHeapBytes(info);
+    }
+
+    // make_shared: control block and DeviceInfo in one allocation, plus the pointer
+    std::vector<std::shared_ptr<const DeviceInfo>> snapshot;
+    snapshot.reserve(fleet.size());
+    for (const auto& info : fleet) {
+        snapshot.push_back(std::make_shared<DeviceInfo>(info));
+    }
+    size_t snapshotBytes = snapshot.capacity() * sizeof(snapshot[0]);
+    for (const auto& info : fleet) {
+        snapshotBytes += 16 + sizeof(DeviceInfo) + infoHeapBytes(info);
+    }
+
+    DeviceStateStore store;
+    for (const auto& info : fleet) {
+        store.insert(info);
+    }
+    size_t storeBytes = store.memoryUsage();
+
+    for (size_t i = 0; i < fleet.size(); i += 997) {
+        DeviceInfo copy;
+        if (!store.get(fleet[i].deviceId, copy) || copy.ip != fleet[i].ip || copy.mac != fleet[i].mac ||
+            copy.model != fleet[i].model || copy.isOn != fleet[i].isOn || copy.hue != fleet[i].hue) {
+            std::cerr << "store disagrees with DeviceInfo for device " << i << std::endl;
+            return 1;
+        }
+    }
+
+    size_t online = 0;
+    size_t on = 0;
+    double vectorCountNs = nsPerRun([&]() {
+        online = 0;
+        on = 0;
+        for (const auto& info : fleet) {
+            online += info.isOnline;
+            on += info.isOn;
+        }
+    });
+    DeviceCounts counts{};
+    double storeCountNs = nsPerRun([&]() { counts = store.counts(); });
+    if (counts.online != online || counts.on != on || counts.total != fleet.size()) {
+        std::cerr << "store counts disagree" << std::endl;
+        return 1;
+    }
+
+    std::cout << kFleetSize << " devices" << std::endl;
+    std::cout << std::left << std::setw(14) << "layout" << std::setw(14) << "MB"
+              << std::setw(18) << "bytes/device" << "online+on count us" << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(14) << "DeviceInfo" << std::setw(14) << vectorBytes / 1e6
+              << std::setw(18) << static_cast<double>(vectorBytes) / kFleetSize << vectorCountNs / 1000 << std::endl
+              << std::setw(14) << "snapshot" << std::setw(14) << snapshotBytes / 1e6
+              << std::setw(18) << static_cast<double>(snapshotBytes) / kFleetSize << "-" << std::endl
+              << std::setw(14) << "state store" << std::setw(14) << storeBytes / 1e6
+              << std::setw(18) << static_cast<double>(storeBytes) / kFleetSize << storeCountNs / 1000 << std::endl;
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "sysinfo_parser.h"
+#include "tplink_device.h"
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+// Cost of turning a decrypted get_sysinfo response into DeviceInfo.
+//
+//   jsoncpp - Json::Reader DOM followed by field copies (the old path)
+//   parser  - SysinfoParser walking the response in place
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<size_t> g_allocations{0};
+
+const char* kPlugResponse =
+    "{\"system\":{\"get_sysinfo\":{\"sw_ver\":\"1.5.6 Build 191125 Rel.083657\",\"hw_ver\":\"2.0\","
+    "\"type\":\"IOT.SMARTPLUGSWITCH\",\"model\":\"HS100(US)\",\"mac\":\"50:C7:BF:12:34:56\","
+    "\"dev_name\":\"Smart Wi-Fi Plug\",\"alias\":\"Living Room Lamp\",\"relay_state\":1,"
+    "\"on_time\":3521,\"active_mode\":\"none\",\"feature\":\"TIM\",\"updating\":0,\"icon_hash\":\"\","
+    "\"rssi\":-52,\"led_off\":0,\"longitude_i\":0,\"latitude_i\":0,"
+    "\"hwId\":\"A0E3CC8F5C1166B27A16D56BE262A6D3\",\"fwId\":\"00000000000000000000000000000000\","
+    "\"deviceId\":\"8006A1B2C3D4E5F60718293A4B5C6D7E8F901234\",\"oemId\":\"FFF22CFF774A0B89F7624BFC6F50D5DE\","
+    "\"next_action\":{\"type\":-1},\"err_code\":0}}}";
+
+const char* kBulbResponse =
+    "{\"system\":{\"get_sysinfo\":{\"sw_ver\":\"1.8.11 Build 191113 Rel.105336\",\"hw_ver\":\"1.0\","
+    "\"model\":\"LB130(US)\",\"description\":\"Smart Wi-Fi LED Bulb with Color Changing\","
+    "\"alias\":\"Bedroom \\\"Reading\\\" Light\",\"mic_type\":\"IOT.SMARTBULB\",\"dev_state\":\"normal\","
+    "\"mac\":\"50:C7:BF:AB:CD:EF\",\"deviceId\":\"80120B1C2D3E4F5A6B7C8D9EAFB0C1D2E3F40516\","
+    "\"oemId\":\"D5C424D3C480911C3F6C4C0C0B1C8D3E\",\"hwId\":\"111E35908497A05512E259BB76801E10\","
+    "\"is_factory\":false,\"disco_ver\":\"1.0\",\"ctrl_protocols\":{\"name\":\"Linkie\",\"version\":\"1.0\"},"
+    "\"light_state\":{\"on_off\":1,\"mode\":\"normal\",\"hue\":120,\"saturation\":75,\"color_temp\":0,"
+    "\"brightness\":60},\"is_dimmable\":1,\"is_color\":1,\"is_variable_color_temp\":1,"
+    "\"preferred_state\":[{\"index\":0,\"hue\":0,\"saturation\":0,\"color_temp\":2700,\"brightness\":50},"
+    "{\"index\":1,\"hue\":0,\"saturation\":100,\"color_temp\":0,\"brightness\":100}],"
+    "\"rssi\":-61,\"active_mode\":\"none\",\"heapsize\":302452,\"err_code\":0}}}";
+
+bool jsoncppParse(const std::string& response, DeviceInfo& info) {
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(response, root)) {
+        return false;
+    }
+    if (!root.isMember("system") || !root["system"].isMember("get_sysinfo")) {
+        return false;
+    }
+
+    Json::Value sysinfo = root["system"]["get_sysinfo"];
+    info.deviceId = sysinfo.get("deviceId", "").asString();
+    info.name = sysinfo.get("alias", "").asString();
+    info.model = sysinfo.get("model", "").asString();
+    info.mac = sysinfo.get("mac", "").asString();
+    info.isOnline = true;
+
+    if (sysinfo.isMember("light_state")) {
+        Json::Value lightState = sysinfo["light_state"];
+        info.isOn = lightState.get("on_off", 0).asInt() == 1;
+        info.brightness = lightState.get("brightness", 0).asInt();
+        info.colorTemp = lightState.get("color_temp", 4000).asInt();
+        info.hue = lightState.get("hue", 0).asInt();
+        info.saturation = lightState.get("saturation", 0).asInt();
+    } else if (sysinfo.isMember("relay_state")) {
+        info.isOn = sysinfo.get("relay_state", 0).asInt() == 1;
+    }
+    return true;
+}
+
+bool sameInfo(const DeviceInfo& a, const DeviceInfo& b) {
+    return a.deviceId == b.deviceId && a.name == b.name && a.model == b.model && a.mac == b.mac &&
+           a.isOnline == b.isOnline && a.isOn == b.isOn && a.brightness == b.brightness &&
+           a.colorTemp == b.colorTemp && a.hue == b.hue && a.saturation == b.saturation;
+}
+
+DeviceInfo blankInfo() {
+    DeviceInfo info{};
+    info.colorTemp = 4000;
+    return info;
+}
+
+struct Measurement {
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+Measurement measure(const std::function<void()>& body) {
+    for (int i = 0; i < 1000; ++i) {
+        body();
+    }
+
+    size_t iterations = 0;
+    size_t allocsBefore = g_allocations.load();
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (elapsed < std::chrono::milliseconds(200)) {
+        for (int i = 0; i < 1000; ++i) {
+            body();
+        }
+        iterations += 1000;
+        elapsed = Clock::now() - start;
+    }
+    size_t allocs = g_allocations.load() - allocsBefore;
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    return Measurement{ns / iterations, static_cast<double>(allocs) / iterations};
+}
+
+}
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main() {
+    struct Sample {
+        const char* name;
+        std::string response;
+    } samples[] = {
+        {"plug", kPlugResponse},
+        {"bulb", kBulbResponse},
+    };
+
+    std::cout << std::left << std::setw(8) << "sample" << std::setw(8) << "bytes"
+              << std::setw(14) << "jsoncpp ns" << std::setw(14) << "parser ns"
+              << std::setw(10) << "speedup" << std::setw(16) << "jsoncpp allocs"
+              << "parser allocs" << std::endl;
+
+    for (const auto& sample : samples) {
+        DeviceInfo expected = blankInfo();
+        DeviceInfo actual = blankInfo();
+        if (!jsoncppParse(sample.response, expected) || !SysinfoParser::parse(sample.response, actual) ||
+            !sameInfo(expected, actual)) {
+            std::cerr << "parser disagrees with jsoncpp on " << sample.name << std::endl;
+            return 1;
+        }
+
+        // Both paths write into a long-lived DeviceInfo, as TPLinkDevice does
+        DeviceInfo info = blankInfo();
+        Measurement legacy = measure([&]() { jsoncppParse(sample.response, info); });
+        Measurement parser = measure([&]() { SysinfoParser::parse(sample.response, info); });
+
+        std::cout << std::fixed << std::setprecision(1) << std::left
+                  << std::setw(8) << sample.name << std::setw(8) << sample.response.size()
+                  << std::setw(14) << legacy.nsPerOp << std::setw(14) << parser.nsPerOp
+                  << std::setw(10) << legacy.nsPerOp / parser.nsPerOp
+                  << std::setw(16) << legacy.allocsPerOp << parser.allocsPerOp << std::endl;
+    }
+
+    return 0;
+}
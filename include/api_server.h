@@ -5,10 +5,16 @@
 #include <string>
 #include <memory>
 #include <thread>
+#include <vector>
 #include <atomic>
+#include <cstdint>
 
 class APIServer {
 public:
+    static const int kMaxEventStreams = 4; // Each holds an HTTP worker thread
+    static constexpr size_t kMaxHistorySamples = 10000; // Per history request
+    static constexpr int64_t kDefaultHistoryMs = 24 * 60 * 60 * 1000LL; // When from is omitted
+
     APIServer(int port = 8080);
     ~APIServer();
 
@@ -26,9 +32,18 @@ private:
     void setupRoutes();
     void runServer();
     
+    // Serialized /api/devices/live body, reused while the snapshot version holds
+    struct LiveBody {
+        uint64_t version;
+        std::string body;
+    };
+    
     int port_;
     std::shared_ptr<DeviceManager> deviceManager_;
     std::shared_ptr<Database> database_;
+    std::shared_ptr<const LiveBody> live_body_; // Only accessed through std::atomic_load/store
+    uint64_t db_subscription_; // Event bus subscription that keeps the database current
+    std::atomic<int> event_streams_;
     std::thread server_thread_;
     std::atomic<bool> running_;
     std::atomic<bool> should_stop_;
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <random>
+
+enum class BreakerState { Closed, Open, HalfOpen };
+
+struct BreakerStatus {
+    BreakerState state;
+    int consecutiveFailures;
+    int retryAfterMs;   // Until the next probe is let through; 0 unless open
+    uint64_t rejected;  // Calls failed fast since the breaker was created
+};
+
+// Per-device failure tracking. After kFailureThreshold consecutive failures
+// the breaker opens and calls fail fast for a backoff that doubles with each
+// failed probe, up to kMaxBackoffMs, with half of it randomized so devices
+// that dropped together don't all come back to be probed at once. When the
+// backoff has passed a single call is let through as a half-open probe; its
+// success closes the breaker, its failure reopens it. Thread-safe.
+class CircuitBreaker {
+public:
+    static constexpr int kFailureThreshold = 3;
+    static constexpr int kBaseBackoffMs = 1000;
+    static constexpr int kMaxBackoffMs = 300000;
+
+    CircuitBreaker();
+
+    // False when the call must fail fast. A true result must be followed by
+    // recordSuccess() or recordFailure().
+    bool allow();
+    void recordSuccess();
+    void recordFailure();
+
+    BreakerStatus status();
+
+    static const char* stateName(BreakerState state);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex mutex_;
+    BreakerState state_;
+    int failures_;
+    int openings_;          // Consecutive times opened without a successful probe
+    bool probe_in_flight_;
+    Clock::time_point retry_at_;
+    uint64_t rejected_;
+    std::minstd_rand rng_;
+};
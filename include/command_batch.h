@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Result of one operation inside a coalesced request
+struct OperationResult {
+    std::string operation; // "power", "brightness", "colorTemp", "color" or "refresh"
+    bool success;
+    int errCode;           // Kasa err_code, or -1 if the device didn't answer for it
+    std::string error;
+};
+
+struct BatchResult {
+    bool success;          // Every operation succeeded
+    std::vector<OperationResult> results;
+};
+
+// Device state a batch sets; -1 where it leaves a field alone
+struct BatchTarget {
+    int on;
+    int brightness;
+    int colorTemp;
+    int hue;
+    int saturation;
+};
+
+// Several pending operations for one device merged into a single Kasa
+// request. Later light_state operations override earlier fields, repeated
+// operations of the same kind collapse into the last one, and a refresh is
+// sent as get_sysinfo after the writes in the same frame.
+class CommandBatch {
+public:
+    CommandBatch();
+
+    CommandBatch& setPower(bool on);
+    CommandBatch& setBrightness(int brightness);    // 0-100
+    CommandBatch& setColorTemp(int temp);           // 2700-6500K
+    CommandBatch& setColor(int hue, int saturation, int value);
+    CommandBatch& refresh();
+    CommandBatch& merge(const CommandBatch& later); // Replays later's operations on top of this one
+
+    bool empty() const;
+    bool valid() const;    // All parameters were within range
+    bool hasRefresh() const;
+    std::vector<std::string> operationNames() const;
+    BatchTarget target() const;
+
+    // Request JSON. Bulbs take power as light_state on_off, plugs as relay_state.
+    std::string toJson(bool isBulb) const;
+
+    // Splits a device response back into one result per operation
+    BatchResult parseResponse(const std::string& response, bool isBulb) const;
+
+private:
+    struct Operation {
+        std::string name;
+        bool lightState; // Served by set_light_state rather than system
+        int args[3];     // Setter arguments, for merge()
+    };
+
+    void addOperation(const std::string& name, bool lightState, int arg0 = 0, int arg1 = 0, int arg2 = 0);
+
+    std::vector<Operation> operations_;
+    bool valid_;
+    bool refresh_;
+
+    // Merged light_state fields; -1 means not set
+    int power_;
+    int onOff_;
+    int brightness_;
+    int colorTemp_;
+    int hue_;
+    int saturation_;
+};
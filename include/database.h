@@ -1,11 +1,127 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include "tplink_device.h"
 
+struct DeviceGroup {
+    std::string groupId;
+    std::string name;
+    std::vector<std::string> deviceIds;
+};
+
+// Target state for one device in a scene; -1 leaves a setting unchanged
+struct SceneTarget {
+    std::string deviceId;
+    bool isOn;
+    int brightness;
+    int colorTemp;
+    int hue;
+    int saturation;
+};
+
+struct Scene {
+    std::string sceneId;
+    std::string name;
+    std::vector<SceneTarget> targets;
+};
+
+// One recorded state change
+struct StateSample {
+    int64_t timestampMs; // Unix time
+    bool isOnline;
+    bool isOn;
+    int brightness;
+    int colorTemp;
+    int hue;
+    int saturation;
+};
+
+enum class HistoryResolution { Raw, Minute, Hour };
+
+// A device's changes within one minute or hour. Buckets without changes
+// have no rollup; the state at the end of the previous one carries over.
+// Durations only cover time whose state is known, so the first bucket
+// after history begins may account for less than its width.
+struct StateRollup {
+    int64_t bucketMs;    // Start, Unix time
+    int changes;
+    int64_t onMs;        // Time switched on
+    int64_t onlineMs;
+    int brightnessAvg;   // Time-weighted
+    int brightnessMin;
+    int brightnessMax;
+    bool isOnline;       // State at the end of the bucket
+    bool isOn;
+    int brightness;
+};
+
+// How long history is kept, in milliseconds. Discovery records follow raw.
+struct HistoryRetention {
+    int64_t rawMs;
+    int64_t minuteMs;
+    int64_t hourMs;
+};
+
+struct DatabaseCacheStats {
+    size_t devices;
+    uint64_t hits;       // getDevice() calls that found the device
+    uint64_t misses;     // getDevice() calls for unknown ids
+    uint64_t scans;      // List reads
+    uint64_t checks;     // Reads compared against the table in check mode
+    uint64_t mismatches; // Reads where the cache and the table disagreed
+};
+
+struct DatabaseWriteStats {
+    uint64_t queued;     // Device writes and discovery records accepted
+    uint64_t coalesced;  // Device writes folded into one already queued
+    uint64_t committed;  // Rows written
+    uint64_t batches;    // Transactions committed
+    uint64_t failed;     // Rows lost to failed transactions
+    size_t pending;
+};
+
+// Aggregates over the stored devices, all taken at one instant
+struct DeviceStatistics {
+    size_t total;
+    size_t online;
+    size_t offline;
+    size_t on;
+    size_t off;
+    int averageBrightness; // Over devices switched on; 0 when none are
+    std::map<std::string, size_t> byModel;
+};
+
+// SQLite store in WAL mode. Device and discovery writes are write-behind:
+// they queue and return, and a writer thread commits them in grouped
+// transactions, folding writes to the same device into one row. Device
+// reads never reach SQLite: the devices table is loaded into a cache keyed
+// by device id, which every device write updates before it is queued, and
+// device statistics are running totals kept alongside it. Group and scene
+// changes are written before their calls return.
+//
+// State changes are also kept as a time series. The writer thread rolls
+// them up into minute and hour buckets once a bucket has closed, and drops
+// history past its retention.
 class Database {
 public:
+    static constexpr size_t kMaxBatchWrites = 1000;
+    static constexpr int kMaxBatchDelayMs = 50; // From the first write queued
+    static constexpr int64_t kMaintenanceIntervalMs = 60 * 1000;
+    static constexpr int64_t kRollupLagMs = 10 * 1000; // Buckets close this long after they end
+    static constexpr int64_t kDayMs = 24 * 60 * 60 * 1000LL;
+    static constexpr HistoryRetention kDefaultRetention = {7 * kDayMs, 30 * kDayMs, 365 * kDayMs};
+
     Database(const std::string& dbPath = "tplink_devices.db");
     ~Database();
 
@@ -13,7 +129,7 @@ public:
     bool initialize();
     bool isOpen();
     
-    // Device management
+    // Device management. Writes return false only if the database isn't open.
     bool addDevice(const DeviceInfo& device);
     bool updateDevice(const DeviceInfo& device);
     bool removeDevice(const std::string& deviceId);
@@ -25,23 +141,191 @@ public:
     bool updateDeviceStatus(const std::string& deviceId, bool isOnline);
     bool updateDeviceState(const std::string& deviceId, bool isOn, int brightness = -1, 
                           int colorTemp = -1, int hue = -1, int saturation = -1);
+    bool updateDevices(const std::vector<DeviceInfo>& devices); // Online and light state
+    
+    // Blocks until everything queued so far is committed
+    void flush();
+    DatabaseWriteStats getWriteStats();
+    
+    // Check mode repeats every device read against the table and logs and
+    // counts differences. Meant for tests; it costs the reads the cache saves.
+    void setCacheCheck(bool enabled);
+    // Ids whose cached row differs from the table, or is missing from either
+    std::vector<std::string> verifyCache();
+    DatabaseCacheStats getCacheStats();
+    
+    // Groups and scenes. Saving replaces any existing one with the same id.
+    bool saveGroup(const DeviceGroup& group);
+    bool removeGroup(const std::string& groupId);
+    DeviceGroup getGroup(const std::string& groupId); // Empty groupId if not found
+    std::vector<DeviceGroup> getAllGroups();
+    bool saveScene(const Scene& scene);
+    bool removeScene(const std::string& sceneId);
+    Scene getScene(const std::string& sceneId);       // Empty sceneId if not found
+    std::vector<Scene> getAllScenes();
     
     // Device discovery history
     bool addDiscoveryRecord(const std::string& ip, const std::string& deviceId, 
                            const std::string& model, bool success);
     std::vector<std::string> getKnownIPs();
     
-    // Statistics
+    // State history. recordState() is queued with the other writes.
+    bool recordState(const DeviceInfo& device, int64_t timestampMs);
+    // Changes in [fromMs, toMs), oldest first, preceded by the last change
+    // before fromMs (the state at fromMs) when there is one
+    std::vector<StateSample> getStateHistory(const std::string& deviceId, int64_t fromMs, int64_t toMs,
+                                             size_t limit);
+    // Buckets starting in [fromMs, toMs), oldest first. Resolution Minute or Hour.
+    std::vector<StateRollup> getStateRollups(const std::string& deviceId, HistoryResolution resolution,
+                                             int64_t fromMs, int64_t toMs);
+    void setHistoryRetention(const HistoryRetention& retention);
+    
+    // Statistics, from running totals rather than table scans
+    DeviceStatistics getStatistics();
     int getDeviceCount();
     int getOnlineDeviceCount();
     int getOfflineDeviceCount();
     
 private:
+    // Every statement the class runs, prepared once by initialize() and
+    // reset after each use. Indexes statements_.
+    enum Statement {
+        kUpsertDevice,
+        kDeleteDevice,
+        kSelectDevice,
+        kSelectAllDevices,
+        kSelectDevicesByStatus,
+        kUpdateDeviceFields,
+        kUpsertGroup,
+        kDeleteGroup,
+        kDeleteGroupMembers,
+        kInsertGroupMember,
+        kSelectGroup,
+        kSelectAllGroups,
+        kUpsertScene,
+        kDeleteScene,
+        kDeleteSceneTargets,
+        kInsertSceneTarget,
+        kSelectScene,
+        kSelectAllScenes,
+        kInsertDiscoveryRecord,
+        kSelectKnownIPs,
+        kSelectHistoryKey,
+        kInsertHistoryKey,
+        kSelectHistoryKeys,
+        kInsertHistory,
+        kSelectHistoryRange,
+        kSelectHistoryBefore,
+        kDeleteHistoryBefore,
+        kUpsertRollup,
+        kSelectRollups,
+        kDeleteRollupsBefore,
+        kSelectRollupProgress,
+        kUpsertRollupProgress,
+        kDeleteDiscoveryRecordsBefore,
+        kBegin,
+        kCommit,
+        kRollback,
+        kStatementCount
+    };
+
+    // A device's queued writes, folded together. Settings of -1 are left
+    // as they are; an upsert carries the whole row.
+    struct PendingDevice {
+        enum Kind { Update, Upsert, Remove } kind;
+        DeviceInfo device;
+        int isOnline;
+        int isOn;
+        int brightness;
+        int colorTemp;
+        int hue;
+        int saturation;
+    };
+
+    struct DiscoveryRecord {
+        std::string ip;
+        std::string deviceId;
+        std::string model;
+        bool success;
+    };
+
+    struct HistoryEntry {
+        std::string deviceId;
+        StateSample sample;
+    };
+
     std::string dbPath_;
     void* db_; // sqlite3* (using void* to avoid including sqlite3.h in header)
+    void* statements_[kStatementCount]; // sqlite3_stmt*
+    std::mutex mutex_; // A prepared statement can only serve one caller at a time
+    
+    bool executeQuery(const std::string& query); // Schema setup only
+    bool prepareStatements();
+    // Folds fields (Update, settings set) into the device's queued write
+    bool queueUpdate(const std::string& deviceId, const PendingDevice& fields);
+    static void applyFields(DeviceInfo& device, const PendingDevice& fields);
+    void queued(bool wasEmpty); // Needs queue_mutex_; counts the write and wakes the writer
+    size_t pendingWrites() const; // Needs queue_mutex_
+    std::vector<DeviceInfo> cachedDevices(int isOnline); // -1 for all, in table order
+    // Everything below to tally() needs cache_mutex_ held exclusively
+    void cachePut(const DeviceInfo& device);
+    void cacheErase(const std::string& deviceId);
+    void tally(const DeviceInfo& device, int sign); // Adds (1) or takes (-1) device from the totals
+    // Waits until nothing is queued or being committed, and returns holding
+    // queue_mutex_ so that no write can start
+    std::unique_lock<std::mutex> quiesce();
+    void runWriter();
+    bool commit(const std::unordered_map<std::string, PendingDevice>& devices,
+                const std::vector<DiscoveryRecord>& records, const std::vector<HistoryEntry>& history);
+    // Everything below needs mutex_
+    int64_t historyKey(const std::string& deviceId, bool create); // -1 if unknown
+    std::vector<StateSample> historyRange(int64_t key, int64_t fromMs, int64_t toMs, size_t limit);
+    std::vector<DeviceInfo> selectDevices(Statement statement, int isOnline); // isOnline for kSelectDevicesByStatus
+    bool rollUp(int64_t widthMs, int64_t nowMs, int64_t rawRetentionMs);
+    bool maintain(const HistoryRetention& retention, int64_t nowMs); // Rollups, then retention
+    // Runs body inside BEGIN/COMMIT, rolling back if it returns false. Needs mutex_.
+    bool transaction(const std::function<bool()>& body);
+    std::vector<DeviceGroup> getGroups(Statement statement, const std::string& groupId);
+    std::vector<Scene> getScenes(Statement statement, const std::string& sceneId);
+
+    // Write-behind queue, guarded by queue_mutex_
+    std::mutex queue_mutex_;
+    std::condition_variable writer_wake_;
+    std::condition_variable flushed_;
+    std::unordered_map<std::string, PendingDevice> pending_devices_;
+    std::vector<DiscoveryRecord> pending_records_;
+    std::vector<HistoryEntry> pending_history_;
+    std::unordered_map<std::string, StateSample> last_recorded_; // Per device, to drop repeats
+    std::chrono::steady_clock::time_point first_queued_at_;
+    uint64_t committed_through_; // Writes accepted before the last commit, by stats_.queued
+    bool flush_requested_;
+    bool stopping_;
+    DatabaseWriteStats stats_;
+    HistoryRetention retention_;
+    std::chrono::steady_clock::time_point next_maintenance_;
+    std::thread writer_;
+    
+    std::unordered_map<std::string, int64_t> history_keys_; // Guarded by mutex_
     
-    bool executeQuery(const std::string& query);
-    bool executeQueryWithResult(const std::string& query, 
-                               std::function<int(void*, int, char**, char**)> callback,
-                               void* data = nullptr);
+    // Device cache. Writers hold queue_mutex_ as well, so the cache and the
+    // queue see writes in the same order.
+    // Rows are held in listing order (name, then id) and indexed by id.
+    using CacheOrder = std::map<std::pair<std::string, std::string>, DeviceInfo>;
+    mutable std::shared_mutex cache_mutex_;
+    CacheOrder cache_order_;
+    std::unordered_map<std::string, CacheOrder::iterator> cache_;
+    struct CacheTotals {
+        size_t devices;
+        size_t online;
+        size_t on;
+        int64_t brightnessOn; // Summed over devices switched on
+        std::unordered_map<std::string, size_t> models;
+    };
+    CacheTotals cache_totals_;
+    std::atomic<bool> cache_check_;
+    std::atomic<uint64_t> cache_hits_;
+    std::atomic<uint64_t> cache_misses_;
+    std::atomic<uint64_t> cache_scans_;
+    std::atomic<uint64_t> cache_checks_;
+    std::atomic<uint64_t> cache_mismatches_;
 };
@@ -1,22 +1,95 @@
 #pragma once
 
 #include "tplink_device.h"
+#include "io_engine.h"
+#include "executor.h"
+#include "udp_discovery.h"
+#include "network_sweep.h"
+#include "device_registry.h"
+#include "device_state_store.h"
+#include "event_bus.h"
+#include "timing_wheel.h"
+#include <chrono>
+#include <deque>
+#include <random>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <cstdint>
+
+// Published view of every managed device, in registry order. Never modified
+// once published, so readers can keep it as long as they like.
+struct DeviceSnapshot {
+    uint64_t version = 1; // Bumped on every publication
+    std::vector<std::shared_ptr<const DeviceInfo>> devices;
+};
+
+// Outcome of one device's share of a fan-out
+struct FanOutResult {
+    std::string deviceId;
+    bool success;
+    bool timedOut;     // Still unanswered at the deadline
+    double latencyMs;  // Until the device answered, or the deadline
+    std::string error; // Set when the request as a whole failed
+    std::vector<OperationResult> results;
+};
+
+struct MonitorStats {
+    size_t scheduled; // Devices waiting for their next poll
+    size_t backlog;   // Due but held back by the poll budget
+    size_t inFlight;
+    uint64_t polls;   // Sent since startup
+    double pollRate;  // Budget, polls per second
+};
+
+struct BreakerReport {
+    std::string deviceId;
+    BreakerStatus status;
+};
+
+struct BreakerStats {
+    size_t open;       // Failing fast, half-open included
+    uint64_t rejected; // Calls failed fast since startup
+    std::vector<BreakerReport> tripped; // Every device whose breaker isn't closed
+};
 
 class DeviceManager {
 public:
+    static constexpr size_t kMonitorConcurrency = 64; // Status polls in flight at once
+    static constexpr int kPollIntervalMs = 30000;     // Starting interval for new devices
+    static constexpr int kMinPollIntervalMs = 5000;   // After a state change or a command
+    static constexpr int kMaxPollIntervalMs = 300000; // Stable and offline devices back off up to this
+    static constexpr int kPollTickMs = 100;
+    static constexpr double kDefaultPollRate = 50.0;
+    static constexpr int kDefaultFanOutDeadlineMs = 2000;
+
     DeviceManager();
     ~DeviceManager();
 
     // Device discovery and management
     std::vector<DeviceInfo> discoverDevices();
-    bool addDevice(const std::string& ip, int port = 9999);
+    void setDiscoveryWindow(int windowMs); // UDP reply collection window
+    void addDiscoveryTarget(const std::string& address); // Probed alongside interface broadcasts
+    
+    // TCP sweep of CIDR ranges for networks that block broadcast. onDevice is
+    // called on the calling thread as devices answer; returning false stops
+    // the sweep. Hosts that are already managed are skipped, so only new
+    // devices are reported. Returns false if a range is malformed.
+    bool sweepDevices(const std::vector<std::string>& cidrs, std::function<bool(const DeviceInfo&)> onDevice,
+                      size_t concurrency = NetworkSweep::kDefaultConcurrency,
+                      int probeTimeoutMs = NetworkSweep::kDefaultProbeTimeoutMs);
+    bool addDevice(const std::string& ip, int port = 9999); // False for unreachable or already managed devices
     bool removeDevice(const std::string& deviceId);
-    std::vector<DeviceInfo> getAllDevices();
+    std::vector<DeviceInfo> getAllDevices(); // From the state store, like the other DeviceInfo reads below
+    
+    // Current device list without taking any lock. Device changes mark the
+    // snapshot stale and a new version is published when the manager call
+    // or monitoring pass that caused them finishes.
+    std::shared_ptr<const DeviceSnapshot> getSnapshot();
     std::shared_ptr<TPLinkDevice> getDevice(const std::string& deviceId);
     
     // Device control
@@ -26,24 +99,93 @@ public:
     bool setDeviceBrightness(const std::string& deviceId, int brightness);
     bool setDeviceColor(const std::string& deviceId, int hue, int saturation, int value);
     bool setDeviceColorTemp(const std::string& deviceId, int temp);
+    BatchResult applyBatch(const std::string& deviceId, const CommandBatch& batch);
     
-    // Status monitoring
+    // Sends every batch to its device at once and waits at most deadlineMs
+    // for the answers, for groups and scenes. Results are in input order.
+    std::vector<FanOutResult> applyBatches(const std::vector<std::pair<std::string, CommandBatch>>& batches,
+                                           int deadlineMs = kDefaultFanOutDeadlineMs);
+    
+    // Status monitoring. Each device has its own jittered poll deadline:
+    // changed or just commanded devices are polled again soon, stable and
+    // offline ones back off exponentially, and polls are paced to an overall
+    // rate rather than sent in bursts.
     void startMonitoring();
     void stopMonitoring();
     bool isMonitoring();
+    void setPollRate(double pollsPerSecond);
+    MonitorStats getMonitorStats();
     
     // Device information
     DeviceInfo getDeviceInfo(const std::string& deviceId);
     std::vector<DeviceInfo> getOnlineDevices();
     std::vector<DeviceInfo> getOfflineDevices();
+    // Typed events for every change in a managed device's state, whether
+    // seen by a poll or caused by a command
+    std::shared_ptr<EventBus> getEventBus();
+    
+    // Counted from the state store without copying any device
+    DeviceCounts getDeviceCounts();
+    size_t getStateStoreMemory();
+    
+    // Circuit breakers of unreachable devices. Unknown ids report closed.
+    BreakerStatus getBreakerStatus(const std::string& deviceId);
+    BreakerStats getBreakerStats();
+    
+    // Connection pool statistics
+    IOPoolStats getConnectionStats();
+    
+    // Shared worker pool. Device I/O completions run on it, monitoring and
+    // discovery in the background lane.
+    std::shared_ptr<Executor> getExecutor();
+    ExecutorStats getExecutorStats();
     
 private:
     void monitoringLoop();
-    void updateDeviceStatus();
+    void pollCompleted(const std::string& deviceId, bool changed);
+    void schedulePoll(const std::string& deviceId, int intervalMs); // Needs poll_mutex_
+    void commandSent(const std::string& deviceId);
+    uint64_t pollTick() const;
+    bool manage(const std::shared_ptr<TPLinkDevice>& device); // Registers and watches for state changes; needs an id
+    void publishSnapshot(); // No-op unless something changed
     
-    std::vector<std::shared_ptr<TPLinkDevice>> devices_;
-    std::mutex devices_mutex_;
+    std::shared_ptr<Executor> executor_; // Before engine_, which dispatches to it
+    std::shared_ptr<IOEngine> engine_;
+    std::atomic<int> discovery_window_ms_;
+    std::vector<std::string> discovery_targets_;
+    DeviceRegistry registry_;
+    // Serves device reads and counts; kept current by each device's state listener
+    std::shared_ptr<DeviceStateStore> state_store_;
+    std::shared_ptr<EventBus> event_bus_;           // Fed by the same listener
+    std::shared_ptr<const DeviceSnapshot> snapshot_; // Only accessed through std::atomic_load/store
+    std::shared_ptr<std::atomic<bool>> snapshot_dirty_;
+    std::mutex publish_mutex_;
     std::thread monitoring_thread_;
     std::atomic<bool> monitoring_active_;
     std::atomic<bool> should_stop_;
+    std::mutex monitor_mutex_; // Lets stopMonitoring() cut the wait short
+    std::condition_variable monitor_cv_;
+    
+    // Handed to poll callbacks instead of the manager, and kept across
+    // monitoring restarts so late completions still get rescheduled
+    struct PollCompletion {
+        std::string deviceId;
+        uint64_t version; // State store version when the poll was sent
+        bool success;
+    };
+    struct PollCompletions {
+        std::mutex mutex;
+        std::vector<PollCompletion> done;
+    };
+    std::shared_ptr<PollCompletions> poll_completions_;
+    
+    std::mutex poll_mutex_; // Guards the wheel, intervals, backlog and RNG
+    TimingWheel poll_wheel_;
+    std::unordered_map<std::string, int> poll_intervals_;
+    std::deque<std::string> poll_backlog_;
+    std::minstd_rand poll_rng_;
+    const std::chrono::steady_clock::time_point poll_epoch_;
+    std::atomic<double> poll_rate_;
+    std::atomic<size_t> polls_in_flight_;
+    std::atomic<uint64_t> polls_sent_;
 };
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "tplink_device.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Managed devices indexed by deviceId, by MAC and by ip:port. Each index is
+// split into independently locked shards, so lookups from many threads only
+// contend when they hash to the same shard and never copy DeviceInfo.
+// Identity keys are captured at insert time. Inserts and removals are
+// serialised among themselves so that duplicate checks across the three
+// indexes are atomic.
+class DeviceRegistry {
+public:
+    static const size_t kShardCount = 64;
+
+    DeviceRegistry();
+
+    // Fails if the deviceId, MAC or address is already registered
+    bool insert(const std::shared_ptr<TPLinkDevice>& device);
+    bool erase(const std::string& deviceId);
+
+    std::shared_ptr<TPLinkDevice> find(const std::string& deviceId) const;
+    std::shared_ptr<TPLinkDevice> findByMac(const std::string& mac) const;
+    std::shared_ptr<TPLinkDevice> findByAddress(const std::string& ip, int port) const;
+
+    // First match by deviceId, then MAC, then address. Empty keys are skipped.
+    std::shared_ptr<TPLinkDevice> findAny(const std::string& deviceId, const std::string& mac,
+                                          const std::string& ip, int port) const;
+
+    // Every device, in insertion order
+    std::vector<std::shared_ptr<TPLinkDevice>> all() const;
+    size_t size() const;
+
+private:
+    struct Entry {
+        std::shared_ptr<TPLinkDevice> device;
+        std::string deviceId;
+        std::string mac;
+        std::string address;
+        uint64_t sequence;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<const Entry>> entries;
+    };
+
+    class Index {
+    public:
+        std::shared_ptr<const Entry> find(const std::string& key) const;
+        void insert(const std::string& key, const std::shared_ptr<const Entry>& entry);
+        void erase(const std::string& key);
+        void collect(std::vector<std::shared_ptr<const Entry>>& out) const;
+
+    private:
+        Shard& shardFor(const std::string& key);
+        const Shard& shardFor(const std::string& key) const;
+
+        Shard shards_[kShardCount];
+    };
+
+    static std::string addressKey(const std::string& ip, int port);
+
+    Index byId_;
+    Index byMac_;
+    Index byAddress_; // Every device is in this one
+    std::mutex write_mutex_;
+    std::atomic<size_t> size_;
+    uint64_t next_sequence_;
+};
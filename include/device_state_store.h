@@ -0,0 +1,111 @@
+#pragma once
+
+#include "tplink_device.h"
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct DeviceCounts {
+    size_t total;
+    size_t online;
+    size_t on;
+};
+
+// Structure-of-arrays copy of every managed device's state. Each device owns
+// a slot; hot state lives in parallel arrays of small integers (online and
+// on as bitsets, counted 64 devices per popcount). Identity is stored in
+// binary where it can be: Kasa's 40-hex-digit device ids as 20 bytes, IPv4
+// addresses as uint32_t, models and MAC vendor prefixes interned, names in
+// one shared arena. Slots of removed devices are reused. Thread-safe.
+class DeviceStateStore {
+public:
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    DeviceStateStore();
+
+    // Returns the device's slot, reusing it if the id is already stored
+    uint32_t insert(const DeviceInfo& info);
+    // Ignored unless the slot still belongs to info.deviceId
+    void update(uint32_t slot, const DeviceInfo& info);
+    bool erase(const std::string& deviceId);
+
+    bool get(const std::string& deviceId, DeviceInfo& info) const;
+    // In slot order. Offline devices are skipped 64 at a time by bitset word.
+    std::vector<DeviceInfo> all() const;
+    std::vector<DeviceInfo> withStatus(bool online) const;
+    // Changes whenever the device's row is written; 0 for unknown ids
+    uint64_t version(const std::string& deviceId) const;
+    DeviceCounts counts() const;
+    size_t size() const;
+
+    // Bytes held by the arrays, intern tables and id index
+    size_t memoryUsage() const;
+
+private:
+    static constexpr size_t kIdBytes = 20;
+    static constexpr uint16_t kNoMac = UINT16_MAX;
+
+    // Maps a value to a small index for as long as the store lives
+    template <typename Key>
+    struct InternTable {
+        std::vector<Key> values;
+        std::unordered_map<Key, uint16_t> indexes;
+
+        uint16_t intern(const Key& value);
+    };
+
+    // Everything below needs the lock held
+    uint32_t find(const std::string& deviceId, uint32_t hash) const;
+    bool sameId(uint32_t slot, const std::string& deviceId, uint32_t hash) const;
+    std::string idOf(uint32_t slot) const;
+    void read(uint32_t slot, DeviceInfo& info) const;
+    std::vector<DeviceInfo> list(bool onlineOnly, bool offlineOnly) const;
+    void indexInsert(uint32_t slot);
+    void indexErase(uint32_t slot);
+    void write(uint32_t slot, const DeviceInfo& info);
+    void setName(uint32_t slot, const std::string& name);
+    void compactNames();
+    static void setBit(std::vector<uint64_t>& bits, uint32_t slot, bool value);
+    static bool bit(const std::vector<uint64_t>& bits, uint32_t slot);
+    static size_t popcount(const std::vector<uint64_t>& bits);
+
+    mutable std::shared_mutex mutex_;
+
+    // Hot state
+    std::vector<uint64_t> used_;
+    std::vector<uint64_t> online_;
+    std::vector<uint64_t> on_;
+    std::vector<uint8_t> brightness_;
+    std::vector<uint16_t> color_temp_;
+    std::vector<uint16_t> hue_;
+    std::vector<uint8_t> saturation_;
+    std::vector<uint64_t> versions_;
+    uint64_t next_version_;
+
+    // Identity
+    std::vector<uint8_t> ids_;       // kIdBytes per slot
+    std::vector<uint32_t> id_hashes_;
+    std::vector<uint32_t> name_offsets_;
+    std::vector<uint16_t> name_lengths_;
+    std::vector<uint32_t> ips_;      // Host order
+    std::vector<uint16_t> ports_;
+    std::vector<uint16_t> models_;
+    std::vector<uint16_t> mac_prefixes_;
+    std::vector<uint32_t> mac_suffixes_;
+    std::string names_;              // Arena; stale names are dropped by compactNames()
+    size_t stale_name_bytes_;
+
+    // Values that don't fit the binary forms, by slot
+    std::unordered_map<uint32_t, std::string> id_text_;
+    std::unordered_map<uint32_t, std::string> ip_text_;
+
+    InternTable<std::string> model_table_;
+    InternTable<uint32_t> mac_prefix_table_;
+
+    // Open addressing, linear probing; kNoSlot marks an empty bucket
+    std::vector<uint32_t> index_;
+    size_t count_;
+    std::vector<uint32_t> free_slots_;
+};
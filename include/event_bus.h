@@ -0,0 +1,97 @@
+#pragma once
+
+#include "tplink_device.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class DeviceEventType { Online, Offline, Power, Brightness, Color, ColorTemp };
+constexpr size_t kDeviceEventTypeCount = static_cast<size_t>(DeviceEventType::ColorTemp) + 1; // Keep on the last type
+
+struct DeviceEvent {
+    uint64_t sequence;    // Assigned in delivery order, starting at 1
+    DeviceEventType type;
+    std::string deviceId;
+    int64_t timestampMs;  // Unix time the change was seen
+    std::shared_ptr<const DeviceInfo> state; // Device state after the change
+};
+
+struct EventBusStats {
+    uint64_t published;
+    uint64_t delivered;   // Events handed to subscribers, counted once per event
+    size_t subscribers;
+    uint64_t byType[kDeviceEventTypeCount]; // Indexed by DeviceEventType
+};
+
+// Device state-change events. Producers push onto a lock-free
+// multi-producer single-consumer queue (Vyukov's intrusive design) and
+// never block; one dispatcher thread drains it and hands each subscriber
+// everything that arrived since the previous batch, in order. Handlers run
+// on the dispatcher thread, so slow consumers should hand work off.
+class EventBus {
+public:
+    using Handler = std::function<void(const std::vector<DeviceEvent>&)>;
+
+    static const size_t kMaxBatch = 256;
+
+    EventBus();
+    ~EventBus(); // Delivers what is already queued, then stops
+
+    void publish(DeviceEventType type, std::shared_ptr<const DeviceInfo> state);
+    // One event per aspect that differs between the two states. A null
+    // before counts as every aspect having changed.
+    void publishChanges(const std::shared_ptr<const DeviceInfo>& before,
+                        const std::shared_ptr<const DeviceInfo>& after);
+
+    // A batch being delivered while unsubscribe() runs may still reach the
+    // handler, so it must not capture anything that dies with the caller
+    uint64_t subscribe(Handler handler);
+    bool unsubscribe(uint64_t id);
+
+    EventBusStats stats() const;
+    static const char* typeName(DeviceEventType type);
+
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        DeviceEvent event;
+    };
+
+    struct Subscriber {
+        uint64_t id;
+        Handler handler;
+    };
+    using Subscribers = std::vector<Subscriber>;
+
+    void push(Node* node);
+    Node* pop(); // Consumer only; null when empty or a push is half done
+    bool pending() const;
+    void run();
+
+    // Queue: producers swap themselves in at head_, the consumer reads from tail_
+    std::atomic<Node*> head_;
+    Node* tail_;
+    Node stub_;
+
+    std::thread dispatcher_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> sleeping_;
+    std::atomic<bool> stopping_;
+
+    std::mutex subscribe_mutex_;
+    std::shared_ptr<const Subscribers> subscribers_; // Only accessed through std::atomic_load/store
+    uint64_t next_subscriber_;
+
+    std::atomic<uint64_t> published_;
+    std::atomic<uint64_t> delivered_;
+    std::atomic<uint64_t> by_type_[kDeviceEventTypeCount];
+    uint64_t next_sequence_; // Dispatcher only
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Interactive work (API-driven control, fan-outs) always runs ahead of
+// background work (monitoring polls, sweeps) that is already queued
+enum class TaskPriority { Interactive = 0, Background = 1 };
+
+struct ExecutorStats {
+    size_t workers;
+    size_t interactiveQueued;
+    size_t backgroundQueued;
+    uint64_t executed;
+    uint64_t steals;       // Tasks taken from another worker's queue
+};
+
+// Work-stealing thread pool. Each worker has its own queue per priority
+// lane; tasks submitted from a worker stay on that worker, others are
+// spread round-robin. An idle worker takes the oldest task of its own
+// queues and otherwise steals the newest from a sibling, checking every
+// interactive queue before any background one. Queued tasks are run
+// before the destructor returns.
+class Executor {
+public:
+    explicit Executor(size_t workers = 0); // 0 = one per hardware thread
+    ~Executor();
+
+    void submit(std::function<void()> task, TaskPriority priority = TaskPriority::Interactive);
+
+    size_t workerCount() const { return workers_.size(); }
+    ExecutorStats stats() const;
+
+    // True on a worker of any executor. Waiting there for another task
+    // can deadlock once every worker is waiting.
+    static bool onWorkerThread();
+
+private:
+    static const size_t kLanes = 2;
+
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> lanes[kLanes];
+    };
+
+    void run(size_t index);
+    bool take(size_t index, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> sleepers_;
+    bool stopping_; // Guarded by sleep_mutex_
+
+    std::atomic<size_t> queued_[kLanes];
+    std::atomic<size_t> next_worker_;
+    std::atomic<uint64_t> executed_;
+    std::atomic<uint64_t> steals_;
+};
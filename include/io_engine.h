@@ -0,0 +1,140 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+#include "executor.h"
+
+// Outcome of one request/response exchange with a Kasa device
+struct IOResult {
+    bool success;
+    std::string payload; // Response body without the length header (still encrypted)
+    std::string error;
+};
+
+using IOCallback = std::function<void(IOResult)>;
+
+struct IORequest {
+    std::string ip;
+    int port;
+    std::string frame;   // Complete wire frame, 4-byte length header included
+    int timeoutMs;       // Deadline for the whole exchange (connect + write + read)
+    IOCallback callback; // Invoked exactly once, on an engine thread or the engine's executor
+    TaskPriority priority = TaskPriority::Interactive; // Executor lane for the callback
+
+    // Immutable frame with static lifetime, sent instead of frame when set
+    const char* staticFrame = nullptr;
+    size_t staticFrameSize = 0;
+};
+
+// Connection pool counters
+struct IOPoolStats {
+    uint64_t hits;        // Requests served on a warm pooled socket
+    uint64_t misses;      // Requests that needed a new TCP connection
+    uint64_t evictions;   // Idle sockets closed to stay under the fd budget
+    uint64_t idleCloses;  // Idle sockets closed after the idle timeout
+    uint64_t staleCloses; // Idle sockets found half-closed by the peer
+    uint64_t reconnects;  // Requests transparently retried on a fresh socket
+    size_t openConnections;
+    size_t idleConnections;
+};
+
+// Event-driven socket engine. Every device socket is owned by one of a small
+// number of epoll loops; callers submit requests and receive completions.
+// Sockets are kept warm per device (one request in flight per device, others
+// queue) and idle ones are evicted LRU-first under a connection budget.
+// Callbacks run on the loop thread, or on the executor when one is set, and
+// must not block on other engine requests.
+class IOEngine {
+public:
+    IOEngine(size_t threads = 2);
+    ~IOEngine();
+
+    // Engines shared with devices should come from here. Completions hold
+    // device references, so the last reference to the engine can go on one
+    // of its own loop threads; that thread can't join itself, so teardown
+    // is handed to a new thread instead.
+    static std::shared_ptr<IOEngine> create(size_t threads = 2);
+
+    // Engine control. From a loop thread, stop() only stops the loops; what
+    // is still queued fails when the engine is destroyed.
+    void stop();
+    bool isRunning();
+
+    // Request submission
+    void submit(IORequest request);
+    IOResult execute(IORequest request); // Blocking convenience wrapper around submit()
+    void release(const std::string& ip, int port); // Drop the pooled socket of a device
+
+    // Connection pool configuration
+    void setConnectionBudget(size_t maxConnections);
+    void setIdleTimeout(int idleTimeoutMs);
+    void setMaxFrameSize(size_t maxFrameSize); // Larger responses fail the request
+    
+    // Run callbacks on executor lanes instead of the loop threads, so parsing
+    // and follow-up work neither stalls socket handling nor runs ahead of
+    // interactive work. Set before submitting requests. The engine doesn't
+    // keep the executor alive; once it is gone callbacks run inline again.
+    // execute() always completes inline, so it is safe from executor tasks.
+    void setExecutor(std::shared_ptr<Executor> executor);
+
+    // Statistics
+    size_t inFlight();
+    size_t threadCount();
+    IOPoolStats poolStats();
+
+    // Process-wide engine used by devices constructed without an explicit one
+    static std::shared_ptr<IOEngine> shared();
+
+private:
+    enum class Failure { ConnectFailed, TimedOut, Broken, Protocol };
+
+    struct Pending;
+    struct Connection;
+    struct Loop;
+
+    void runLoop(Loop& loop);
+    int nextTimeout(Loop& loop);
+    void drainIncoming(Loop& loop);
+    void enqueue(IORequest request);
+    void dispatch(Loop& loop, Pending pending);
+    void openConnection(Loop& loop, Pending pending);
+    void beginRequest(Loop& loop, Connection& conn, Pending pending);
+    void resetWriter(Connection& conn);
+    void handleEvent(Loop& loop, Connection& conn, uint32_t events);
+    void flushWrite(Loop& loop, Connection& conn);
+    void readResponse(Loop& loop, Connection& conn);
+    void completeRequest(Loop& loop, Connection& conn);
+    void failConnection(Loop& loop, Connection& conn, const std::string& error, Failure failure);
+    void makeIdle(Loop& loop, Connection& conn);
+    void closeConnection(Loop& loop, Connection& conn);
+    void enforceBudget(Loop& loop, size_t reserve);
+    void expireTimers(Loop& loop);
+    void fail(Pending& pending, const std::string& error);
+    Loop& loopFor(const std::string& ip, int port);
+    bool onLoopThread() const;
+
+    std::vector<std::unique_ptr<Loop>> loops_;
+    std::weak_ptr<Executor> executor_;
+    std::atomic<bool> running_;
+    std::mutex stop_mutex_; // Serializes joining and draining the loops
+    std::atomic<size_t> in_flight_;
+    std::atomic<size_t> max_connections_;
+    std::atomic<int> idle_timeout_ms_;
+    std::atomic<size_t> max_frame_size_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> evictions_;
+    std::atomic<uint64_t> idle_closes_;
+    std::atomic<uint64_t> stale_closes_;
+    std::atomic<uint64_t> reconnects_;
+    std::atomic<size_t> open_connections_;
+    std::atomic<size_t> idle_connections_;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Kasa "autokey" cipher. Each plaintext byte is XORed with the previous
+// ciphertext byte, starting from 171. Encryption is therefore a running
+// prefix-XOR of the plaintext, and decryption only depends on adjacent
+// ciphertext bytes, so both can be done a word or vector at a time.
+class KasaCodec {
+public:
+    static const uint8_t kInitialKey = 171;
+    static const size_t kHeaderSize = 4; // Big-endian payload length on TCP
+
+    // Raw cipher. Both work in place (in == out) and return the key state
+    // after the last byte so a stream can be continued across calls.
+    static uint8_t encrypt(const uint8_t* in, uint8_t* out, size_t len, uint8_t key = kInitialKey);
+    static uint8_t decrypt(const uint8_t* in, uint8_t* out, size_t len, uint8_t key = kInitialKey);
+
+    // Writes the length header followed by the ciphertext into out.
+    // Returns the frame size, or 0 if outCapacity is too small.
+    static size_t encodeFrame(const char* plain, size_t len, uint8_t* out, size_t outCapacity);
+    static size_t frameSize(size_t payloadLen) { return payloadLen + kHeaderSize; }
+
+    // String conveniences built on the buffer API
+    static std::string encodeFrame(const std::string& plain);
+    static std::string encrypt(const std::string& plain);   // No header (UDP datagrams)
+    static void decryptInPlace(std::string& data);
+
+    // Byte-at-a-time reference implementations
+    static uint8_t encryptScalar(const uint8_t* in, uint8_t* out, size_t len, uint8_t key = kInitialKey);
+    static uint8_t decryptScalar(const uint8_t* in, uint8_t* out, size_t len, uint8_t key = kInitialKey);
+
+    // Ciphertext of a string literal computed at compile time. endKey lets a
+    // template resume encryption right after a constant prefix.
+    template <size_t N>
+    struct ConstantCipher {
+        char data[N];
+        uint8_t endKey;
+        static constexpr size_t size = N;
+    };
+
+    // Complete wire frame (header + ciphertext) of a string literal
+    template <size_t N>
+    struct ConstantFrame {
+        char data[N + kHeaderSize];
+        static constexpr size_t size = N + kHeaderSize;
+    };
+
+    template <size_t L>
+    static constexpr ConstantCipher<L - 1> encryptConstant(const char (&text)[L]) {
+        ConstantCipher<L - 1> cipher{};
+        uint8_t key = kInitialKey;
+        for (size_t i = 0; i + 1 < L; ++i) {
+            key = static_cast<uint8_t>(key ^ static_cast<uint8_t>(text[i]));
+            cipher.data[i] = static_cast<char>(key);
+        }
+        cipher.endKey = key;
+        return cipher;
+    }
+
+    template <size_t L>
+    static constexpr ConstantFrame<L - 1> encodeConstant(const char (&text)[L]) {
+        ConstantFrame<L - 1> frame{};
+        const size_t len = L - 1;
+        frame.data[0] = static_cast<char>((len >> 24) & 0xFF);
+        frame.data[1] = static_cast<char>((len >> 16) & 0xFF);
+        frame.data[2] = static_cast<char>((len >> 8) & 0xFF);
+        frame.data[3] = static_cast<char>(len & 0xFF);
+        uint8_t key = kInitialKey;
+        for (size_t i = 0; i < len; ++i) {
+            key = static_cast<uint8_t>(key ^ static_cast<uint8_t>(text[i]));
+            frame.data[kHeaderSize + i] = static_cast<char>(key);
+        }
+        return frame;
+    }
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Immutable, already-encrypted wire frame with static storage duration
+struct FrameRef {
+    const char* data;
+    size_t size;
+};
+
+// Wire frames for the commands on the hot control path. Fixed commands are
+// encrypted (length header included) at compile time; parameterised ones
+// splice their numbers into a template whose constant prefix is also
+// pre-encrypted, so no JSON tree is built per call.
+class KasaCommands {
+public:
+    // Fixed commands
+    static FrameRef getSysinfo();
+    static FrameRef relayOn();
+    static FrameRef relayOff();
+    static FrameRef relayToggle();
+    static FrameRef lightOn();   // Smartbulb power, as light_state on_off
+    static FrameRef lightOff();
+
+    // get_sysinfo as a UDP discovery datagram (ciphertext only, no header)
+    static FrameRef getSysinfoDatagram();
+
+    // Parameterised smartbulb light_state commands
+    static std::string setBrightness(int brightness);
+    static std::string setColorTemp(int temp);
+    static std::string setColor(int hue, int saturation, int value);
+};
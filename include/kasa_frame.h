@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Incremental reader for 4-byte big-endian length-prefixed frames.
+// Bytes accumulate in a per-connection growable buffer, so short reads and
+// frames split across several recv() calls are handled transparently.
+class FrameReader {
+public:
+    enum class Status { NeedMore, Complete, Closed, Error, TooLarge };
+
+    static const size_t kDefaultMaxFrameSize = 1 << 20;
+
+    FrameReader(size_t maxFrameSize = kDefaultMaxFrameSize);
+
+    // Reads whatever the (non-blocking) socket has available
+    Status readFrom(int fd);
+
+    // Moves the completed frame's payload (header stripped) into out
+    bool takeFrame(std::string& out);
+
+    void setMaxFrameSize(size_t maxFrameSize);
+    size_t buffered() const;     // Bytes received but not yet consumed
+    int lastError() const;       // errno of the last Error status
+    void reset();                // Drops buffered bytes and trims a large buffer
+
+private:
+    Status parse();
+
+    std::vector<char> buffer_;
+    size_t start_;
+    size_t end_;
+    size_t maxFrameSize_;
+    int lastError_;
+};
+
+// Writes one frame with sendmsg() (MSG_NOSIGNAL, so a closed peer is an
+// error rather than SIGPIPE), resuming after short writes. The header
+// and payload may live in separate buffers, which must stay valid until
+// the write completes.
+class FrameWriter {
+public:
+    enum class Status { Done, WouldBlock, Error };
+
+    FrameWriter();
+
+    // Frame already carrying its header (e.g. KasaCodec::encodeFrame output)
+    void reset(const char* frame, size_t len);
+
+    // Header built here from the payload length, sent with the payload in one syscall
+    void resetWithHeader(const char* payload, size_t len);
+
+    Status writeTo(int fd);
+
+    int lastError() const;
+
+private:
+    uint8_t header_[4];
+    const char* segments_[2];
+    size_t lengths_[2];
+    size_t segmentCount_;
+    size_t total_;
+    size_t written_;
+    int lastError_;
+};
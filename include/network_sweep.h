@@ -0,0 +1,58 @@
+#pragma once
+
+#include "io_engine.h"
+#include "tplink_device.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// IPv4 block in CIDR notation, e.g. "192.168.4.0/22"
+struct CidrRange {
+    uint32_t first; // First and last probed host, host byte order
+    uint32_t last;
+
+    static const int kMinPrefix = 16; // Larger blocks are rejected
+
+    // Network and broadcast addresses are excluded for prefixes up to /30
+    static bool parse(const std::string& text, CidrRange& range);
+    size_t size() const { return static_cast<size_t>(last - first) + 1; }
+};
+
+// TCP sysinfo sweep over address ranges, for networks where broadcast
+// discovery is blocked. A fixed number of probes is kept in flight through
+// the I/O engine (non-blocking connects with a short deadline), and each
+// device that answers is handed to the caller as soon as it does.
+class NetworkSweep {
+public:
+    static const size_t kDefaultConcurrency = 256;
+    static const int kDefaultProbeTimeoutMs = 500;
+
+    // Return false to stop launching new probes; those in flight still finish
+    using DeviceCallback = std::function<bool(std::shared_ptr<TPLinkDevice>)>;
+    // Return true to leave a host unprobed, e.g. one that is already managed
+    using HostFilter = std::function<bool(const std::string& ip, int port)>;
+
+    explicit NetworkSweep(std::shared_ptr<IOEngine> engine);
+
+    void setConcurrency(size_t concurrency);
+    void setProbeTimeout(int timeoutMs);
+    void setPort(int port);
+    void setSkip(HostFilter skip);
+    bool addRange(const std::string& cidr); // False if cidr is malformed
+
+    size_t hostCount() const;
+
+    // Blocks until every host has been probed. onDevice runs on the calling
+    // thread. Returns the number of devices found.
+    size_t run(const DeviceCallback& onDevice);
+
+private:
+    std::shared_ptr<IOEngine> engine_;
+    std::vector<CidrRange> ranges_;
+    HostFilter skip_;
+    size_t concurrency_;
+    int probe_timeout_ms_;
+    int port_;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string_view>
+
+struct DeviceInfo;
+
+// Allocation-free reader for get_sysinfo responses. It walks the decrypted
+// JSON in place and keeps views into it, skipping every key it doesn't need.
+// Only the exact shapes plugs and bulbs send are accepted. Anything else
+// (wrong types, fractional numbers, malformed input) is reported as
+// unrecognised so the caller can fall back to jsoncpp.
+class SysinfoParser {
+public:
+    struct Fields {
+        // Raw string contents between the quotes, escapes not yet decoded
+        std::string_view deviceId;
+        std::string_view alias;
+        std::string_view model;
+        std::string_view mac;
+
+        bool hasLightState = false;
+        int onOff = 0;
+        int brightness = 0;
+        int colorTemp = 4000;
+        int hue = 0;
+        int saturation = 0;
+
+        bool hasRelayState = false;
+        int relayState = 0;
+    };
+
+    // Finds system.get_sysinfo in response. The views in fields point into
+    // response and are only valid as long as it is.
+    static bool scan(std::string_view response, Fields& fields);
+
+    // Copies scanned fields into info the same way the jsoncpp path does
+    static void apply(const Fields& fields, DeviceInfo& info);
+
+    static bool parse(std::string_view response, DeviceInfo& info);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical timing wheel of string keys. Four levels of 64 slots cover
+// 2^24 ticks; an entry sits on the coarsest level where its deadline still
+// differs from the current tick and is cascaded down as that level comes
+// round. Scheduling, rescheduling and cancelling are O(1). Not thread-safe.
+class TimingWheel {
+public:
+    static const int kLevels = 4;
+    static const int kSlotBits = 6;
+    static const uint64_t kSlots = uint64_t(1) << kSlotBits;
+    static const uint64_t kMaxDelay = (uint64_t(1) << (kLevels * kSlotBits)) - 1; // In ticks
+
+    TimingWheel();
+
+    // Replaces any deadline already set for key. Deadlines that are not in
+    // the future fire on the next tick; those beyond kMaxDelay are clamped.
+    void schedule(const std::string& key, uint64_t deadline);
+    bool cancel(const std::string& key);
+    bool contains(const std::string& key) const;
+
+    size_t size() const { return nodes_.size(); }
+    uint64_t now() const { return current_; }
+
+    // Steps the wheel forward to tick, appending keys in the order they came due
+    void advance(uint64_t tick, std::vector<std::string>& expired);
+
+private:
+    struct Node {
+        const std::string* key; // Owned by the map
+        uint64_t deadline;
+        Node** head;            // Slot the node is linked into
+        Node* prev;
+        Node* next;
+    };
+
+    void link(Node& node);
+    static void unlink(Node& node);
+    void cascade(int level);
+
+    std::unordered_map<std::string, Node> nodes_;
+    Node* slots_[kLevels][kSlots];
+    uint64_t current_;
+};
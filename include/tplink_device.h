@@ -5,6 +5,13 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "io_engine.h"
+#include "circuit_breaker.h"
+#include "kasa_commands.h"
+#include "command_batch.h"
 
 struct DeviceInfo {
     std::string deviceId;
@@ -21,17 +28,30 @@ struct DeviceInfo {
     int saturation; // Saturation for color bulbs
 };
 
-class TPLinkDevice {
+// Async methods keep the device alive until completion, so instances must be
+// owned by a std::shared_ptr.
+class TPLinkDevice : public std::enable_shared_from_this<TPLinkDevice> {
 public:
-    TPLinkDevice(const std::string& ip, int port = 9999);
+    static const int kDefaultTimeoutMs = 3000;
+
+    TPLinkDevice(const std::string& ip, int port = 9999, std::shared_ptr<IOEngine> engine = nullptr);
     ~TPLinkDevice();
 
     // Device discovery and connection
     bool discover();
+    void discoverAsync(std::function<void(bool)> callback, TaskPriority priority = TaskPriority::Interactive);
     bool connect();
     void disconnect();
+    void setTimeout(int timeoutMs);
+    // Every request passes the device's circuit breaker; while it is open,
+    // calls fail without touching the network
+    BreakerStatus getBreakerStatus();
     
-    // Device control
+    // Device control. Everything except toggle() goes through the device's
+    // command queue: one command is in flight at a time, and commands that
+    // arrive meanwhile merge into a single follow-up batch in which the last
+    // value of each kind wins. Each caller gets the outcome of its own
+    // operations from the batch that carried them.
     bool turnOn();
     bool turnOff();
     bool toggle();
@@ -39,8 +59,31 @@ public:
     bool setColorTemp(int temp); // 2700-6500K
     bool setColor(int hue, int saturation, int value);
     
+    // Sends every operation in the batch as one request. With refresh(), the
+    // cached device info is updated from the same response. Blocks until
+    // the completion runs, which may be an executor task, so don't call it
+    // (or the setters above) from engine callbacks or executor tasks; from
+    // an executor task it fails every operation without sending anything.
+    BatchResult apply(const CommandBatch& batch);
+    // Same, completing on an engine thread. timeoutMs > 0 shortens the
+    // device timeout for this request.
+    void applyAsync(const CommandBatch& batch, std::function<void(BatchResult)> callback, int timeoutMs = 0);
+    
+    // Process-wide command queue counters
+    static uint64_t commandsSent();
+    static uint64_t commandsCoalesced(); // Merged into a batch that was already waiting
+    
     // Device information
     DeviceInfo getDeviceInfo();
+    // Immutable copy of the current state, shared until the state next changes
+    std::shared_ptr<const DeviceInfo> getDeviceState();
+    // Called with the state before and after whenever the cached state or
+    // online status changes (before is null if no state was built yet).
+    // Calls for one device are serialized and in order; the listener must
+    // not cause another state change on the same device.
+    using StateListener = std::function<void(const std::shared_ptr<const DeviceInfo>& before,
+                                             const std::shared_ptr<const DeviceInfo>& after)>;
+    void setStateListener(StateListener listener);
     bool isOnline();
     bool isOn();
     int getBrightness();
@@ -48,19 +91,45 @@ public:
     
     // Raw command interface
     std::string sendCommand(const std::string& command);
+    void sendCommandAsync(const std::string& command, std::function<void(std::string)> callback);
     
 private:
-    std::string encrypt(const std::string& data);
-    std::string decrypt(const std::string& data);
     std::string createCommand(const std::string& method, const std::map<std::string, std::string>& params = {});
+    IORequest buildRequest(std::string frame);
+    IORequest buildRequest(FrameRef frame);
+    IORequest buildRequest(const CommandBatch& batch, bool isBulb);
+    std::string execute(IORequest request);
+    void executeAsync(IORequest request, std::function<void(std::string)> callback);
+    void requestFailed(); // Counts the failure; drops the pooled socket once the breaker opens
+    bool applySysinfo(const std::string& response);
+    bool applySysinfoJson(const std::string& response); // Fallback for unrecognised shapes
+    void setConnected(bool connected);
+    void stateChanged();
+    void applyCommandResult(const CommandBatch& batch, const BatchResult& result);
+    
+    struct CommandWaiter {
+        std::vector<std::string> operations;
+        std::function<void(BatchResult)> callback;
+    };
+    void dispatchBatch(CommandBatch batch, int timeoutMs, std::vector<CommandWaiter> waiters);
+    void commandFinished();
     
     std::string ip_;
     int port_;
-    int socket_fd_;
+    int timeout_ms_;
+    std::shared_ptr<IOEngine> engine_;
     DeviceInfo deviceInfo_;
-    bool connected_;
+    std::mutex info_mutex_;
+    std::shared_ptr<const DeviceInfo> state_; // Built lazily from deviceInfo_
+    StateListener state_listener_;
+    std::mutex notify_mutex_; // Held while the listener runs, outside info_mutex_
+    std::atomic<bool> connected_;
+    std::atomic<bool> is_bulb_; // Sysinfo reported a light_state
+    CircuitBreaker breaker_;
     
-    // Kasa protocol encryption key
-    static const uint8_t kasa_key_[16];
-    static const uint8_t kasa_iv_[16];
+    std::mutex command_mutex_;
+    bool command_in_flight_;
+    CommandBatch queued_batch_;
+    int queued_timeout_ms_;
+    std::vector<CommandWaiter> queued_waiters_; // Empty when nothing is queued
 };
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A device that answered the discovery broadcast
+struct DiscoveryReply {
+    std::string ip;
+    int port;              // Source port of the reply, the device's TCP port
+    std::string deviceId;  // Empty if the reply couldn't be parsed
+    std::string mac;
+    std::string key;       // deviceId, else MAC, else ip:port
+};
+
+// Kasa UDP discovery. One encrypted get_sysinfo datagram is sent to the
+// broadcast address of every IPv4 interface, and replies are collected on the
+// same socket until the window closes. The probe is repeated a few times
+// early in the window to ride out packet loss; devices are reported once.
+class UdpDiscovery {
+public:
+    static const int kDefaultPort = 9999;
+    static const int kDefaultWindowMs = 1000;
+
+    UdpDiscovery();
+
+    void setWindow(int windowMs);
+    void setPort(int port);
+
+    // Extra unicast or broadcast destinations probed alongside the interfaces
+    void addTarget(const std::string& address);
+
+    std::vector<DiscoveryReply> run();
+
+    // Broadcast addresses of interfaces that are up, excluding loopback
+    static std::vector<std::string> broadcastAddresses();
+
+private:
+    int window_ms_;
+    int port_;
+    std::vector<std::string> targets_;
+};
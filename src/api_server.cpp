@@ -1,11 +1,160 @@
 #include "api_server.h"
 #include "../third_party/httplib.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
 #include <sstream>
 #include <json/json.h>
 
+namespace {
+
+Json::Value discoveredDeviceJson(const DeviceInfo& device) {
+    Json::Value deviceJson;
+    deviceJson["deviceId"] = device.deviceId;
+    deviceJson["name"] = device.name;
+    deviceJson["ip"] = device.ip;
+    deviceJson["port"] = device.port;
+    deviceJson["model"] = device.model;
+    deviceJson["mac"] = device.mac;
+    deviceJson["isOnline"] = device.isOnline;
+    deviceJson["isOn"] = device.isOn;
+    deviceJson["brightness"] = device.brightness;
+    deviceJson["colorTemp"] = device.colorTemp;
+    deviceJson["hue"] = device.hue;
+    deviceJson["saturation"] = device.saturation;
+    return deviceJson;
+}
+
+Json::Value breakerJson(const BreakerStatus& status) {
+    Json::Value breaker;
+    breaker["state"] = CircuitBreaker::stateName(status.state);
+    breaker["failures"] = status.consecutiveFailures;
+    breaker["retryAfterMs"] = status.retryAfterMs;
+    return breaker;
+}
+
+Json::Value eventJson(const DeviceEvent& event) {
+    Json::Value eventJson;
+    eventJson["sequence"] = Json::UInt64(event.sequence);
+    eventJson["type"] = EventBus::typeName(event.type);
+    eventJson["deviceId"] = event.deviceId;
+    eventJson["timestampMs"] = Json::Int64(event.timestampMs);
+    
+    const DeviceInfo& state = *event.state;
+    switch (event.type) {
+        case DeviceEventType::Online:
+        case DeviceEventType::Offline:
+            eventJson["isOnline"] = state.isOnline;
+            break;
+        case DeviceEventType::Power:
+            eventJson["isOn"] = state.isOn;
+            break;
+        case DeviceEventType::Brightness:
+            eventJson["brightness"] = state.brightness;
+            break;
+        case DeviceEventType::Color:
+            eventJson["hue"] = state.hue;
+            eventJson["saturation"] = state.saturation;
+            break;
+        case DeviceEventType::ColorTemp:
+            eventJson["colorTemp"] = state.colorTemp;
+            break;
+    }
+    return eventJson;
+}
+
+// Events waiting to be written to one /api/events client
+struct EventStream {
+    static const size_t kMaxPending = 1024; // Oldest are dropped beyond this
+    
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<DeviceEvent> pending;
+    uint64_t dropped = 0;
+    int idleSeconds = 0;
+};
+
+// A control call that failed because the device's breaker is open gets a 503
+// with a Retry-After hint instead of a plain failure
+bool circuitOpen(const BreakerStatus& status, httplib::Response& res) {
+    if (status.state == BreakerState::Closed) {
+        return false;
+    }
+    Json::Value error;
+    error["success"] = false;
+    error["error"] = "Device unreachable, circuit open";
+    error["retryAfterMs"] = status.retryAfterMs;
+    
+    Json::StreamWriterBuilder builder;
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(std::max((status.retryAfterMs + 999) / 1000, 1)));
+    res.set_content(Json::writeString(builder, error), "application/json");
+    return true;
+}
+
+// Scene targets in the order /state applies them: power, color
+// temperature, color, brightness. Devices switched off only get power.
+CommandBatch sceneBatch(const SceneTarget& target) {
+    CommandBatch batch;
+    batch.setPower(target.isOn);
+    if (target.isOn) {
+        if (target.colorTemp >= 0) {
+            batch.setColorTemp(target.colorTemp);
+        }
+        if (target.hue >= 0 || target.saturation >= 0) {
+            batch.setColor(std::max(target.hue, 0), std::max(target.saturation, 0),
+                           target.brightness >= 0 ? target.brightness : 100);
+        }
+        if (target.brightness >= 0) {
+            batch.setBrightness(target.brightness);
+        }
+    }
+    batch.refresh();
+    return batch;
+}
+
+Json::Value fanOutJson(const std::vector<FanOutResult>& results, double elapsedMs) {
+    Json::Value response;
+    int succeeded = 0;
+    response["results"] = Json::Value(Json::arrayValue);
+    for (const auto& result : results) {
+        Json::Value entry;
+        entry["deviceId"] = result.deviceId;
+        entry["success"] = result.success;
+        entry["timedOut"] = result.timedOut;
+        entry["latencyMs"] = result.latencyMs;
+        if (!result.error.empty()) {
+            entry["error"] = result.error;
+        }
+        entry["operations"] = Json::Value(Json::arrayValue);
+        for (const auto& op : result.results) {
+            Json::Value opJson;
+            opJson["operation"] = op.operation;
+            opJson["success"] = op.success;
+            opJson["errCode"] = op.errCode;
+            if (!op.error.empty()) {
+                opJson["error"] = op.error;
+            }
+            entry["operations"].append(opJson);
+        }
+        response["results"].append(entry);
+        if (result.success) {
+            succeeded++;
+        }
+    }
+    response["success"] = succeeded == static_cast<int>(results.size());
+    response["succeeded"] = succeeded;
+    response["failed"] = static_cast<int>(results.size()) - succeeded;
+    response["elapsedMs"] = elapsedMs;
+    return response;
+}
+
+}
+
 APIServer::APIServer(int port) 
-    : port_(port), deviceManager_(nullptr), database_(nullptr), 
+    : port_(port), deviceManager_(nullptr), database_(nullptr), db_subscription_(0), event_streams_(0),
       running_(false), should_stop_(false), server_(nullptr) {
 }
 
@@ -24,11 +173,36 @@ bool APIServer::start() {
     }
     
     should_stop_ = false;
+    
+    // The database follows device state through the event bus, and keeps
+    // each change in the state history. Its write queue folds repeated
+    // changes to a device. Seeded once here, since events only carry changes.
+    std::shared_ptr<Database> database = database_;
+    db_subscription_ = deviceManager_->getEventBus()->subscribe([database](const std::vector<DeviceEvent>& events) {
+        std::vector<DeviceInfo> devices;
+        devices.reserve(events.size());
+        const DeviceInfo* previous = nullptr;
+        for (const auto& event : events) {
+            // One change can raise several events, all sharing its state
+            if (event.state.get() == previous) {
+                continue;
+            }
+            previous = event.state.get();
+            devices.push_back(*event.state);
+            database->recordState(*event.state, event.timestampMs);
+        }
+        database->updateDevices(devices);
+    });
+    database_->updateDevices(deviceManager_->getAllDevices());
+    
     server_thread_ = std::thread(&APIServer::runServer, this);
     
     // Wait a moment for server to start
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     
+    if (!running_) {
+        deviceManager_->getEventBus()->unsubscribe(db_subscription_);
+    }
     return running_;
 }
 
@@ -45,6 +219,7 @@ void APIServer::stop() {
     if (server_thread_.joinable()) {
         server_thread_.join();
     }
+    deviceManager_->getEventBus()->unsubscribe(db_subscription_);
     
     if (server_) {
         delete static_cast<httplib::Server*>(server_);
@@ -85,10 +260,91 @@ void APIServer::setupRoutes() {
         res.set_content("{\"status\":\"ok\"}", "application/json");
     });
     
-    // Device discovery
-    server->Post("/api/discover", [this](const httplib::Request&, httplib::Response& res) {
+    // Device discovery. With "cidr" in the body, sweeps those ranges over TCP
+    // instead of broadcasting; "stream": true returns NDJSON as devices answer.
+    server->Post("/api/discover", [this](const httplib::Request& req, httplib::Response& res) {
         try {
-            auto devices = deviceManager_->discoverDevices();
+            Json::Value request;
+            if (!req.body.empty()) {
+                Json::Reader reader;
+                if (!reader.parse(req.body, request) || !request.isObject()) {
+                    res.status = 400;
+                    res.set_content("{\"success\":false,\"error\":\"Invalid JSON\"}", "application/json");
+                    return;
+                }
+            }
+            
+            std::vector<std::string> cidrs;
+            if (request.isMember("cidr")) {
+                const Json::Value& cidr = request["cidr"];
+                // Non-string entries are left empty and rejected below
+                if (cidr.isArray()) {
+                    for (const auto& range : cidr) {
+                        cidrs.push_back(range.isString() ? range.asString() : "");
+                    }
+                } else {
+                    cidrs.push_back(cidr.isString() ? cidr.asString() : "");
+                }
+                for (const auto& range : cidrs) {
+                    CidrRange parsed;
+                    if (range.empty() || !CidrRange::parse(range, parsed)) {
+                        res.status = 400;
+                        res.set_content("{\"success\":false,\"error\":\"Invalid CIDR range\"}", "application/json");
+                        return;
+                    }
+                }
+            }
+            const Json::Value& concurrencyValue = request.get("concurrency", Json::UInt(NetworkSweep::kDefaultConcurrency));
+            const Json::Value& timeoutValue = request.get("timeoutMs", NetworkSweep::kDefaultProbeTimeoutMs);
+            if (!concurrencyValue.isUInt() || concurrencyValue.asUInt() < 1) {
+                res.status = 400;
+                res.set_content("{\"success\":false,\"error\":\"concurrency must be a positive integer\"}", "application/json");
+                return;
+            }
+            if (!timeoutValue.isInt() || timeoutValue.asInt() < 1) {
+                res.status = 400;
+                res.set_content("{\"success\":false,\"error\":\"timeoutMs must be a positive integer\"}", "application/json");
+                return;
+            }
+            size_t concurrency = concurrencyValue.asUInt();
+            int timeoutMs = timeoutValue.asInt();
+            
+            if (!cidrs.empty() && request.get("stream", false).asBool()) {
+                auto deviceManager = deviceManager_;
+                auto database = database_;
+                res.set_chunked_content_provider("application/x-ndjson",
+                    [deviceManager, database, cidrs, concurrency, timeoutMs](size_t, httplib::DataSink& sink) {
+                        Json::StreamWriterBuilder builder;
+                        builder["indentation"] = "";
+                        int count = 0;
+                        deviceManager->sweepDevices(cidrs, [&](const DeviceInfo& device) {
+                            database->addDevice(device);
+                            database->addDiscoveryRecord(device.ip, device.deviceId, device.model, true);
+                            count++;
+                            std::string line = Json::writeString(builder, discoveredDeviceJson(device)) + "\n";
+                            return sink.write(line.data(), line.size());
+                        }, concurrency, timeoutMs);
+                        
+                        Json::Value summary;
+                        summary["success"] = true;
+                        summary["count"] = count;
+                        std::string line = Json::writeString(builder, summary) + "\n";
+                        sink.write(line.data(), line.size());
+                        sink.done();
+                        return true;
+                    });
+                return;
+            }
+            
+            std::vector<DeviceInfo> devices;
+            if (cidrs.empty()) {
+                devices = deviceManager_->discoverDevices();
+            } else {
+                deviceManager_->sweepDevices(cidrs, [&devices](const DeviceInfo& device) {
+                    devices.push_back(device);
+                    return true;
+                }, concurrency, timeoutMs);
+            }
             
             // Save discovered devices to database
             for (const auto& device : devices) {
@@ -102,20 +358,7 @@ void APIServer::setupRoutes() {
             
             Json::Value devicesArray(Json::arrayValue);
             for (const auto& device : devices) {
-                Json::Value deviceJson;
-                deviceJson["deviceId"] = device.deviceId;
-                deviceJson["name"] = device.name;
-                deviceJson["ip"] = device.ip;
-                deviceJson["port"] = device.port;
-                deviceJson["model"] = device.model;
-                deviceJson["mac"] = device.mac;
-                deviceJson["isOnline"] = device.isOnline;
-                deviceJson["isOn"] = device.isOn;
-                deviceJson["brightness"] = device.brightness;
-                deviceJson["colorTemp"] = device.colorTemp;
-                deviceJson["hue"] = device.hue;
-                deviceJson["saturation"] = device.saturation;
-                devicesArray.append(deviceJson);
+                devicesArray.append(discoveredDeviceJson(device));
             }
             response["devices"] = devicesArray;
             
@@ -156,6 +399,7 @@ void APIServer::setupRoutes() {
                 deviceJson["colorTemp"] = device.colorTemp;
                 deviceJson["hue"] = device.hue;
                 deviceJson["saturation"] = device.saturation;
+                deviceJson["breaker"] = breakerJson(deviceManager_->getBreakerStatus(device.deviceId));
                 devicesArray.append(deviceJson);
             }
             response["devices"] = devicesArray;
@@ -173,6 +417,189 @@ void APIServer::setupRoutes() {
         }
     });
     
+    // Live device state from the manager's published snapshot. The snapshot
+    // version is the ETag, so pollers get a 304 until something changes.
+    server->Get("/api/devices/live", [this](const httplib::Request& req, httplib::Response& res) {
+        try {
+            auto snapshot = deviceManager_->getSnapshot();
+            std::string etag = "\"" + std::to_string(snapshot->version) + "\"";
+            res.set_header("ETag", etag);
+            if (req.get_header_value("If-None-Match") == etag) {
+                res.status = 304;
+                return;
+            }
+            
+            auto cached = std::atomic_load(&live_body_);
+            if (!cached || cached->version != snapshot->version) {
+                Json::Value response;
+                response["success"] = true;
+                response["version"] = Json::UInt64(snapshot->version);
+                response["count"] = static_cast<int>(snapshot->devices.size());
+                
+                Json::Value devicesArray(Json::arrayValue);
+                for (const auto& device : snapshot->devices) {
+                    devicesArray.append(discoveredDeviceJson(*device));
+                }
+                response["devices"] = devicesArray;
+                
+                Json::StreamWriterBuilder builder;
+                auto body = std::make_shared<LiveBody>();
+                body->version = snapshot->version;
+                body->body = Json::writeString(builder, response);
+                cached = body;
+                std::atomic_store(&live_body_, cached);
+            }
+            res.set_content(cached->body, "application/json");
+        } catch (const std::exception& e) {
+            Json::Value error;
+            error["success"] = false;
+            error["error"] = e.what();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, error), "application/json");
+            res.status = 500;
+        }
+    });
+    
+    // Device state changes as server-sent events, one per changed aspect
+    server->Get("/api/events", [this](const httplib::Request&, httplib::Response& res) {
+        if (event_streams_.fetch_add(1) >= kMaxEventStreams) {
+            event_streams_--;
+            res.status = 503;
+            res.set_content("{\"success\":false,\"error\":\"Too many event streams\"}", "application/json");
+            return;
+        }
+        
+        auto stream = std::make_shared<EventStream>();
+        auto bus = deviceManager_->getEventBus();
+        uint64_t subscription = bus->subscribe([stream](const std::vector<DeviceEvent>& events) {
+            std::lock_guard<std::mutex> lock(stream->mutex);
+            for (const auto& event : events) {
+                if (stream->pending.size() >= EventStream::kMaxPending) {
+                    stream->pending.pop_front();
+                    stream->dropped++;
+                }
+                stream->pending.push_back(event);
+            }
+            stream->ready.notify_one();
+        });
+        
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream",
+            [this, stream](size_t, httplib::DataSink& sink) {
+                std::deque<DeviceEvent> events;
+                uint64_t dropped = 0;
+                {
+                    std::unique_lock<std::mutex> lock(stream->mutex);
+                    stream->ready.wait_for(lock, std::chrono::seconds(1),
+                                           [&stream]() { return !stream->pending.empty(); });
+                    events.swap(stream->pending);
+                    std::swap(dropped, stream->dropped);
+                }
+                // is_writable() also notices a client that hung up
+                if (should_stop_ || !sink.is_writable()) {
+                    return false;
+                }
+                
+                std::string out;
+                if (dropped > 0) {
+                    out += "event: dropped\ndata: " + std::to_string(dropped) + "\n\n";
+                }
+                Json::StreamWriterBuilder builder;
+                builder["indentation"] = "";
+                for (const auto& event : events) {
+                    out += "id: " + std::to_string(event.sequence) + "\ndata: " +
+                           Json::writeString(builder, eventJson(event)) + "\n\n";
+                }
+                // A periodic comment keeps proxies from timing the stream out
+                if (out.empty() && ++stream->idleSeconds >= 15) {
+                    out = ": keepalive\n\n";
+                }
+                if (!out.empty()) {
+                    stream->idleSeconds = 0;
+                    return sink.write(out.data(), out.size());
+                }
+                return true;
+            },
+            [this, bus, subscription](bool) {
+                bus->unsubscribe(subscription);
+                event_streams_--;
+            });
+    });
+    
+    // State history of a device: raw changes, or minute or hour rollups
+    server->Get("/api/devices/(.*)/history", [this](const httplib::Request& req, httplib::Response& res) {
+        try {
+            std::string deviceId = req.matches[1];
+            int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            int64_t to = req.has_param("to") ? std::stoll(req.get_param_value("to")) : now;
+            int64_t from = req.has_param("from") ? std::stoll(req.get_param_value("from")) : to - kDefaultHistoryMs;
+            std::string resolution = req.has_param("resolution") ? req.get_param_value("resolution") : "raw";
+            size_t limit = req.has_param("limit") ? std::stoul(req.get_param_value("limit")) : kMaxHistorySamples;
+            limit = std::min(limit, kMaxHistorySamples);
+            
+            Json::Value response;
+            response["success"] = true;
+            response["deviceId"] = deviceId;
+            response["resolution"] = resolution;
+            response["from"] = Json::Int64(from);
+            response["to"] = Json::Int64(to);
+            Json::Value entries(Json::arrayValue);
+            if (resolution == "raw") {
+                for (const auto& sample : database_->getStateHistory(deviceId, from, to, limit)) {
+                    Json::Value entry;
+                    entry["timestampMs"] = Json::Int64(sample.timestampMs);
+                    entry["isOnline"] = sample.isOnline;
+                    entry["isOn"] = sample.isOn;
+                    entry["brightness"] = sample.brightness;
+                    entry["colorTemp"] = sample.colorTemp;
+                    entry["hue"] = sample.hue;
+                    entry["saturation"] = sample.saturation;
+                    entries.append(entry);
+                }
+                response["samples"] = entries;
+            } else if (resolution == "minute" || resolution == "hour") {
+                HistoryResolution width = resolution == "minute" ? HistoryResolution::Minute : HistoryResolution::Hour;
+                for (const auto& rollup : database_->getStateRollups(deviceId, width, from, to)) {
+                    Json::Value entry;
+                    entry["bucketMs"] = Json::Int64(rollup.bucketMs);
+                    entry["changes"] = rollup.changes;
+                    entry["onMs"] = Json::Int64(rollup.onMs);
+                    entry["onlineMs"] = Json::Int64(rollup.onlineMs);
+                    entry["brightnessAvg"] = rollup.brightnessAvg;
+                    entry["brightnessMin"] = rollup.brightnessMin;
+                    entry["brightnessMax"] = rollup.brightnessMax;
+                    entry["isOnline"] = rollup.isOnline;
+                    entry["isOn"] = rollup.isOn;
+                    entry["brightness"] = rollup.brightness;
+                    entries.append(entry);
+                }
+                response["rollups"] = entries;
+            } else {
+                res.status = 400;
+                res.set_content("{\"success\":false,\"error\":\"resolution must be raw, minute or hour\"}",
+                                "application/json");
+                return;
+            }
+            response["count"] = entries.size();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, response), "application/json");
+        } catch (const std::logic_error&) {
+            res.status = 400;
+            res.set_content("{\"success\":false,\"error\":\"from, to and limit must be numbers\"}", "application/json");
+        } catch (const std::exception& e) {
+            Json::Value error;
+            error["success"] = false;
+            error["error"] = e.what();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, error), "application/json");
+            res.status = 500;
+        }
+    });
+    
     // Get device by ID
     server->Get("/api/devices/(.*)", [this](const httplib::Request& req, httplib::Response& res) {
         try {
@@ -199,6 +626,7 @@ void APIServer::setupRoutes() {
             response["device"]["colorTemp"] = device.colorTemp;
             response["device"]["hue"] = device.hue;
             response["device"]["saturation"] = device.saturation;
+            response["device"]["breaker"] = breakerJson(deviceManager_->getBreakerStatus(device.deviceId));
             
             Json::StreamWriterBuilder builder;
             res.set_content(Json::writeString(builder, response), "application/json");
@@ -228,9 +656,8 @@ void APIServer::setupRoutes() {
             
             bool turnOn = request.get("on", false).asBool();
             bool success = turnOn ? deviceManager_->turnOnDevice(deviceId) : deviceManager_->turnOffDevice(deviceId);
-            
-            if (success) {
-                database_->updateDeviceState(deviceId, turnOn);
+            if (!success && circuitOpen(deviceManager_->getBreakerStatus(deviceId), res)) {
+                return;
             }
             
             Json::Value response;
@@ -271,9 +698,8 @@ void APIServer::setupRoutes() {
             }
             
             bool success = deviceManager_->setDeviceBrightness(deviceId, brightness);
-            
-            if (success) {
-                database_->updateDeviceState(deviceId, brightness > 0, brightness);
+            if (!success && circuitOpen(deviceManager_->getBreakerStatus(deviceId), res)) {
+                return;
             }
             
             Json::Value response;
@@ -317,9 +743,8 @@ void APIServer::setupRoutes() {
             }
             
             bool success = deviceManager_->setDeviceColor(deviceId, hue, saturation, value);
-            
-            if (success) {
-                database_->updateDeviceState(deviceId, value > 0, value, -1, hue, saturation);
+            if (!success && circuitOpen(deviceManager_->getBreakerStatus(deviceId), res)) {
+                return;
             }
             
             Json::Value response;
@@ -362,9 +787,8 @@ void APIServer::setupRoutes() {
             }
             
             bool success = deviceManager_->setDeviceColorTemp(deviceId, colorTemp);
-            
-            if (success) {
-                database_->updateDeviceState(deviceId, true, -1, colorTemp);
+            if (!success && circuitOpen(deviceManager_->getBreakerStatus(deviceId), res)) {
+                return;
             }
             
             Json::Value response;
@@ -384,14 +808,410 @@ void APIServer::setupRoutes() {
         }
     });
     
+    // Apply several state changes in one device round-trip
+    server->Post("/api/devices/(.*)/state", [this](const httplib::Request& req, httplib::Response& res) {
+        try {
+            std::string deviceId = req.matches[1];
+            
+            Json::Value request;
+            Json::Reader reader;
+            if (!reader.parse(req.body, request)) {
+                res.status = 400;
+                res.set_content("{\"success\":false,\"error\":\"Invalid JSON\"}", "application/json");
+                return;
+            }
+            
+            // Applied in a fixed order: power, color temperature, color, brightness
+            CommandBatch batch;
+            if (request.isMember("on")) {
+                batch.setPower(request["on"].asBool());
+            }
+            if (request.isMember("colorTemp")) {
+                batch.setColorTemp(request["colorTemp"].asInt());
+            }
+            if (request.isMember("hue") || request.isMember("saturation")) {
+                batch.setColor(request.get("hue", 0).asInt(), request.get("saturation", 0).asInt(),
+                               request.get("value", 100).asInt());
+            }
+            if (request.isMember("brightness")) {
+                batch.setBrightness(request["brightness"].asInt());
+            }
+            if (request.get("refresh", true).asBool()) {
+                batch.refresh();
+            }
+            
+            if (batch.empty() || !batch.valid()) {
+                res.status = 400;
+                res.set_content("{\"success\":false,\"error\":\"Invalid state values\"}", "application/json");
+                return;
+            }
+            
+            BatchResult result = deviceManager_->applyBatch(deviceId, batch);
+            if (result.results.empty() && circuitOpen(deviceManager_->getBreakerStatus(deviceId), res)) {
+                return;
+            }
+            
+            Json::Value response;
+            response["success"] = result.success;
+            response["results"] = Json::Value(Json::arrayValue);
+            for (const auto& op : result.results) {
+                Json::Value entry;
+                entry["operation"] = op.operation;
+                entry["success"] = op.success;
+                entry["errCode"] = op.errCode;
+                if (!op.error.empty()) {
+                    entry["error"] = op.error;
+                }
+                response["results"].append(entry);
+            }
+            
+            if (batch.hasRefresh() && !result.results.empty() && result.results.back().success) {
+                DeviceInfo info = deviceManager_->getDeviceInfo(deviceId);
+                Json::Value state;
+                state["on"] = info.isOn;
+                state["brightness"] = info.brightness;
+                state["colorTemp"] = info.colorTemp;
+                state["hue"] = info.hue;
+                state["saturation"] = info.saturation;
+                response["state"] = state;
+            }
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, response), "application/json");
+        } catch (const std::exception& e) {
+            Json::Value error;
+            error["success"] = false;
+            error["error"] = e.what();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, error), "application/json");
+            res.status = 500;
+        }
+    });
+    
+    // Groups
+    server->Get("/api/groups", [this](const httplib::Request&, httplib::Response& res) {
+        try {
+            auto groups = database_->getAllGroups();
+            
+            Json::Value response;
+            response["success"] = true;
+            response["count"] = static_cast<int>(groups.size());
+            response["groups"] = Json::Value(Json::arrayValue);
+            for (const auto& group : groups) {
+                Json::Value groupJson;
+                groupJson["id"] = group.groupId;
+                groupJson["name"] = group.name;
+                groupJson["devices"] = Json::Value(Json::arrayValue);
+                for (const auto& deviceId : group.deviceIds) {
+                    groupJson["devices"].append(deviceId);
+                }
+                response["groups"].append(groupJson);
+            }
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, response), "application/json");
+        } catch (const std::exception& e) {
+            Json::Value error;
+            error["success"] = false;
+            error["error"] = e.what();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, error), "application/json");
+            res.status = 500;
+        }
+    });
+    
+    server->Post("/api/groups", [this](const httplib::Request& req, httplib::Response& res) {
+        try {
+            Json::Value request;
+            Json::Reader reader;
+            if (!reader.parse(req.body, request) || !request["id"].isString() || !request["name"].isString() ||
+                !request["devices"].isArray()) {
+                res.status = 400;
+                res.set_content("{\"success\":false,\"error\":\"Expected id, name and devices\"}", "application/json");
+                return;
+            }
+            
+            DeviceGroup group;
+            group.groupId = request["id"].asString();
+            group.name = request["name"].asString();
+            for (const auto& deviceId : request["devices"]) {
+                group.deviceIds.push_back(deviceId.asString());
+            }
+            
+            Json::Value response;
+            response["success"] = database_->saveGroup(group);
+            response["id"] = group.groupId;
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, response), "application/json");
+        } catch (const std::exception& e) {
+            Json::Value error;
+            error["success"] = false;
+            error["error"] = e.what();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, error), "application/json");
+            res.status = 500;
+        }
+    });
+    
+    server->Delete("/api/groups/(.*)", [this](const httplib::Request& req, httplib::Response& res) {
+        std::string groupId = req.matches[1];
+        if (database_->getGroup(groupId).groupId.empty()) {
+            res.status = 404;
+            res.set_content("{\"success\":false,\"error\":\"Group not found\"}", "application/json");
+            return;
+        }
+        bool success = database_->removeGroup(groupId);
+        res.set_content(success ? "{\"success\":true}" : "{\"success\":false}", "application/json");
+    });
+    
+    // Switch every device in a group at once
+    server->Post("/api/groups/(.*)/power", [this](const httplib::Request& req, httplib::Response& res) {
+        try {
+            std::string groupId = req.matches[1];
+            
+            Json::Value request;
+            Json::Reader reader;
+            if (!reader.parse(req.body, request)) {
+                res.status = 400;
+                res.set_content("{\"success\":false,\"error\":\"Invalid JSON\"}", "application/json");
+                return;
+            }
+            
+            DeviceGroup group = database_->getGroup(groupId);
+            if (group.groupId.empty()) {
+                res.status = 404;
+                res.set_content("{\"success\":false,\"error\":\"Group not found\"}", "application/json");
+                return;
+            }
+            
+            bool turnOn = request.get("on", false).asBool();
+            std::vector<std::pair<std::string, CommandBatch>> batches;
+            for (const auto& deviceId : group.deviceIds) {
+                CommandBatch batch;
+                batch.setPower(turnOn).refresh();
+                batches.emplace_back(deviceId, batch);
+            }
+            
+            int deadlineMs = request.get("deadlineMs", DeviceManager::kDefaultFanOutDeadlineMs).asInt();
+            auto start = std::chrono::steady_clock::now();
+            auto results = deviceManager_->applyBatches(batches, deadlineMs);
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            
+            Json::Value response = fanOutJson(results, elapsedMs);
+            response["on"] = turnOn;
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, response), "application/json");
+        } catch (const std::exception& e) {
+            Json::Value error;
+            error["success"] = false;
+            error["error"] = e.what();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, error), "application/json");
+            res.status = 500;
+        }
+    });
+    
+    // Scenes
+    server->Get("/api/scenes", [this](const httplib::Request&, httplib::Response& res) {
+        try {
+            auto scenes = database_->getAllScenes();
+            
+            Json::Value response;
+            response["success"] = true;
+            response["count"] = static_cast<int>(scenes.size());
+            response["scenes"] = Json::Value(Json::arrayValue);
+            for (const auto& scene : scenes) {
+                Json::Value sceneJson;
+                sceneJson["id"] = scene.sceneId;
+                sceneJson["name"] = scene.name;
+                sceneJson["devices"] = Json::Value(Json::arrayValue);
+                for (const auto& target : scene.targets) {
+                    Json::Value targetJson;
+                    targetJson["deviceId"] = target.deviceId;
+                    targetJson["on"] = target.isOn;
+                    if (target.brightness >= 0) {
+                        targetJson["brightness"] = target.brightness;
+                    }
+                    if (target.colorTemp >= 0) {
+                        targetJson["colorTemp"] = target.colorTemp;
+                    }
+                    if (target.hue >= 0) {
+                        targetJson["hue"] = target.hue;
+                    }
+                    if (target.saturation >= 0) {
+                        targetJson["saturation"] = target.saturation;
+                    }
+                    sceneJson["devices"].append(targetJson);
+                }
+                response["scenes"].append(sceneJson);
+            }
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, response), "application/json");
+        } catch (const std::exception& e) {
+            Json::Value error;
+            error["success"] = false;
+            error["error"] = e.what();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, error), "application/json");
+            res.status = 500;
+        }
+    });
+    
+    server->Post("/api/scenes", [this](const httplib::Request& req, httplib::Response& res) {
+        try {
+            Json::Value request;
+            Json::Reader reader;
+            if (!reader.parse(req.body, request) || !request["id"].isString() || !request["name"].isString() ||
+                !request["devices"].isArray()) {
+                res.status = 400;
+                res.set_content("{\"success\":false,\"error\":\"Expected id, name and devices\"}", "application/json");
+                return;
+            }
+            
+            Scene scene;
+            scene.sceneId = request["id"].asString();
+            scene.name = request["name"].asString();
+            for (const auto& targetJson : request["devices"]) {
+                if (!targetJson["deviceId"].isString()) {
+                    res.status = 400;
+                    res.set_content("{\"success\":false,\"error\":\"Every scene device needs a deviceId\"}",
+                                    "application/json");
+                    return;
+                }
+                SceneTarget target;
+                target.deviceId = targetJson["deviceId"].asString();
+                target.isOn = targetJson.get("on", true).asBool();
+                target.brightness = targetJson.get("brightness", -1).asInt();
+                target.colorTemp = targetJson.get("colorTemp", -1).asInt();
+                target.hue = targetJson.get("hue", -1).asInt();
+                target.saturation = targetJson.get("saturation", -1).asInt();
+                if (!sceneBatch(target).valid()) {
+                    res.status = 400;
+                    res.set_content("{\"success\":false,\"error\":\"Invalid state values for " + target.deviceId + "\"}",
+                                    "application/json");
+                    return;
+                }
+                scene.targets.push_back(target);
+            }
+            
+            Json::Value response;
+            response["success"] = database_->saveScene(scene);
+            response["id"] = scene.sceneId;
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, response), "application/json");
+        } catch (const std::exception& e) {
+            Json::Value error;
+            error["success"] = false;
+            error["error"] = e.what();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, error), "application/json");
+            res.status = 500;
+        }
+    });
+    
+    server->Delete("/api/scenes/(.*)", [this](const httplib::Request& req, httplib::Response& res) {
+        std::string sceneId = req.matches[1];
+        if (database_->getScene(sceneId).sceneId.empty()) {
+            res.status = 404;
+            res.set_content("{\"success\":false,\"error\":\"Scene not found\"}", "application/json");
+            return;
+        }
+        bool success = database_->removeScene(sceneId);
+        res.set_content(success ? "{\"success\":true}" : "{\"success\":false}", "application/json");
+    });
+    
+    // Bring every device in a scene to its target state at once
+    server->Post("/api/scenes/(.*)/apply", [this](const httplib::Request& req, httplib::Response& res) {
+        try {
+            std::string sceneId = req.matches[1];
+            
+            Json::Value request;
+            Json::Reader reader;
+            if (!req.body.empty() && !reader.parse(req.body, request)) {
+                res.status = 400;
+                res.set_content("{\"success\":false,\"error\":\"Invalid JSON\"}", "application/json");
+                return;
+            }
+            
+            Scene scene = database_->getScene(sceneId);
+            if (scene.sceneId.empty()) {
+                res.status = 404;
+                res.set_content("{\"success\":false,\"error\":\"Scene not found\"}", "application/json");
+                return;
+            }
+            
+            std::vector<std::pair<std::string, CommandBatch>> batches;
+            for (const auto& target : scene.targets) {
+                batches.emplace_back(target.deviceId, sceneBatch(target));
+            }
+            
+            int deadlineMs = request.get("deadlineMs", DeviceManager::kDefaultFanOutDeadlineMs).asInt();
+            auto start = std::chrono::steady_clock::now();
+            auto results = deviceManager_->applyBatches(batches, deadlineMs);
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, fanOutJson(results, elapsedMs)), "application/json");
+        } catch (const std::exception& e) {
+            Json::Value error;
+            error["success"] = false;
+            error["error"] = e.what();
+            
+            Json::StreamWriterBuilder builder;
+            res.set_content(Json::writeString(builder, error), "application/json");
+            res.status = 500;
+        }
+    });
+    
     // Get statistics
     server->Get("/api/stats", [this](const httplib::Request&, httplib::Response& res) {
         try {
             Json::Value response;
             response["success"] = true;
-            response["totalDevices"] = database_->getDeviceCount();
-            response["onlineDevices"] = database_->getOnlineDeviceCount();
-            response["offlineDevices"] = database_->getOfflineDeviceCount();
+            DeviceStatistics stored = database_->getStatistics();
+            response["totalDevices"] = Json::UInt64(stored.total);
+            response["onlineDevices"] = Json::UInt64(stored.online);
+            response["offlineDevices"] = Json::UInt64(stored.offline);
+            response["onDevices"] = Json::UInt64(stored.on);
+            response["offDevices"] = Json::UInt64(stored.off);
+            response["averageBrightness"] = stored.averageBrightness;
+            response["models"] = Json::Value(Json::objectValue);
+            for (const auto& model : stored.byModel) {
+                response["models"][model.first] = Json::UInt64(model.second);
+            }
+            
+            DeviceCounts managed = deviceManager_->getDeviceCounts();
+            response["managed"]["total"] = Json::UInt64(managed.total);
+            response["managed"]["online"] = Json::UInt64(managed.online);
+            response["managed"]["on"] = Json::UInt64(managed.on);
+            
+            IOPoolStats pool = deviceManager_->getConnectionStats();
+            response["connectionPool"]["hits"] = Json::UInt64(pool.hits);
+            response["connectionPool"]["misses"] = Json::UInt64(pool.misses);
+            response["connectionPool"]["evictions"] = Json::UInt64(pool.evictions);
+            response["connectionPool"]["idleCloses"] = Json::UInt64(pool.idleCloses);
+            response["connectionPool"]["staleCloses"] = Json::UInt64(pool.staleCloses);
+            response["connectionPool"]["reconnects"] = Json::UInt64(pool.reconnects);
+            response["connectionPool"]["open"] = Json::UInt64(pool.openConnections);
+            response["connectionPool"]["idle"] = Json::UInt64(pool.idleConnections);
+            
+            MonitorStats monitor = deviceManager_->getMonitorStats();
+            response["monitoring"]["active"] = deviceManager_->isMonitoring();
+            response["monitoring"]["pollRate"] = monitor.pollRate;
+            response["monitoring"]["scheduled"] = Json::UInt64(monitor.scheduled);
+            response["monitoring"]["backlog"] = Json::UInt64(monitor.backlog);
+            response["monitoring"]["inFlight"] = Json::UInt64(monitor.inFlight);
+            response["monitoring"]["polls"] = Json::UInt64(monitor.polls);
             
             Json::StreamWriterBuilder builder;
             res.set_content(Json::writeString(builder, response), "application/json");
@@ -405,6 +1225,65 @@ void APIServer::setupRoutes() {
             res.status = 500;
         }
     });
+    
+    // Runtime internals for operators
+    server->Get("/api/metrics", [this](const httplib::Request&, httplib::Response& res) {
+        ExecutorStats executor = deviceManager_->getExecutorStats();
+        
+        Json::Value response;
+        response["success"] = true;
+        response["executor"]["workers"] = Json::UInt64(executor.workers);
+        response["executor"]["queued"]["interactive"] = Json::UInt64(executor.interactiveQueued);
+        response["executor"]["queued"]["background"] = Json::UInt64(executor.backgroundQueued);
+        response["executor"]["executed"] = Json::UInt64(executor.executed);
+        response["executor"]["steals"] = Json::UInt64(executor.steals);
+        response["commands"]["sent"] = Json::UInt64(TPLinkDevice::commandsSent());
+        response["commands"]["coalesced"] = Json::UInt64(TPLinkDevice::commandsCoalesced());
+        
+        DeviceCounts managed = deviceManager_->getDeviceCounts();
+        size_t stateBytes = deviceManager_->getStateStoreMemory();
+        response["stateStore"]["devices"] = Json::UInt64(managed.total);
+        response["stateStore"]["bytes"] = Json::UInt64(stateBytes);
+        response["stateStore"]["bytesPerDevice"] = managed.total ? static_cast<double>(stateBytes) / managed.total : 0.0;
+        
+        EventBusStats events = deviceManager_->getEventBus()->stats();
+        response["events"]["published"] = Json::UInt64(events.published);
+        response["events"]["delivered"] = Json::UInt64(events.delivered);
+        response["events"]["subscribers"] = Json::UInt64(events.subscribers);
+        response["events"]["streams"] = event_streams_.load();
+        for (size_t type = 0; type < kDeviceEventTypeCount; type++) {
+            response["events"]["byType"][EventBus::typeName(static_cast<DeviceEventType>(type))] =
+                Json::UInt64(events.byType[type]);
+        }
+        
+        BreakerStats breakers = deviceManager_->getBreakerStats();
+        response["breakers"]["open"] = Json::UInt64(breakers.open);
+        response["breakers"]["rejected"] = Json::UInt64(breakers.rejected);
+        response["breakers"]["devices"] = Json::Value(Json::arrayValue);
+        for (const auto& report : breakers.tripped) {
+            Json::Value entry = breakerJson(report.status);
+            entry["deviceId"] = report.deviceId;
+            response["breakers"]["devices"].append(entry);
+        }
+        
+        DatabaseWriteStats writes = database_->getWriteStats();
+        response["database"]["queued"] = Json::UInt64(writes.queued);
+        response["database"]["coalesced"] = Json::UInt64(writes.coalesced);
+        response["database"]["committed"] = Json::UInt64(writes.committed);
+        response["database"]["batches"] = Json::UInt64(writes.batches);
+        response["database"]["failed"] = Json::UInt64(writes.failed);
+        response["database"]["pending"] = Json::UInt64(writes.pending);
+        DatabaseCacheStats cache = database_->getCacheStats();
+        response["database"]["cache"]["devices"] = Json::UInt64(cache.devices);
+        response["database"]["cache"]["hits"] = Json::UInt64(cache.hits);
+        response["database"]["cache"]["misses"] = Json::UInt64(cache.misses);
+        response["database"]["cache"]["scans"] = Json::UInt64(cache.scans);
+        response["database"]["cache"]["checks"] = Json::UInt64(cache.checks);
+        response["database"]["cache"]["mismatches"] = Json::UInt64(cache.mismatches);
+        
+        Json::StreamWriterBuilder builder;
+        res.set_content(Json::writeString(builder, response), "application/json");
+    });
 }
 
 void APIServer::runServer() {
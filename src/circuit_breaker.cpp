@@ -0,0 +1,75 @@
+#include "circuit_breaker.h"
+#include <algorithm>
+
+CircuitBreaker::CircuitBreaker()
+    : state_(BreakerState::Closed), failures_(0), openings_(0), probe_in_flight_(false),
+      rejected_(0), rng_(std::random_device()()) {
+}
+
+bool CircuitBreaker::allow() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == BreakerState::Open && Clock::now() >= retry_at_) {
+        state_ = BreakerState::HalfOpen;
+    }
+    if (state_ == BreakerState::Closed) {
+        return true;
+    }
+    if (state_ == BreakerState::HalfOpen && !probe_in_flight_) {
+        probe_in_flight_ = true;
+        return true;
+    }
+    rejected_++;
+    return false;
+}
+
+void CircuitBreaker::recordSuccess() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = BreakerState::Closed;
+    failures_ = 0;
+    openings_ = 0;
+    probe_in_flight_ = false;
+}
+
+void CircuitBreaker::recordFailure() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    failures_++;
+    bool probeFailed = state_ == BreakerState::HalfOpen;
+    probe_in_flight_ = false;
+    if (!probeFailed && failures_ < kFailureThreshold) {
+        return;
+    }
+    if (state_ == BreakerState::Open) {
+        return; // A call admitted before the breaker opened
+    }
+
+    // Equal jitter: half the backoff is fixed, the other half random
+    int shift = std::min(openings_, 20);
+    int backoffMs = static_cast<int>(std::min<int64_t>(int64_t(kBaseBackoffMs) << shift, kMaxBackoffMs));
+    int delayMs = backoffMs / 2 + std::uniform_int_distribution<int>(0, backoffMs / 2)(rng_);
+    openings_++;
+    state_ = BreakerState::Open;
+    retry_at_ = Clock::now() + std::chrono::milliseconds(delayMs);
+}
+
+BreakerStatus CircuitBreaker::status() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    BreakerStatus status{state_, failures_, 0, rejected_};
+    if (state_ == BreakerState::Open) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(retry_at_ - Clock::now()).count();
+        if (remaining > 0) {
+            status.retryAfterMs = static_cast<int>(remaining);
+        } else {
+            status.state = BreakerState::HalfOpen; // The next call is the probe
+        }
+    }
+    return status;
+}
+
+const char* CircuitBreaker::stateName(BreakerState state) {
+    switch (state) {
+        case BreakerState::Closed: return "closed";
+        case BreakerState::Open: return "open";
+        case BreakerState::HalfOpen: return "half-open";
+    }
+    return "unknown";
+}
@@ -0,0 +1,244 @@
+#include "command_batch.h"
+#include <json/json.h>
+#include <memory>
+#include <sstream>
+
+namespace {
+
+const char* kLightModule = "smartlife.iot.smartbulb.lightingservice";
+const char* kLightMethod = "set_light_state";
+const char* kSystemModule = "system";
+const char* kRelayMethod = "set_relay_state";
+const char* kSysinfoMethod = "get_sysinfo";
+
+// Fills errCode (0 when absent) and err_msg from a reply object; false,
+// with the result marked invalid, when either has the wrong type
+bool readError(const Json::Value& reply, OperationResult& result) {
+    const Json::Value& code = reply.get("err_code", 0);
+    const Json::Value& message = reply.get("err_msg", "");
+    if (!code.isInt() || !message.isString()) {
+        result.errCode = -1;
+        result.error = "invalid response";
+        return false;
+    }
+    result.errCode = code.asInt();
+    result.error = message.asString();
+    return true;
+}
+
+}
+
+CommandBatch::CommandBatch()
+    : valid_(true), refresh_(false), power_(-1), onOff_(-1), brightness_(-1),
+      colorTemp_(-1), hue_(-1), saturation_(-1) {
+}
+
+CommandBatch& CommandBatch::setPower(bool on) {
+    power_ = on ? 1 : 0;
+    onOff_ = power_;
+    addOperation("power", false, power_);
+    return *this;
+}
+
+CommandBatch& CommandBatch::setBrightness(int brightness) {
+    if (brightness < 0 || brightness > 100) {
+        valid_ = false;
+    }
+    brightness_ = brightness;
+    onOff_ = brightness > 0 ? 1 : 0;
+    addOperation("brightness", true, brightness);
+    return *this;
+}
+
+CommandBatch& CommandBatch::setColorTemp(int temp) {
+    if (temp < 2700 || temp > 6500) {
+        valid_ = false;
+    }
+    // A color temperature takes precedence over hue/saturation on the bulb
+    colorTemp_ = temp;
+    hue_ = -1;
+    saturation_ = -1;
+    onOff_ = 1;
+    addOperation("colorTemp", true, temp);
+    return *this;
+}
+
+CommandBatch& CommandBatch::setColor(int hue, int saturation, int value) {
+    if (hue < 0 || hue > 360 || saturation < 0 || saturation > 100 || value < 0 || value > 100) {
+        valid_ = false;
+    }
+    hue_ = hue;
+    saturation_ = saturation;
+    brightness_ = value;
+    colorTemp_ = -1;
+    onOff_ = 1;
+    addOperation("color", true, hue, saturation, value);
+    return *this;
+}
+
+CommandBatch& CommandBatch::refresh() {
+    if (!refresh_) {
+        refresh_ = true;
+        addOperation("refresh", false);
+    }
+    return *this;
+}
+
+CommandBatch& CommandBatch::merge(const CommandBatch& later) {
+    for (const auto& op : later.operations_) {
+        if (op.name == "power") {
+            setPower(op.args[0] != 0);
+        } else if (op.name == "brightness") {
+            setBrightness(op.args[0]);
+        } else if (op.name == "colorTemp") {
+            setColorTemp(op.args[0]);
+        } else if (op.name == "color") {
+            setColor(op.args[0], op.args[1], op.args[2]);
+        } else if (op.name == "refresh") {
+            refresh();
+        }
+    }
+    return *this;
+}
+
+bool CommandBatch::empty() const {
+    return operations_.empty();
+}
+
+bool CommandBatch::valid() const {
+    return valid_;
+}
+
+bool CommandBatch::hasRefresh() const {
+    return refresh_;
+}
+
+std::vector<std::string> CommandBatch::operationNames() const {
+    std::vector<std::string> names;
+    for (const auto& op : operations_) {
+        names.push_back(op.name);
+    }
+    return names;
+}
+
+void CommandBatch::addOperation(const std::string& name, bool lightState, int arg0, int arg1, int arg2) {
+    for (auto& op : operations_) {
+        if (op.name == name) {
+            op.args[0] = arg0;
+            op.args[1] = arg1;
+            op.args[2] = arg2;
+            return;
+        }
+    }
+    operations_.push_back(Operation{name, lightState, {arg0, arg1, arg2}});
+}
+
+BatchTarget CommandBatch::target() const {
+    return BatchTarget{onOff_, brightness_, colorTemp_, hue_, saturation_};
+}
+
+std::string CommandBatch::toJson(bool isBulb) const {
+    bool hasLight = false;
+    for (const auto& op : operations_) {
+        if (op.lightState || (op.name == "power" && isBulb)) {
+            hasLight = true;
+        }
+    }
+    bool relay = power_ >= 0 && !isBulb;
+
+    // Written by hand so the writes precede get_sysinfo; devices execute
+    // methods in the order they appear.
+    std::ostringstream json;
+    json << "{";
+    if (hasLight) {
+        json << "\"" << kLightModule << "\":{\"" << kLightMethod << "\":{";
+        const char* sep = "";
+        if (brightness_ >= 0) {
+            json << sep << "\"brightness\":" << brightness_;
+            sep = ",";
+        }
+        if (colorTemp_ >= 0) {
+            json << sep << "\"color_temp\":" << colorTemp_;
+            sep = ",";
+        }
+        if (hue_ >= 0) {
+            json << sep << "\"hue\":" << hue_;
+            sep = ",";
+        }
+        if (onOff_ >= 0) {
+            json << sep << "\"on_off\":" << onOff_;
+            sep = ",";
+        }
+        if (saturation_ >= 0) {
+            json << sep << "\"saturation\":" << saturation_;
+        }
+        json << "}}";
+    }
+    if (relay || refresh_) {
+        json << (hasLight ? "," : "") << "\"" << kSystemModule << "\":{";
+        if (relay) {
+            json << "\"" << kRelayMethod << "\":{\"state\":" << power_ << "}";
+        }
+        if (refresh_) {
+            json << (relay ? "," : "") << "\"" << kSysinfoMethod << "\":null";
+        }
+        json << "}";
+    }
+    json << "}";
+
+    return json.str();
+}
+
+BatchResult CommandBatch::parseResponse(const std::string& response, bool isBulb) const {
+    BatchResult batch;
+    batch.success = true;
+
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errors;
+    bool parsed = !response.empty() &&
+                  reader->parse(response.data(), response.data() + response.size(), &root, &errors) &&
+                  root.isObject();
+
+    for (const auto& op : operations_) {
+        const char* module = kSystemModule;
+        const char* method = kSysinfoMethod;
+        if (op.lightState || (op.name == "power" && isBulb)) {
+            module = kLightModule;
+            method = kLightMethod;
+        } else if (op.name == "power") {
+            method = kRelayMethod;
+        }
+
+        // Read through const references and check every type first: jsoncpp
+        // throws on indexing a non-object or converting a mismatched value,
+        // and this runs in a completion on an executor worker
+        OperationResult result{op.name, false, -1, ""};
+        const Json::Value& moduleValue = parsed ? root.get(module, Json::nullValue) : Json::Value::nullSingleton();
+        if (!parsed) {
+            result.error = response.empty() ? "no response from device" : "invalid response";
+        } else if (moduleValue.isNull()) {
+            result.error = std::string("no response for ") + module + "." + method;
+        } else if (!moduleValue.isObject()) {
+            result.error = "invalid response";
+        } else if (moduleValue.isMember("err_code") && !moduleValue.isMember(method)) {
+            // Module-level failure, e.g. "module not support"
+            readError(moduleValue, result);
+        } else if (moduleValue.isMember(method)) {
+            const Json::Value& reply = moduleValue[method];
+            if (reply.isObject() && readError(reply, result)) {
+                result.success = result.errCode == 0;
+            } else if (!reply.isObject()) {
+                result.error = "invalid response";
+            }
+        } else {
+            result.error = std::string("no response for ") + module + "." + method;
+        }
+
+        batch.success = batch.success && result.success;
+        batch.results.push_back(result);
+    }
+
+    return batch;
+}
@@ -1,12 +1,337 @@
 #include "database.h"
 #include <sqlite3.h>
+#include <algorithm>
+#include <climits>
 #include <iostream>
-#include <sstream>
+#include <unordered_set>
 
-Database::Database(const std::string& dbPath) : dbPath_(dbPath), db_(nullptr) {
+namespace {
+
+const char* const kStatementSql[] = {
+    // kUpsertDevice
+    "INSERT OR REPLACE INTO devices (device_id, name, ip, port, model, mac, is_online, is_on, "
+    "brightness, color_temp, hue, saturation, updated_at) "
+    "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, CURRENT_TIMESTAMP)",
+    // kDeleteDevice
+    "DELETE FROM devices WHERE device_id = ?1",
+    // kSelectDevice
+    "SELECT device_id, name, ip, port, model, mac, is_online, is_on, brightness, color_temp, hue, "
+    "saturation FROM devices WHERE device_id = ?1",
+    // kSelectAllDevices
+    "SELECT device_id, name, ip, port, model, mac, is_online, is_on, brightness, color_temp, hue, "
+    "saturation FROM devices ORDER BY name",
+    // kSelectDevicesByStatus
+    "SELECT device_id, name, ip, port, model, mac, is_online, is_on, brightness, color_temp, hue, "
+    "saturation FROM devices WHERE is_online = ?1 ORDER BY name",
+    // kUpdateDeviceFields: a NULL leaves the column as it is
+    "UPDATE devices SET is_online = COALESCE(?2, is_online), is_on = COALESCE(?3, is_on), "
+    "brightness = COALESCE(?4, brightness), color_temp = COALESCE(?5, color_temp), "
+    "hue = COALESCE(?6, hue), saturation = COALESCE(?7, saturation), "
+    "updated_at = CURRENT_TIMESTAMP WHERE device_id = ?1",
+    // kUpsertGroup
+    "INSERT OR REPLACE INTO device_groups (group_id, name) VALUES (?1, ?2)",
+    // kDeleteGroup
+    "DELETE FROM device_groups WHERE group_id = ?1",
+    // kDeleteGroupMembers
+    "DELETE FROM group_members WHERE group_id = ?1",
+    // kInsertGroupMember
+    "INSERT OR IGNORE INTO group_members (group_id, device_id) VALUES (?1, ?2)",
+    // kSelectGroup
+    "SELECT g.group_id, g.name, m.device_id FROM device_groups g "
+    "LEFT JOIN group_members m ON m.group_id = g.group_id WHERE g.group_id = ?1 "
+    "ORDER BY g.name, g.group_id, m.device_id",
+    // kSelectAllGroups
+    "SELECT g.group_id, g.name, m.device_id FROM device_groups g "
+    "LEFT JOIN group_members m ON m.group_id = g.group_id "
+    "ORDER BY g.name, g.group_id, m.device_id",
+    // kUpsertScene
+    "INSERT OR REPLACE INTO scenes (scene_id, name) VALUES (?1, ?2)",
+    // kDeleteScene
+    "DELETE FROM scenes WHERE scene_id = ?1",
+    // kDeleteSceneTargets
+    "DELETE FROM scene_targets WHERE scene_id = ?1",
+    // kInsertSceneTarget
+    "INSERT OR REPLACE INTO scene_targets "
+    "(scene_id, device_id, is_on, brightness, color_temp, hue, saturation) "
+    "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)",
+    // kSelectScene
+    "SELECT s.scene_id, s.name, t.device_id, t.is_on, t.brightness, t.color_temp, t.hue, t.saturation "
+    "FROM scenes s LEFT JOIN scene_targets t ON t.scene_id = s.scene_id WHERE s.scene_id = ?1 "
+    "ORDER BY s.name, s.scene_id, t.device_id",
+    // kSelectAllScenes
+    "SELECT s.scene_id, s.name, t.device_id, t.is_on, t.brightness, t.color_temp, t.hue, t.saturation "
+    "FROM scenes s LEFT JOIN scene_targets t ON t.scene_id = s.scene_id "
+    "ORDER BY s.name, s.scene_id, t.device_id",
+    // kInsertDiscoveryRecord
+    "INSERT INTO discovery_history (ip, device_id, model, success) VALUES (?1, ?2, ?3, ?4)",
+    // kSelectKnownIPs
+    "SELECT DISTINCT ip FROM devices",
+    // kSelectHistoryKey
+    "SELECT device_key FROM history_devices WHERE device_id = ?1",
+    // kInsertHistoryKey
+    "INSERT OR IGNORE INTO history_devices (device_id) VALUES (?1)",
+    // kSelectHistoryKeys
+    "SELECT device_key FROM history_devices",
+    // kInsertHistory
+    "INSERT OR REPLACE INTO state_history "
+    "(device_key, ts, is_online, is_on, brightness, color_temp, hue, saturation) "
+    "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)",
+    // kSelectHistoryRange
+    "SELECT ts, is_online, is_on, brightness, color_temp, hue, saturation FROM state_history "
+    "WHERE device_key = ?1 AND ts >= ?2 AND ts < ?3 ORDER BY ts LIMIT ?4",
+    // kSelectHistoryBefore
+    "SELECT ts, is_online, is_on, brightness, color_temp, hue, saturation FROM state_history "
+    "WHERE device_key = ?1 AND ts < ?2 ORDER BY ts DESC LIMIT 1",
+    // kDeleteHistoryBefore
+    "DELETE FROM state_history WHERE device_key = ?1 AND ts < ?2",
+    // kUpsertRollup
+    "INSERT OR REPLACE INTO state_rollups (device_key, width, bucket, changes, on_ms, online_ms, "
+    "brightness_avg, brightness_min, brightness_max, is_online, is_on, brightness) "
+    "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12)",
+    // kSelectRollups
+    "SELECT bucket, changes, on_ms, online_ms, brightness_avg, brightness_min, brightness_max, "
+    "is_online, is_on, brightness FROM state_rollups "
+    "WHERE device_key = ?1 AND width = ?2 AND bucket >= ?3 AND bucket < ?4 ORDER BY bucket",
+    // kDeleteRollupsBefore
+    "DELETE FROM state_rollups WHERE device_key = ?1 AND width = ?2 AND bucket < ?3",
+    // kSelectRollupProgress
+    "SELECT through_ms FROM rollup_progress WHERE width = ?1",
+    // kUpsertRollupProgress
+    "INSERT OR REPLACE INTO rollup_progress (width, through_ms) VALUES (?1, ?2)",
+    // kDeleteDiscoveryRecordsBefore: discovered_at is UTC text, which sorts by time
+    "DELETE FROM discovery_history WHERE discovered_at < datetime(?1 / 1000, 'unixepoch')",
+    // kBegin, kCommit, kRollback
+    "BEGIN",
+    "COMMIT",
+    "ROLLBACK",
+};
+
+// Binds parameters to a cached statement and resets it when the call is
+// done, so the next caller finds it unbound and at the start. Text is bound
+// without a copy: the string must outlive the Query. Statements are null
+// until initialize() succeeds; a Query on one does nothing and fails.
+class Query {
+public:
+    explicit Query(void* statement) : stmt_(static_cast<sqlite3_stmt*>(statement)) {}
+    ~Query() {
+        if (stmt_) {
+            sqlite3_reset(stmt_);
+            sqlite3_clear_bindings(stmt_);
+        }
+    }
+    Query(const Query&) = delete;
+    Query& operator=(const Query&) = delete;
+
+    Query& bind(int index, const std::string& value) {
+        if (stmt_) {
+            sqlite3_bind_text(stmt_, index, value.data(), static_cast<int>(value.size()), SQLITE_STATIC);
+        }
+        return *this;
+    }
+    Query& bind(int index, int value) {
+        if (stmt_) {
+            sqlite3_bind_int(stmt_, index, value);
+        }
+        return *this;
+    }
+    Query& bind(int index, int64_t value) {
+        if (stmt_) {
+            sqlite3_bind_int64(stmt_, index, value);
+        }
+        return *this;
+    }
+    // Negative values are "unset" and bind as NULL
+    Query& bindSetting(int index, int value) {
+        if (stmt_ && value >= 0) {
+            sqlite3_bind_int(stmt_, index, value);
+        }
+        return *this;
+    }
+
+    // Next result row; false once the rows run out or on error
+    bool step() {
+        if (!stmt_) {
+            return false;
+        }
+        int rc = sqlite3_step(stmt_);
+        if (rc == SQLITE_ROW) {
+            return true;
+        }
+        if (rc != SQLITE_DONE) {
+            report();
+        }
+        return false;
+    }
+    // For statements without results
+    bool run() {
+        if (!stmt_) {
+            return false;
+        }
+        int rc = sqlite3_step(stmt_);
+        if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
+            report();
+            return false;
+        }
+        return true;
+    }
+
+    std::string text(int column) const {
+        const unsigned char* value = sqlite3_column_text(stmt_, column);
+        return value ? std::string(reinterpret_cast<const char*>(value),
+                                   static_cast<size_t>(sqlite3_column_bytes(stmt_, column)))
+                     : std::string();
+    }
+    int integer(int column, int fallback) const {
+        return sqlite3_column_type(stmt_, column) == SQLITE_NULL ? fallback : sqlite3_column_int(stmt_, column);
+    }
+    int64_t integer64(int column) const {
+        return sqlite3_column_int64(stmt_, column);
+    }
+    bool isNull(int column) const {
+        return sqlite3_column_type(stmt_, column) == SQLITE_NULL;
+    }
+
+private:
+    void report() const {
+        std::cerr << "SQL error: " << sqlite3_errmsg(sqlite3_db_handle(stmt_)) << std::endl;
+    }
+
+    sqlite3_stmt* stmt_;
+};
+
+// Columns in the order the device SELECTs list them
+DeviceInfo readDevice(const Query& query) {
+    DeviceInfo device;
+    device.deviceId = query.text(0);
+    device.name = query.text(1);
+    device.ip = query.text(2);
+    device.port = query.integer(3, 9999);
+    device.model = query.text(4);
+    device.mac = query.text(5);
+    device.isOnline = query.integer(6, 0) != 0;
+    device.isOn = query.integer(7, 0) != 0;
+    device.brightness = query.integer(8, 0);
+    device.colorTemp = query.integer(9, 4000);
+    device.hue = query.integer(10, 0);
+    device.saturation = query.integer(11, 0);
+    return device;
+}
+
+// Columns in the order the history SELECTs list them
+StateSample readSample(const Query& query) {
+    StateSample sample;
+    sample.timestampMs = query.integer64(0);
+    sample.isOnline = query.integer(1, 0) != 0;
+    sample.isOn = query.integer(2, 0) != 0;
+    sample.brightness = query.integer(3, 0);
+    sample.colorTemp = query.integer(4, 0);
+    sample.hue = query.integer(5, 0);
+    sample.saturation = query.integer(6, 0);
+    return sample;
+}
+
+bool sameState(const StateSample& a, const StateSample& b) {
+    return a.isOnline == b.isOnline && a.isOn == b.isOn && a.brightness == b.brightness &&
+           a.colorTemp == b.colorTemp && a.hue == b.hue && a.saturation == b.saturation;
+}
+
+// One rollup of widthMs for each bucket holding samples (ordered by time).
+// prior, when known, is the state before the first sample.
+std::vector<StateRollup> bucketSamples(const StateSample* prior, const std::vector<StateSample>& samples,
+                                       int64_t widthMs) {
+    std::vector<StateRollup> rollups;
+    bool known = prior != nullptr;
+    StateSample state = known ? *prior : StateSample{};
+    size_t next = 0;
+    while (next < samples.size()) {
+        StateRollup rollup{};
+        rollup.bucketMs = samples[next].timestampMs - samples[next].timestampMs % widthMs;
+        rollup.brightnessMin = INT_MAX;
+        rollup.brightnessMax = INT_MIN;
+        int64_t end = rollup.bucketMs + widthMs;
+        int64_t cursor = rollup.bucketMs;
+        int64_t knownMs = 0;
+        int64_t brightnessMs = 0;
+        
+        // Credits the current state with the time up to until
+        auto hold = [&](int64_t until) {
+            if (known && until > cursor) {
+                int64_t span = until - cursor;
+                knownMs += span;
+                rollup.onMs += state.isOn ? span : 0;
+                rollup.onlineMs += state.isOnline ? span : 0;
+                brightnessMs += state.brightness * span;
+                rollup.brightnessMin = std::min(rollup.brightnessMin, state.brightness);
+                rollup.brightnessMax = std::max(rollup.brightnessMax, state.brightness);
+            }
+            cursor = until;
+        };
+        for (; next < samples.size() && samples[next].timestampMs < end; next++) {
+            hold(samples[next].timestampMs);
+            state = samples[next];
+            known = true;
+            rollup.changes++;
+        }
+        hold(end);
+        
+        rollup.brightnessAvg = static_cast<int>(brightnessMs / knownMs);
+        rollup.isOnline = state.isOnline;
+        rollup.isOn = state.isOn;
+        rollup.brightness = state.brightness;
+        rollups.push_back(rollup);
+    }
+    return rollups;
+}
+
+int64_t widthOf(HistoryResolution resolution) {
+    return resolution == HistoryResolution::Hour ? 60 * 60 * 1000LL : 60 * 1000LL;
+}
+
+int64_t unixMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool sameDevice(const DeviceInfo& a, const DeviceInfo& b) {
+    return a.deviceId == b.deviceId && a.name == b.name && a.ip == b.ip && a.port == b.port &&
+           a.model == b.model && a.mac == b.mac && a.isOnline == b.isOnline && a.isOn == b.isOn &&
+           a.brightness == b.brightness && a.colorTemp == b.colorTemp && a.hue == b.hue &&
+           a.saturation == b.saturation;
+}
+
+// The listing order of the devices table, ties broken by id
+bool byName(const DeviceInfo& a, const DeviceInfo& b) {
+    return a.name != b.name ? a.name < b.name : a.deviceId < b.deviceId;
+}
+
+// Settings of -1 are unset and leave target alone
+void overlay(int& target, int value) {
+    if (value >= 0) {
+        target = value;
+    }
+}
+
+}
+
+Database::Database(const std::string& dbPath)
+    : dbPath_(dbPath), db_(nullptr), statements_{}, committed_through_(0), flush_requested_(false),
+      stopping_(false), stats_{}, retention_(kDefaultRetention), cache_totals_{}, cache_check_(false), cache_hits_(0),
+      cache_misses_(0), cache_scans_(0), cache_checks_(0), cache_mismatches_(0) {
 }
 
 Database::~Database() {
+    // Commits whatever is still queued
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stopping_ = true;
+    }
+    writer_wake_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    for (void* statement : statements_) {
+        sqlite3_finalize(static_cast<sqlite3_stmt*>(statement));
+    }
     if (db_) {
         sqlite3_close(static_cast<sqlite3*>(db_));
     }
@@ -20,6 +345,11 @@ bool Database::initialize() {
     }
     db_ = db;
     
+    // WAL: commits append to the log and, with synchronous=NORMAL, don't
+    // wait on fsync; only checkpoints do. Readers no longer block the writer.
+    executeQuery("PRAGMA journal_mode=WAL");
+    executeQuery("PRAGMA synchronous=NORMAL");
+    
     // Create devices table
     std::string createDevicesTable = R"(
         CREATE TABLE IF NOT EXISTS devices (
@@ -60,10 +390,100 @@ bool Database::initialize() {
         return false;
     }
     
+    // Groups and scenes. Members and targets go with their group or scene.
+    std::string createGroupTables = R"(
+        CREATE TABLE IF NOT EXISTS device_groups (
+            group_id TEXT PRIMARY KEY,
+            name TEXT NOT NULL,
+            created_at DATETIME DEFAULT CURRENT_TIMESTAMP
+        );
+        CREATE TABLE IF NOT EXISTS group_members (
+            group_id TEXT NOT NULL,
+            device_id TEXT NOT NULL,
+            PRIMARY KEY (group_id, device_id)
+        );
+        CREATE TABLE IF NOT EXISTS scenes (
+            scene_id TEXT PRIMARY KEY,
+            name TEXT NOT NULL,
+            created_at DATETIME DEFAULT CURRENT_TIMESTAMP
+        );
+        CREATE TABLE IF NOT EXISTS scene_targets (
+            scene_id TEXT NOT NULL,
+            device_id TEXT NOT NULL,
+            is_on INTEGER NOT NULL,
+            brightness INTEGER DEFAULT -1,
+            color_temp INTEGER DEFAULT -1,
+            hue INTEGER DEFAULT -1,
+            saturation INTEGER DEFAULT -1,
+            PRIMARY KEY (scene_id, device_id)
+        )
+    )";
+    
+    if (!executeQuery(createGroupTables)) {
+        return false;
+    }
+    
+    // State history. Device ids are stored once, in history_devices; rows
+    // refer to them by integer key. Rollup widths are in milliseconds.
+    std::string createHistoryTables = R"(
+        CREATE TABLE IF NOT EXISTS history_devices (
+            device_key INTEGER PRIMARY KEY,
+            device_id TEXT NOT NULL UNIQUE
+        );
+        CREATE TABLE IF NOT EXISTS state_history (
+            device_key INTEGER NOT NULL,
+            ts INTEGER NOT NULL,
+            is_online INTEGER NOT NULL,
+            is_on INTEGER NOT NULL,
+            brightness INTEGER NOT NULL,
+            color_temp INTEGER NOT NULL,
+            hue INTEGER NOT NULL,
+            saturation INTEGER NOT NULL,
+            PRIMARY KEY (device_key, ts)
+        ) WITHOUT ROWID;
+        CREATE TABLE IF NOT EXISTS state_rollups (
+            device_key INTEGER NOT NULL,
+            width INTEGER NOT NULL,
+            bucket INTEGER NOT NULL,
+            changes INTEGER NOT NULL,
+            on_ms INTEGER NOT NULL,
+            online_ms INTEGER NOT NULL,
+            brightness_avg INTEGER NOT NULL,
+            brightness_min INTEGER NOT NULL,
+            brightness_max INTEGER NOT NULL,
+            is_online INTEGER NOT NULL,
+            is_on INTEGER NOT NULL,
+            brightness INTEGER NOT NULL,
+            PRIMARY KEY (device_key, width, bucket)
+        ) WITHOUT ROWID;
+        CREATE TABLE IF NOT EXISTS rollup_progress (
+            width INTEGER PRIMARY KEY,
+            through_ms INTEGER NOT NULL
+        )
+    )";
+    
+    if (!executeQuery(createHistoryTables)) {
+        return false;
+    }
+    
     // Create index for faster lookups
     std::string createIndex = "CREATE INDEX IF NOT EXISTS idx_devices_ip ON devices(ip)";
     executeQuery(createIndex);
+    // Device listings are ordered by name; this saves a sort per call
+    executeQuery("CREATE INDEX IF NOT EXISTS idx_devices_name ON devices(name)");
     
+    if (!prepareStatements()) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unique_lock<std::shared_mutex> cache(cache_mutex_);
+        for (const auto& device : selectDevices(kSelectAllDevices, -1)) {
+            cachePut(device);
+        }
+    }
+    next_maintenance_ = std::chrono::steady_clock::now();
+    writer_ = std::thread(&Database::runWriter, this);
     return true;
 }
 
@@ -72,17 +492,23 @@ bool Database::isOpen() {
 }
 
 bool Database::addDevice(const DeviceInfo& device) {
-    std::stringstream query;
-    query << "INSERT OR REPLACE INTO devices (device_id, name, ip, port, model, mac, "
-          << "is_online, is_on, brightness, color_temp, hue, saturation, updated_at) "
-          << "VALUES ('" << device.deviceId << "', '" << device.name << "', '"
-          << device.ip << "', " << device.port << ", '" << device.model << "', '"
-          << device.mac << "', " << (device.isOnline ? 1 : 0) << ", "
-          << (device.isOn ? 1 : 0) << ", " << device.brightness << ", "
-          << device.colorTemp << ", " << device.hue << ", " << device.saturation
-          << ", CURRENT_TIMESTAMP)";
-    
-    return executeQuery(query.str());
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!writer_.joinable()) {
+        return false;
+    }
+    {
+        std::unique_lock<std::shared_mutex> cache(cache_mutex_);
+        cachePut(device);
+    }
+    bool wasEmpty = pendingWrites() == 0;
+    PendingDevice write{PendingDevice::Upsert, device, -1, -1, -1, -1, -1, -1};
+    auto result = pending_devices_.emplace(device.deviceId, write);
+    if (!result.second) {
+        result.first->second = write;
+        stats_.coalesced++;
+    }
+    queued(wasEmpty);
+    return true;
 }
 
 bool Database::updateDevice(const DeviceInfo& device) {
@@ -90,213 +516,515 @@ bool Database::updateDevice(const DeviceInfo& device) {
 }
 
 bool Database::removeDevice(const std::string& deviceId) {
-    std::string query = "DELETE FROM devices WHERE device_id = '" + deviceId + "'";
-    return executeQuery(query);
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!writer_.joinable()) {
+        return false;
+    }
+    bool wasEmpty = pendingWrites() == 0;
+    last_recorded_.erase(deviceId);
+    {
+        std::unique_lock<std::shared_mutex> cache(cache_mutex_);
+        cacheErase(deviceId);
+    }
+    PendingDevice write{PendingDevice::Remove, DeviceInfo(), -1, -1, -1, -1, -1, -1};
+    auto result = pending_devices_.emplace(deviceId, write);
+    if (!result.second) {
+        result.first->second = write;
+        stats_.coalesced++;
+    }
+    queued(wasEmpty);
+    return true;
 }
 
 DeviceInfo Database::getDevice(const std::string& deviceId) {
-    DeviceInfo device;
-    
-    std::string query = "SELECT * FROM devices WHERE device_id = '" + deviceId + "'";
+    // In check mode, holding the drained queue keeps writes out until both reads are done
+    std::unique_lock<std::mutex> quiet;
+    if (cache_check_) {
+        quiet = quiesce();
+    }
     
-    auto callback = [](void* data, int argc, char** argv, char** colNames) -> int {
-        DeviceInfo* device = static_cast<DeviceInfo*>(data);
-        
-        if (argc >= 13) {
-            device->deviceId = argv[0] ? argv[0] : "";
-            device->name = argv[1] ? argv[1] : "";
-            device->ip = argv[2] ? argv[2] : "";
-            device->port = argv[3] ? std::stoi(argv[3]) : 9999;
-            device->model = argv[4] ? argv[4] : "";
-            device->mac = argv[5] ? argv[5] : "";
-            device->isOnline = argv[6] ? std::stoi(argv[6]) != 0 : false;
-            device->isOn = argv[7] ? std::stoi(argv[7]) != 0 : false;
-            device->brightness = argv[8] ? std::stoi(argv[8]) : 0;
-            device->colorTemp = argv[9] ? std::stoi(argv[9]) : 4000;
-            device->hue = argv[10] ? std::stoi(argv[10]) : 0;
-            device->saturation = argv[11] ? std::stoi(argv[11]) : 0;
+    DeviceInfo device{};
+    {
+        std::shared_lock<std::shared_mutex> cache(cache_mutex_);
+        auto it = cache_.find(deviceId);
+        if (it != cache_.end()) {
+            device = it->second->second;
         }
-        
-        return 0;
-    };
+    }
+    (device.deviceId.empty() ? cache_misses_ : cache_hits_)++;
     
-    executeQueryWithResult(query, callback, &device);
+    if (quiet.owns_lock()) {
+        DeviceInfo stored{};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Query query(statements_[kSelectDevice]);
+            query.bind(1, deviceId);
+            if (query.step()) {
+                stored = readDevice(query);
+            }
+        }
+        cache_checks_++;
+        if (stored.deviceId != device.deviceId || (!device.deviceId.empty() && !sameDevice(stored, device))) {
+            cache_mismatches_++;
+            std::cerr << "Device cache differs from the table for " << deviceId << std::endl;
+        }
+    }
     return device;
 }
 
 std::vector<DeviceInfo> Database::getAllDevices() {
-    std::vector<DeviceInfo> devices;
-    
-    std::string query = "SELECT * FROM devices ORDER BY name";
-    
-    auto callback = [](void* data, int argc, char** argv, char** colNames) -> int {
-        std::vector<DeviceInfo>* devices = static_cast<std::vector<DeviceInfo>*>(data);
-        
-        if (argc >= 13) {
-            DeviceInfo device;
-            device.deviceId = argv[0] ? argv[0] : "";
-            device.name = argv[1] ? argv[1] : "";
-            device.ip = argv[2] ? argv[2] : "";
-            device.port = argv[3] ? std::stoi(argv[3]) : 9999;
-            device.model = argv[4] ? argv[4] : "";
-            device.mac = argv[5] ? argv[5] : "";
-            device.isOnline = argv[6] ? std::stoi(argv[6]) != 0 : false;
-            device.isOn = argv[7] ? std::stoi(argv[7]) != 0 : false;
-            device.brightness = argv[8] ? std::stoi(argv[8]) : 0;
-            device.colorTemp = argv[9] ? std::stoi(argv[9]) : 4000;
-            device.hue = argv[10] ? std::stoi(argv[10]) : 0;
-            device.saturation = argv[11] ? std::stoi(argv[11]) : 0;
-            
-            devices->push_back(device);
-        }
-        
-        return 0;
-    };
-    
-    executeQueryWithResult(query, callback, &devices);
-    return devices;
+    return cachedDevices(-1);
 }
 
 std::vector<DeviceInfo> Database::getDevicesByStatus(bool isOnline) {
-    std::vector<DeviceInfo> devices;
-    
-    std::string query = "SELECT * FROM devices WHERE is_online = " + 
-                       std::string(isOnline ? "1" : "0") + " ORDER BY name";
-    
-    auto callback = [](void* data, int argc, char** argv, char** colNames) -> int {
-        std::vector<DeviceInfo>* devices = static_cast<std::vector<DeviceInfo>*>(data);
-        
-        if (argc >= 13) {
-            DeviceInfo device;
-            device.deviceId = argv[0] ? argv[0] : "";
-            device.name = argv[1] ? argv[1] : "";
-            device.ip = argv[2] ? argv[2] : "";
-            device.port = argv[3] ? std::stoi(argv[3]) : 9999;
-            device.model = argv[4] ? argv[4] : "";
-            device.mac = argv[5] ? argv[5] : "";
-            device.isOnline = argv[6] ? std::stoi(argv[6]) != 0 : false;
-            device.isOn = argv[7] ? std::stoi(argv[7]) != 0 : false;
-            device.brightness = argv[8] ? std::stoi(argv[8]) : 0;
-            device.colorTemp = argv[9] ? std::stoi(argv[9]) : 4000;
-            device.hue = argv[10] ? std::stoi(argv[10]) : 0;
-            device.saturation = argv[11] ? std::stoi(argv[11]) : 0;
-            
-            devices->push_back(device);
-        }
-        
-        return 0;
-    };
-    
-    executeQueryWithResult(query, callback, &devices);
-    return devices;
+    return cachedDevices(isOnline ? 1 : 0);
 }
 
 bool Database::updateDeviceStatus(const std::string& deviceId, bool isOnline) {
-    std::string query = "UPDATE devices SET is_online = " + 
-                       std::string(isOnline ? "1" : "0") + 
-                       ", updated_at = CURRENT_TIMESTAMP WHERE device_id = '" + deviceId + "'";
-    return executeQuery(query);
+    return queueUpdate(deviceId, {PendingDevice::Update, DeviceInfo(), isOnline ? 1 : 0, -1, -1, -1, -1, -1});
 }
 
 bool Database::updateDeviceState(const std::string& deviceId, bool isOn, int brightness, 
                                 int colorTemp, int hue, int saturation) {
-    std::stringstream query;
-    query << "UPDATE devices SET is_on = " << (isOn ? 1 : 0);
-    
-    if (brightness >= 0) {
-        query << ", brightness = " << brightness;
+    return queueUpdate(deviceId, {PendingDevice::Update, DeviceInfo(), -1, isOn ? 1 : 0, brightness,
+                                  colorTemp, hue, saturation});
+}
+
+bool Database::updateDevices(const std::vector<DeviceInfo>& devices) {
+    for (const auto& device : devices) {
+        if (!queueUpdate(device.deviceId, {PendingDevice::Update, DeviceInfo(), device.isOnline ? 1 : 0,
+                                           device.isOn ? 1 : 0, device.brightness, device.colorTemp,
+                                           device.hue, device.saturation})) {
+            return false;
+        }
     }
-    if (colorTemp >= 0) {
-        query << ", color_temp = " << colorTemp;
+    return true;
+}
+
+void Database::flush() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    uint64_t target = stats_.queued;
+    if (committed_through_ >= target || !writer_.joinable()) {
+        return;
     }
-    if (hue >= 0) {
-        query << ", hue = " << hue;
+    flush_requested_ = true;
+    writer_wake_.notify_one();
+    flushed_.wait(lock, [this, target]() { return committed_through_ >= target; });
+}
+
+std::unique_lock<std::mutex> Database::quiesce() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (writer_.joinable() && (pendingWrites() > 0 || committed_through_ < stats_.queued)) {
+        flush_requested_ = true;
+        writer_wake_.notify_one();
+        flushed_.wait(lock);
     }
-    if (saturation >= 0) {
-        query << ", saturation = " << saturation;
+    return lock;
+}
+
+DatabaseWriteStats Database::getWriteStats() {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    DatabaseWriteStats stats = stats_;
+    stats.pending = pendingWrites();
+    return stats;
+}
+
+bool Database::saveGroup(const DeviceGroup& group) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return transaction([&]() {
+        if (!Query(statements_[kUpsertGroup]).bind(1, group.groupId).bind(2, group.name).run() ||
+            !Query(statements_[kDeleteGroupMembers]).bind(1, group.groupId).run()) {
+            return false;
+        }
+        for (const auto& deviceId : group.deviceIds) {
+            if (!Query(statements_[kInsertGroupMember]).bind(1, group.groupId).bind(2, deviceId).run()) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+bool Database::removeGroup(const std::string& groupId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return transaction([&]() {
+        return Query(statements_[kDeleteGroupMembers]).bind(1, groupId).run() &&
+               Query(statements_[kDeleteGroup]).bind(1, groupId).run();
+    });
+}
+
+DeviceGroup Database::getGroup(const std::string& groupId) {
+    std::vector<DeviceGroup> groups = getGroups(kSelectGroup, groupId);
+    return groups.empty() ? DeviceGroup{} : groups.front();
+}
+
+std::vector<DeviceGroup> Database::getAllGroups() {
+    return getGroups(kSelectAllGroups, "");
+}
+
+std::vector<DeviceGroup> Database::getGroups(Statement statement, const std::string& groupId) {
+    std::vector<DeviceGroup> groups;
+    std::lock_guard<std::mutex> lock(mutex_);
+    Query query(statements_[statement]);
+    if (statement == kSelectGroup) {
+        query.bind(1, groupId);
     }
     
-    query << ", updated_at = CURRENT_TIMESTAMP WHERE device_id = '" << deviceId << "'";
+    // Rows arrive grouped, one per member
+    while (query.step()) {
+        if (query.isNull(0)) {
+            continue;
+        }
+        std::string id = query.text(0);
+        if (groups.empty() || groups.back().groupId != id) {
+            DeviceGroup group;
+            group.groupId = id;
+            group.name = query.text(1);
+            groups.push_back(group);
+        }
+        if (!query.isNull(2)) {
+            groups.back().deviceIds.push_back(query.text(2));
+        }
+    }
+    return groups;
+}
+
+bool Database::saveScene(const Scene& scene) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return transaction([&]() {
+        if (!Query(statements_[kUpsertScene]).bind(1, scene.sceneId).bind(2, scene.name).run() ||
+            !Query(statements_[kDeleteSceneTargets]).bind(1, scene.sceneId).run()) {
+            return false;
+        }
+        for (const auto& target : scene.targets) {
+            Query query(statements_[kInsertSceneTarget]);
+            query.bind(1, scene.sceneId).bind(2, target.deviceId).bind(3, target.isOn ? 1 : 0)
+                 .bind(4, target.brightness).bind(5, target.colorTemp).bind(6, target.hue)
+                 .bind(7, target.saturation);
+            if (!query.run()) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+bool Database::removeScene(const std::string& sceneId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return transaction([&]() {
+        return Query(statements_[kDeleteSceneTargets]).bind(1, sceneId).run() &&
+               Query(statements_[kDeleteScene]).bind(1, sceneId).run();
+    });
+}
+
+Scene Database::getScene(const std::string& sceneId) {
+    std::vector<Scene> scenes = getScenes(kSelectScene, sceneId);
+    return scenes.empty() ? Scene{} : scenes.front();
+}
+
+std::vector<Scene> Database::getAllScenes() {
+    return getScenes(kSelectAllScenes, "");
+}
+
+std::vector<Scene> Database::getScenes(Statement statement, const std::string& sceneId) {
+    std::vector<Scene> scenes;
+    std::lock_guard<std::mutex> lock(mutex_);
+    Query query(statements_[statement]);
+    if (statement == kSelectScene) {
+        query.bind(1, sceneId);
+    }
     
-    return executeQuery(query.str());
+    // Rows arrive grouped, one per target
+    while (query.step()) {
+        if (query.isNull(0)) {
+            continue;
+        }
+        std::string id = query.text(0);
+        if (scenes.empty() || scenes.back().sceneId != id) {
+            Scene scene;
+            scene.sceneId = id;
+            scene.name = query.text(1);
+            scenes.push_back(scene);
+        }
+        if (!query.isNull(2)) {
+            SceneTarget target;
+            target.deviceId = query.text(2);
+            target.isOn = query.integer(3, 0) != 0;
+            target.brightness = query.integer(4, -1);
+            target.colorTemp = query.integer(5, -1);
+            target.hue = query.integer(6, -1);
+            target.saturation = query.integer(7, -1);
+            scenes.back().targets.push_back(target);
+        }
+    }
+    return scenes;
 }
 
 bool Database::addDiscoveryRecord(const std::string& ip, const std::string& deviceId, 
                                  const std::string& model, bool success) {
-    std::stringstream query;
-    query << "INSERT INTO discovery_history (ip, device_id, model, success) "
-          << "VALUES ('" << ip << "', '" << deviceId << "', '" << model << "', "
-          << (success ? 1 : 0) << ")";
-    
-    return executeQuery(query.str());
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!writer_.joinable()) {
+        return false;
+    }
+    bool wasEmpty = pendingWrites() == 0;
+    pending_records_.push_back(DiscoveryRecord{ip, deviceId, model, success});
+    queued(wasEmpty);
+    return true;
 }
 
 std::vector<std::string> Database::getKnownIPs() {
     std::vector<std::string> ips;
-    
-    std::string query = "SELECT DISTINCT ip FROM devices";
-    
-    auto callback = [](void* data, int argc, char** argv, char** colNames) -> int {
-        std::vector<std::string>* ips = static_cast<std::vector<std::string>*>(data);
-        if (argc > 0 && argv[0]) {
-            ips->push_back(argv[0]);
+    {
+        std::shared_lock<std::shared_mutex> cache(cache_mutex_);
+        ips.reserve(cache_order_.size());
+        for (const auto& entry : cache_order_) {
+            ips.push_back(entry.second.ip);
         }
-        return 0;
-    };
-    
-    executeQueryWithResult(query, callback, &ips);
+    }
+    cache_scans_++;
+    std::sort(ips.begin(), ips.end());
+    ips.erase(std::unique(ips.begin(), ips.end()), ips.end());
     return ips;
 }
 
-int Database::getDeviceCount() {
-    int count = 0;
+bool Database::recordState(const DeviceInfo& device, int64_t timestampMs) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!writer_.joinable()) {
+        return false;
+    }
+    StateSample sample{timestampMs, device.isOnline, device.isOn, device.brightness,
+                       device.colorTemp, device.hue, device.saturation};
+    // Changes to fields the history doesn't keep would repeat the last row
+    auto last = last_recorded_.find(device.deviceId);
+    if (last != last_recorded_.end() && sameState(last->second, sample)) {
+        return true;
+    }
+    last_recorded_[device.deviceId] = sample;
     
-    std::string query = "SELECT COUNT(*) FROM devices";
+    bool wasEmpty = pendingWrites() == 0;
+    pending_history_.push_back(HistoryEntry{device.deviceId, sample});
+    queued(wasEmpty);
+    return true;
+}
+
+std::vector<StateSample> Database::getStateHistory(const std::string& deviceId, int64_t fromMs, int64_t toMs,
+                                                   size_t limit) {
+    flush();
+    std::vector<StateSample> samples;
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t key = historyKey(deviceId, false);
+    if (key < 0 || limit == 0) {
+        return samples;
+    }
+    Query before(statements_[kSelectHistoryBefore]);
+    before.bind(1, key).bind(2, fromMs);
+    if (before.step()) {
+        samples.push_back(readSample(before));
+    }
+    std::vector<StateSample> range = historyRange(key, fromMs, toMs, limit - samples.size());
+    samples.insert(samples.end(), range.begin(), range.end());
+    return samples;
+}
+
+std::vector<StateRollup> Database::getStateRollups(const std::string& deviceId, HistoryResolution resolution,
+                                                   int64_t fromMs, int64_t toMs) {
+    std::vector<StateRollup> rollups;
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t key = historyKey(deviceId, false);
+    if (key < 0) {
+        return rollups;
+    }
+    Query query(statements_[kSelectRollups]);
+    query.bind(1, key).bind(2, widthOf(resolution)).bind(3, fromMs).bind(4, toMs);
+    while (query.step()) {
+        StateRollup rollup;
+        rollup.bucketMs = query.integer64(0);
+        rollup.changes = query.integer(1, 0);
+        rollup.onMs = query.integer64(2);
+        rollup.onlineMs = query.integer64(3);
+        rollup.brightnessAvg = query.integer(4, 0);
+        rollup.brightnessMin = query.integer(5, 0);
+        rollup.brightnessMax = query.integer(6, 0);
+        rollup.isOnline = query.integer(7, 0) != 0;
+        rollup.isOn = query.integer(8, 0) != 0;
+        rollup.brightness = query.integer(9, 0);
+        rollups.push_back(rollup);
+    }
+    return rollups;
+}
+
+void Database::setCacheCheck(bool enabled) {
+    cache_check_ = enabled;
+}
+
+std::vector<std::string> Database::verifyCache() {
+    std::unique_lock<std::mutex> quiet = quiesce();
+    std::vector<DeviceInfo> stored;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stored = selectDevices(kSelectAllDevices, -1);
+    }
     
-    auto callback = [](void* data, int argc, char** argv, char** colNames) -> int {
-        int* count = static_cast<int*>(data);
-        if (argc > 0 && argv[0]) {
-            *count = std::stoi(argv[0]);
+    std::vector<std::string> differing;
+    std::unordered_set<std::string> inTable;
+    std::shared_lock<std::shared_mutex> cache(cache_mutex_);
+    for (const auto& device : stored) {
+        inTable.insert(device.deviceId);
+        auto it = cache_.find(device.deviceId);
+        if (it == cache_.end() || !sameDevice(it->second->second, device)) {
+            differing.push_back(device.deviceId);
         }
-        return 0;
-    };
-    
-    executeQueryWithResult(query, callback, &count);
-    return count;
+    }
+    for (const auto& entry : cache_) {
+        if (!inTable.count(entry.first)) {
+            differing.push_back(entry.first);
+        }
+    }
+    return differing;
 }
 
-int Database::getOnlineDeviceCount() {
-    int count = 0;
-    
-    std::string query = "SELECT COUNT(*) FROM devices WHERE is_online = 1";
+DatabaseCacheStats Database::getCacheStats() {
+    DatabaseCacheStats stats{0, cache_hits_, cache_misses_, cache_scans_, cache_checks_, cache_mismatches_};
+    std::shared_lock<std::shared_mutex> cache(cache_mutex_);
+    stats.devices = cache_.size();
+    return stats;
+}
+
+std::vector<DeviceInfo> Database::cachedDevices(int isOnline) {
+    std::unique_lock<std::mutex> quiet;
+    if (cache_check_) {
+        quiet = quiesce();
+    }
     
-    auto callback = [](void* data, int argc, char** argv, char** colNames) -> int {
-        int* count = static_cast<int*>(data);
-        if (argc > 0 && argv[0]) {
-            *count = std::stoi(argv[0]);
+    std::vector<DeviceInfo> devices;
+    {
+        std::shared_lock<std::shared_mutex> cache(cache_mutex_);
+        devices.reserve(cache_order_.size());
+        for (const auto& entry : cache_order_) {
+            if (isOnline < 0 || entry.second.isOnline == (isOnline != 0)) {
+                devices.push_back(entry.second);
+            }
         }
-        return 0;
-    };
+    }
+    cache_scans_++;
     
-    executeQueryWithResult(query, callback, &count);
-    return count;
+    if (quiet.owns_lock()) {
+        std::vector<DeviceInfo> stored;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stored = selectDevices(isOnline < 0 ? kSelectAllDevices : kSelectDevicesByStatus, isOnline);
+        }
+        // Devices with the same name may come back from SQLite in either order
+        std::sort(stored.begin(), stored.end(), byName);
+        cache_checks_++;
+        if (!std::equal(devices.begin(), devices.end(), stored.begin(), stored.end(), sameDevice)) {
+            cache_mismatches_++;
+            std::cerr << "Device cache differs from the table" << std::endl;
+        }
+    }
+    return devices;
 }
 
-int Database::getOfflineDeviceCount() {
-    int count = 0;
-    
-    std::string query = "SELECT COUNT(*) FROM devices WHERE is_online = 0";
-    
-    auto callback = [](void* data, int argc, char** argv, char** colNames) -> int {
-        int* count = static_cast<int*>(data);
-        if (argc > 0 && argv[0]) {
-            *count = std::stoi(argv[0]);
+void Database::cachePut(const DeviceInfo& device) {
+    auto it = cache_.find(device.deviceId);
+    if (it != cache_.end() && it->second->second.name == device.name) {
+        tally(it->second->second, -1);
+        it->second->second = device;
+        tally(device, 1);
+        return;
+    }
+    cacheErase(device.deviceId);
+    auto placed = cache_order_.emplace(std::make_pair(device.name, device.deviceId), device).first;
+    cache_.emplace(device.deviceId, placed);
+    tally(device, 1);
+}
+
+void Database::cacheErase(const std::string& deviceId) {
+    auto it = cache_.find(deviceId);
+    if (it == cache_.end()) {
+        return;
+    }
+    tally(it->second->second, -1);
+    cache_order_.erase(it->second);
+    cache_.erase(it);
+}
+
+void Database::tally(const DeviceInfo& device, int sign) {
+    cache_totals_.devices += sign;
+    if (device.isOnline) {
+        cache_totals_.online += sign;
+    }
+    if (device.isOn) {
+        cache_totals_.on += sign;
+        cache_totals_.brightnessOn += sign * device.brightness;
+    }
+    size_t& models = cache_totals_.models[device.model];
+    models += sign;
+    if (models == 0) {
+        cache_totals_.models.erase(device.model);
+    }
+}
+
+std::vector<DeviceInfo> Database::selectDevices(Statement statement, int isOnline) {
+    std::vector<DeviceInfo> devices;
+    Query query(statements_[statement]);
+    if (statement == kSelectDevicesByStatus) {
+        query.bind(1, isOnline);
+    }
+    while (query.step()) {
+        devices.push_back(readDevice(query));
+    }
+    return devices;
+}
+
+void Database::setHistoryRetention(const HistoryRetention& retention) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    retention_ = retention;
+}
+
+DeviceStatistics Database::getStatistics() {
+    DeviceStatistics stats{};
+    {
+        std::shared_lock<std::shared_mutex> cache(cache_mutex_);
+        const CacheTotals& totals = cache_totals_;
+        stats.total = totals.devices;
+        stats.online = totals.online;
+        stats.offline = totals.devices - totals.online;
+        stats.on = totals.on;
+        stats.off = totals.devices - totals.on;
+        stats.averageBrightness = totals.on > 0 ? static_cast<int>(totals.brightnessOn / totals.on) : 0;
+        stats.byModel.insert(totals.models.begin(), totals.models.end());
+        
+        if (cache_check_) {
+            CacheTotals counted{};
+            for (const auto& entry : cache_order_) {
+                const DeviceInfo& device = entry.second;
+                counted.devices++;
+                counted.online += device.isOnline ? 1 : 0;
+                counted.on += device.isOn ? 1 : 0;
+                counted.brightnessOn += device.isOn ? device.brightness : 0;
+                counted.models[device.model]++;
+            }
+            if (counted.devices != totals.devices || counted.online != totals.online || counted.on != totals.on ||
+                counted.brightnessOn != totals.brightnessOn || counted.models != totals.models) {
+                cache_mismatches_++;
+                std::cerr << "Device statistics differ from the cache" << std::endl;
+            }
         }
-        return 0;
-    };
-    
-    executeQueryWithResult(query, callback, &count);
-    return count;
+    }
+    return stats;
+}
+
+int Database::getDeviceCount() {
+    return static_cast<int>(getStatistics().total);
+}
+
+int Database::getOnlineDeviceCount() {
+    return static_cast<int>(getStatistics().online);
+}
+
+int Database::getOfflineDeviceCount() {
+    return static_cast<int>(getStatistics().offline);
 }
 
 bool Database::executeQuery(const std::string& query) {
@@ -316,25 +1044,317 @@ bool Database::executeQuery(const std::string& query) {
     return true;
 }
 
-bool Database::executeQueryWithResult(const std::string& query, 
-                                    std::function<int(void*, int, char**, char**)> callback,
-                                    void* data) {
-    if (!db_) {
+bool Database::prepareStatements() {
+    static_assert(sizeof(kStatementSql) / sizeof(kStatementSql[0]) == kStatementCount,
+                  "one SQL string per Statement");
+    
+    for (int i = 0; i < kStatementCount; i++) {
+        sqlite3_stmt* statement = nullptr;
+        // Persistent: these live as long as the connection
+        if (sqlite3_prepare_v3(static_cast<sqlite3*>(db_), kStatementSql[i], -1, SQLITE_PREPARE_PERSISTENT,
+                               &statement, nullptr) != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(static_cast<sqlite3*>(db_))
+                      << std::endl;
+            return false;
+        }
+        statements_[i] = statement;
+    }
+    return true;
+}
+
+bool Database::transaction(const std::function<bool()>& body) {
+    if (!Query(statements_[kBegin]).run()) {
         return false;
     }
-    
-    char* errMsg = 0;
-    int rc = sqlite3_exec(static_cast<sqlite3*>(db_), query.c_str(), 
-                         [](void* data, int argc, char** argv, char** colNames) -> int {
-                             auto* callback = static_cast<std::function<int(void*, int, char**, char**)>*>(data);
-                             return (*callback)(data, argc, argv, colNames);
-                         }, &callback, &errMsg);
-    
-    if (rc != SQLITE_OK) {
-        std::cerr << "SQL error: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
+    if (!body()) {
+        Query(statements_[kRollback]).run();
         return false;
     }
-    
+    return Query(statements_[kCommit]).run();
+}
+
+bool Database::queueUpdate(const std::string& deviceId, const PendingDevice& fields) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!writer_.joinable()) {
+        return false;
+    }
+    {
+        // Same rule as the UPDATE: a device that isn't stored is left alone
+        std::unique_lock<std::shared_mutex> cache(cache_mutex_);
+        auto it = cache_.find(deviceId);
+        if (it != cache_.end()) {
+            tally(it->second->second, -1);
+            applyFields(it->second->second, fields);
+            tally(it->second->second, 1);
+        }
+    }
+    bool wasEmpty = pendingWrites() == 0;
+    auto result = pending_devices_.emplace(deviceId, fields);
+    if (!result.second) {
+        PendingDevice& write = result.first->second;
+        if (write.kind == PendingDevice::Upsert) {
+            applyFields(write.device, fields);
+        } else if (write.kind == PendingDevice::Update) {
+            overlay(write.isOnline, fields.isOnline);
+            overlay(write.isOn, fields.isOn);
+            overlay(write.brightness, fields.brightness);
+            overlay(write.colorTemp, fields.colorTemp);
+            overlay(write.hue, fields.hue);
+            overlay(write.saturation, fields.saturation);
+        }
+        // An update after a queued remove would match no row, so it is dropped
+        stats_.coalesced++;
+    }
+    queued(wasEmpty);
     return true;
 }
+
+void Database::queued(bool wasEmpty) {
+    stats_.queued++;
+    if (wasEmpty) {
+        first_queued_at_ = std::chrono::steady_clock::now();
+        writer_wake_.notify_one();
+    } else if (pendingWrites() == kMaxBatchWrites) {
+        writer_wake_.notify_one();
+    }
+}
+
+void Database::applyFields(DeviceInfo& device, const PendingDevice& fields) {
+    if (fields.isOnline >= 0) {
+        device.isOnline = fields.isOnline != 0;
+    }
+    if (fields.isOn >= 0) {
+        device.isOn = fields.isOn != 0;
+    }
+    overlay(device.brightness, fields.brightness);
+    overlay(device.colorTemp, fields.colorTemp);
+    overlay(device.hue, fields.hue);
+    overlay(device.saturation, fields.saturation);
+}
+
+size_t Database::pendingWrites() const {
+    return pending_devices_.size() + pending_records_.size() + pending_history_.size();
+}
+
+void Database::runWriter() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (true) {
+        writer_wake_.wait_until(lock, next_maintenance_, [this]() { return stopping_ || pendingWrites() > 0; });
+        if (pendingWrites() > 0) {
+            // Let the batch fill, up to its size or age
+            writer_wake_.wait_until(lock, first_queued_at_ + std::chrono::milliseconds(kMaxBatchDelayMs), [this]() {
+                return stopping_ || flush_requested_ || pendingWrites() >= kMaxBatchWrites;
+            });
+            
+            std::unordered_map<std::string, PendingDevice> devices;
+            std::vector<DiscoveryRecord> records;
+            std::vector<HistoryEntry> history;
+            devices.swap(pending_devices_);
+            records.swap(pending_records_);
+            history.swap(pending_history_);
+            uint64_t through = stats_.queued;
+            flush_requested_ = false;
+            
+            lock.unlock();
+            bool committed = commit(devices, records, history);
+            lock.lock();
+            
+            size_t rows = devices.size() + records.size() + history.size();
+            if (committed) {
+                stats_.committed += rows;
+                stats_.batches++;
+            } else {
+                stats_.failed += rows;
+                std::cerr << "Dropped " << rows << " queued database writes" << std::endl;
+            }
+            committed_through_ = through;
+            flushed_.notify_all();
+        } else if (stopping_) {
+            return; // Everything is written
+        }
+        
+        if (std::chrono::steady_clock::now() >= next_maintenance_) {
+            HistoryRetention retention = retention_;
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> statements(mutex_);
+                maintain(retention, unixMs());
+            }
+            lock.lock();
+            next_maintenance_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(kMaintenanceIntervalMs);
+        }
+    }
+}
+
+bool Database::commit(const std::unordered_map<std::string, PendingDevice>& devices,
+                      const std::vector<DiscoveryRecord>& records, const std::vector<HistoryEntry>& history) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool committed = transaction([&]() {
+        for (const auto& entry : devices) {
+            const std::string& deviceId = entry.first;
+            const PendingDevice& write = entry.second;
+            if (write.kind == PendingDevice::Upsert) {
+                const DeviceInfo& device = write.device;
+                Query query(statements_[kUpsertDevice]);
+                query.bind(1, device.deviceId).bind(2, device.name).bind(3, device.ip).bind(4, device.port)
+                     .bind(5, device.model).bind(6, device.mac).bind(7, device.isOnline ? 1 : 0)
+                     .bind(8, device.isOn ? 1 : 0).bind(9, device.brightness).bind(10, device.colorTemp)
+                     .bind(11, device.hue).bind(12, device.saturation);
+                if (!query.run()) {
+                    return false;
+                }
+            } else if (write.kind == PendingDevice::Remove) {
+                if (!Query(statements_[kDeleteDevice]).bind(1, deviceId).run()) {
+                    return false;
+                }
+            } else {
+                Query query(statements_[kUpdateDeviceFields]);
+                query.bind(1, deviceId).bindSetting(2, write.isOnline).bindSetting(3, write.isOn)
+                     .bindSetting(4, write.brightness).bindSetting(5, write.colorTemp)
+                     .bindSetting(6, write.hue).bindSetting(7, write.saturation);
+                if (!query.run()) {
+                    return false;
+                }
+            }
+        }
+        for (const auto& record : records) {
+            Query query(statements_[kInsertDiscoveryRecord]);
+            query.bind(1, record.ip).bind(2, record.deviceId).bind(3, record.model).bind(4, record.success ? 1 : 0);
+            if (!query.run()) {
+                return false;
+            }
+        }
+        for (const auto& entry : history) {
+            int64_t key = historyKey(entry.deviceId, true);
+            if (key < 0) {
+                return false;
+            }
+            const StateSample& sample = entry.sample;
+            Query query(statements_[kInsertHistory]);
+            query.bind(1, key).bind(2, sample.timestampMs).bind(3, sample.isOnline ? 1 : 0)
+                 .bind(4, sample.isOn ? 1 : 0).bind(5, sample.brightness).bind(6, sample.colorTemp)
+                 .bind(7, sample.hue).bind(8, sample.saturation);
+            if (!query.run()) {
+                return false;
+            }
+        }
+        return true;
+    });
+    if (!committed) {
+        history_keys_.clear(); // Keys added by the rolled back transaction are gone
+    }
+    return committed;
+}
+
+int64_t Database::historyKey(const std::string& deviceId, bool create) {
+    auto it = history_keys_.find(deviceId);
+    if (it != history_keys_.end()) {
+        return it->second;
+    }
+    if (create && !Query(statements_[kInsertHistoryKey]).bind(1, deviceId).run()) {
+        return -1;
+    }
+    Query query(statements_[kSelectHistoryKey]);
+    query.bind(1, deviceId);
+    if (!query.step()) {
+        return -1;
+    }
+    int64_t key = query.integer64(0);
+    history_keys_.emplace(deviceId, key);
+    return key;
+}
+
+std::vector<StateSample> Database::historyRange(int64_t key, int64_t fromMs, int64_t toMs, size_t limit) {
+    std::vector<StateSample> samples;
+    Query query(statements_[kSelectHistoryRange]);
+    query.bind(1, key).bind(2, fromMs).bind(3, toMs).bind(4, static_cast<int64_t>(std::min<size_t>(limit, INT64_MAX)));
+    while (query.step()) {
+        samples.push_back(readSample(query));
+    }
+    return samples;
+}
+
+bool Database::rollUp(int64_t widthMs, int64_t nowMs, int64_t rawRetentionMs) {
+    // Whole buckets that closed since the last pass. The first pass starts
+    // as far back as raw history can go.
+    int64_t end = (nowMs - kRollupLagMs) / widthMs * widthMs;
+    int64_t start = end - rawRetentionMs / widthMs * widthMs;
+    {
+        Query progress(statements_[kSelectRollupProgress]);
+        progress.bind(1, widthMs);
+        if (progress.step()) {
+            start = progress.integer64(0);
+        }
+    }
+    if (start >= end) {
+        return true;
+    }
+    
+    std::vector<int64_t> keys;
+    {
+        Query query(statements_[kSelectHistoryKeys]);
+        while (query.step()) {
+            keys.push_back(query.integer64(0));
+        }
+    }
+    for (int64_t key : keys) {
+        std::vector<StateSample> samples = historyRange(key, start, end, SIZE_MAX);
+        if (samples.empty()) {
+            continue;
+        }
+        StateSample prior;
+        bool hasPrior = false;
+        {
+            Query before(statements_[kSelectHistoryBefore]);
+            before.bind(1, key).bind(2, start);
+            if (before.step()) {
+                prior = readSample(before);
+                hasPrior = true;
+            }
+        }
+        for (const auto& rollup : bucketSamples(hasPrior ? &prior : nullptr, samples, widthMs)) {
+            Query query(statements_[kUpsertRollup]);
+            query.bind(1, key).bind(2, widthMs).bind(3, rollup.bucketMs).bind(4, rollup.changes)
+                 .bind(5, rollup.onMs).bind(6, rollup.onlineMs).bind(7, rollup.brightnessAvg)
+                 .bind(8, rollup.brightnessMin).bind(9, rollup.brightnessMax).bind(10, rollup.isOnline ? 1 : 0)
+                 .bind(11, rollup.isOn ? 1 : 0).bind(12, rollup.brightness);
+            if (!query.run()) {
+                return false;
+            }
+        }
+    }
+    return Query(statements_[kUpsertRollupProgress]).bind(1, widthMs).bind(2, end).run();
+}
+
+bool Database::maintain(const HistoryRetention& retention, int64_t nowMs) {
+    bool done = transaction([&]() {
+        if (!rollUp(widthOf(HistoryResolution::Minute), nowMs, retention.rawMs) ||
+            !rollUp(widthOf(HistoryResolution::Hour), nowMs, retention.rawMs)) {
+            return false;
+        }
+        
+        std::vector<int64_t> keys;
+        {
+            Query query(statements_[kSelectHistoryKeys]);
+            while (query.step()) {
+                keys.push_back(query.integer64(0));
+            }
+        }
+        int64_t minuteWidth = widthOf(HistoryResolution::Minute);
+        int64_t hourWidth = widthOf(HistoryResolution::Hour);
+        for (int64_t key : keys) {
+            if (!Query(statements_[kDeleteHistoryBefore]).bind(1, key).bind(2, nowMs - retention.rawMs).run() ||
+                !Query(statements_[kDeleteRollupsBefore]).bind(1, key).bind(2, minuteWidth)
+                     .bind(3, nowMs - retention.minuteMs).run() ||
+                !Query(statements_[kDeleteRollupsBefore]).bind(1, key).bind(2, hourWidth)
+                     .bind(3, nowMs - retention.hourMs).run()) {
+                return false;
+            }
+        }
+        return Query(statements_[kDeleteDiscoveryRecordsBefore]).bind(1, nowMs - retention.rawMs).run();
+    });
+    if (!done) {
+        std::cerr << "State history maintenance failed" << std::endl;
+    }
+    return done;
+}
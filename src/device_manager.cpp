@@ -3,9 +3,17 @@
 #include <algorithm>
 #include <chrono>
 #include <thread>
+#include <condition_variable>
 
 DeviceManager::DeviceManager() 
-    : monitoring_active_(false), should_stop_(false) {
+    : executor_(std::make_shared<Executor>()), engine_(IOEngine::create(2)), discovery_window_ms_(UdpDiscovery::kDefaultWindowMs),
+      state_store_(std::make_shared<DeviceStateStore>()), event_bus_(std::make_shared<EventBus>()),
+      snapshot_(std::make_shared<DeviceSnapshot>()), snapshot_dirty_(std::make_shared<std::atomic<bool>>(false)),
+      monitoring_active_(false), should_stop_(false),
+      poll_completions_(std::make_shared<PollCompletions>()), poll_rng_(std::random_device()()),
+      poll_epoch_(std::chrono::steady_clock::now()), poll_rate_(kDefaultPollRate),
+      polls_in_flight_(0), polls_sent_(0) {
+    engine_->setExecutor(executor_);
 }
 
 DeviceManager::~DeviceManager() {
@@ -15,83 +23,184 @@ DeviceManager::~DeviceManager() {
 std::vector<DeviceInfo> DeviceManager::discoverDevices() {
     std::vector<DeviceInfo> discoveredDevices;
     
-    // For now, we'll implement a simple discovery by trying common IP ranges
-    // In a real implementation, you'd use UDP broadcast or mDNS
-    std::vector<std::string> commonIPs = {
-        "192.168.1.100", "192.168.1.101", "192.168.1.102", "192.168.1.103",
-        "192.168.0.100", "192.168.0.101", "192.168.0.102", "192.168.0.103",
-        "10.0.0.100", "10.0.0.101", "10.0.0.102", "10.0.0.103"
-    };
+    UdpDiscovery discovery;
+    discovery.setWindow(discovery_window_ms_);
+    for (const auto& target : discovery_targets_) {
+        discovery.addTarget(target);
+    }
+    std::vector<DiscoveryReply> replies = discovery.run();
     
-    for (const auto& ip : commonIPs) {
-        auto device = std::make_shared<TPLinkDevice>(ip);
-        if (device->discover()) {
-            DeviceInfo info = device->getDeviceInfo();
-            discoveredDevices.push_back(info);
-            
-            // Add to managed devices
-            std::lock_guard<std::mutex> lock(devices_mutex_);
-            devices_.push_back(device);
+    // Devices we already manage are reported from their cached state; only
+    // newly seen ones get a TCP sysinfo probe.
+    std::vector<DiscoveryReply> fresh;
+    for (const auto& reply : replies) {
+        auto known = registry_.findAny(reply.deviceId, reply.mac, reply.ip, reply.port);
+        if (known) {
+            discoveredDevices.push_back(known->getDeviceInfo());
+        } else {
+            fresh.push_back(reply);
         }
     }
     
+    // Probe new devices concurrently through the I/O engine
+    std::mutex resultMutex;
+    std::condition_variable resultCv;
+    size_t pending = fresh.size();
+    
+    for (const auto& reply : fresh) {
+        auto device = std::make_shared<TPLinkDevice>(reply.ip, reply.port, engine_);
+        device->discoverAsync([&, device](bool success) {
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if (success) {
+                discoveredDevices.push_back(device->getDeviceInfo());
+                
+                // Rejected if the TCP reply revealed an already managed device
+                manage(device);
+            }
+            pending--;
+            resultCv.notify_one();
+        }, TaskPriority::Background);
+    }
+    
+    std::unique_lock<std::mutex> lock(resultMutex);
+    resultCv.wait(lock, [&pending]() { return pending == 0; });
+    lock.unlock();
+    
+    publishSnapshot();
     return discoveredDevices;
 }
 
+bool DeviceManager::sweepDevices(const std::vector<std::string>& cidrs, std::function<bool(const DeviceInfo&)> onDevice,
+                                 size_t concurrency, int probeTimeoutMs) {
+    NetworkSweep sweep(engine_);
+    sweep.setConcurrency(concurrency);
+    sweep.setProbeTimeout(probeTimeoutMs);
+    for (const auto& cidr : cidrs) {
+        if (!sweep.addRange(cidr)) {
+            return false;
+        }
+    }
+    
+    // Known hosts are neither probed again nor reported
+    sweep.setSkip([this](const std::string& ip, int port) { return registry_.findByAddress(ip, port) != nullptr; });
+    sweep.run([this, &onDevice](std::shared_ptr<TPLinkDevice> device) {
+        // The short probe deadline only applies to the sweep itself
+        device->setTimeout(TPLinkDevice::kDefaultTimeoutMs);
+        if (!manage(device)) {
+            return true; // Already managed under another address
+        }
+        return onDevice ? onDevice(device->getDeviceInfo()) : true;
+    });
+    publishSnapshot();
+    return true;
+}
+
+void DeviceManager::setDiscoveryWindow(int windowMs) {
+    discovery_window_ms_ = windowMs;
+}
+
+void DeviceManager::addDiscoveryTarget(const std::string& address) {
+    discovery_targets_.push_back(address);
+}
+
 bool DeviceManager::addDevice(const std::string& ip, int port) {
-    auto device = std::make_shared<TPLinkDevice>(ip, port);
-    if (device->discover()) {
-        std::lock_guard<std::mutex> lock(devices_mutex_);
-        devices_.push_back(device);
+    if (registry_.findByAddress(ip, port)) {
+        return false;
+    }
+    
+    auto device = std::make_shared<TPLinkDevice>(ip, port, engine_);
+    if (device->discover() && manage(device)) {
+        publishSnapshot();
         return true;
     }
     return false;
 }
 
 bool DeviceManager::removeDevice(const std::string& deviceId) {
-    std::lock_guard<std::mutex> lock(devices_mutex_);
-    
-    auto it = std::find_if(devices_.begin(), devices_.end(),
-        [&deviceId](const std::shared_ptr<TPLinkDevice>& device) {
-            return device->getDeviceInfo().deviceId == deviceId;
-        });
-    
-    if (it != devices_.end()) {
-        devices_.erase(it);
-        return true;
+    auto device = registry_.find(deviceId);
+    if (!device || !registry_.erase(deviceId)) {
+        return false;
     }
-    return false;
+    device->setStateListener(nullptr);
+    state_store_->erase(deviceId);
+    {
+        std::lock_guard<std::mutex> lock(poll_mutex_);
+        poll_wheel_.cancel(deviceId);
+        poll_intervals_.erase(deviceId);
+    }
+    *snapshot_dirty_ = true;
+    publishSnapshot();
+    return true;
 }
 
 std::vector<DeviceInfo> DeviceManager::getAllDevices() {
-    std::lock_guard<std::mutex> lock(devices_mutex_);
-    std::vector<DeviceInfo> deviceInfos;
-    
-    for (const auto& device : devices_) {
-        deviceInfos.push_back(device->getDeviceInfo());
+    return state_store_->all();
+}
+
+std::shared_ptr<const DeviceSnapshot> DeviceManager::getSnapshot() {
+    return std::atomic_load_explicit(&snapshot_, std::memory_order_acquire);
+}
+
+bool DeviceManager::manage(const std::shared_ptr<TPLinkDevice>& device) {
+    // Devices are looked up by id everywhere, and reads are served from the
+    // state store, which is keyed by it
+    std::string deviceId = device->getDeviceInfo().deviceId;
+    if (deviceId.empty() || !registry_.insert(device)) {
+        return false;
     }
     
-    return deviceInfos;
+    // The flag, store and bus outlive the manager, since in-flight requests
+    // keep devices alive
+    std::shared_ptr<std::atomic<bool>> dirty = snapshot_dirty_;
+    std::shared_ptr<DeviceStateStore> store = state_store_;
+    std::shared_ptr<EventBus> bus = event_bus_;
+    uint32_t slot = store->insert(*device->getDeviceState());
+    device->setStateListener([dirty, store, bus, slot](const std::shared_ptr<const DeviceInfo>& before,
+                                                       const std::shared_ptr<const DeviceInfo>& after) {
+        store->update(slot, *after);
+        bus->publishChanges(before, after);
+        *dirty = true;
+    });
+    store->update(slot, *device->getDeviceState()); // In case it changed before the listener was set
+    *snapshot_dirty_ = true;
+    
+    // First polls are spread over a whole interval so a freshly discovered
+    // fleet doesn't come due all at once
+    {
+        std::lock_guard<std::mutex> lock(poll_mutex_);
+        poll_intervals_[deviceId] = kPollIntervalMs;
+        int delayMs = std::uniform_int_distribution<int>(kPollTickMs, kPollIntervalMs)(poll_rng_);
+        poll_wheel_.schedule(deviceId, pollTick() + delayMs / kPollTickMs);
+    }
+    return true;
 }
 
-std::shared_ptr<TPLinkDevice> DeviceManager::getDevice(const std::string& deviceId) {
-    std::lock_guard<std::mutex> lock(devices_mutex_);
-    
-    auto it = std::find_if(devices_.begin(), devices_.end(),
-        [&deviceId](const std::shared_ptr<TPLinkDevice>& device) {
-            return device->getDeviceInfo().deviceId == deviceId;
-        });
+void DeviceManager::publishSnapshot() {
+    std::lock_guard<std::mutex> lock(publish_mutex_);
+    if (!snapshot_dirty_->exchange(false)) {
+        return;
+    }
     
-    if (it != devices_.end()) {
-        return *it;
+    auto current = getSnapshot();
+    auto next = std::make_shared<DeviceSnapshot>();
+    next->version = current->version + 1;
+    for (const auto& device : registry_.all()) {
+        next->devices.push_back(device->getDeviceState());
     }
-    return nullptr;
+    std::atomic_store_explicit(&snapshot_, std::shared_ptr<const DeviceSnapshot>(std::move(next)),
+                               std::memory_order_release);
+}
+
+std::shared_ptr<TPLinkDevice> DeviceManager::getDevice(const std::string& deviceId) {
+    return registry_.find(deviceId);
 }
 
 bool DeviceManager::turnOnDevice(const std::string& deviceId) {
     auto device = getDevice(deviceId);
     if (device) {
-        return device->turnOn();
+        bool success = device->turnOn();
+        commandSent(deviceId);
+        return success;
     }
     return false;
 }
@@ -99,7 +208,9 @@ bool DeviceManager::turnOnDevice(const std::string& deviceId) {
 bool DeviceManager::turnOffDevice(const std::string& deviceId) {
     auto device = getDevice(deviceId);
     if (device) {
-        return device->turnOff();
+        bool success = device->turnOff();
+        commandSent(deviceId);
+        return success;
     }
     return false;
 }
@@ -107,7 +218,9 @@ bool DeviceManager::turnOffDevice(const std::string& deviceId) {
 bool DeviceManager::toggleDevice(const std::string& deviceId) {
     auto device = getDevice(deviceId);
     if (device) {
-        return device->toggle();
+        bool success = device->toggle();
+        commandSent(deviceId);
+        return success;
     }
     return false;
 }
@@ -115,7 +228,9 @@ bool DeviceManager::toggleDevice(const std::string& deviceId) {
 bool DeviceManager::setDeviceBrightness(const std::string& deviceId, int brightness) {
     auto device = getDevice(deviceId);
     if (device) {
-        return device->setBrightness(brightness);
+        bool success = device->setBrightness(brightness);
+        commandSent(deviceId);
+        return success;
     }
     return false;
 }
@@ -123,7 +238,9 @@ bool DeviceManager::setDeviceBrightness(const std::string& deviceId, int brightn
 bool DeviceManager::setDeviceColor(const std::string& deviceId, int hue, int saturation, int value) {
     auto device = getDevice(deviceId);
     if (device) {
-        return device->setColor(hue, saturation, value);
+        bool success = device->setColor(hue, saturation, value);
+        commandSent(deviceId);
+        return success;
     }
     return false;
 }
@@ -131,11 +248,109 @@ bool DeviceManager::setDeviceColor(const std::string& deviceId, int hue, int sat
 bool DeviceManager::setDeviceColorTemp(const std::string& deviceId, int temp) {
     auto device = getDevice(deviceId);
     if (device) {
-        return device->setColorTemp(temp);
+        bool success = device->setColorTemp(temp);
+        commandSent(deviceId);
+        return success;
     }
     return false;
 }
 
+BatchResult DeviceManager::applyBatch(const std::string& deviceId, const CommandBatch& batch) {
+    auto device = getDevice(deviceId);
+    if (device) {
+        BatchResult result = device->apply(batch);
+        commandSent(deviceId);
+        return result;
+    }
+    return BatchResult{false, {}};
+}
+
+std::vector<FanOutResult> DeviceManager::applyBatches(
+    const std::vector<std::pair<std::string, CommandBatch>>& batches, int deadlineMs) {
+    // Callbacks that arrive after the deadline find the fan-out closed and
+    // leave the results alone
+    struct Shared {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<FanOutResult> results;
+        size_t pending = 0;
+        bool closed = false;
+    };
+    auto shared = std::make_shared<Shared>();
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(deadlineMs);
+    
+    shared->results.resize(batches.size());
+    for (size_t i = 0; i < batches.size(); i++) {
+        FanOutResult& result = shared->results[i];
+        result.deviceId = batches[i].first;
+        result.success = false;
+        result.timedOut = true; // Until the answer arrives
+        result.latencyMs = 0;
+    }
+    
+    std::vector<std::shared_ptr<TPLinkDevice>> devices;
+    devices.reserve(batches.size());
+    for (size_t i = 0; i < batches.size(); i++) {
+        auto device = getDevice(batches[i].first);
+        devices.push_back(device);
+        if (!device) {
+            shared->results[i].timedOut = false;
+            shared->results[i].error = "Device not found";
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->pending++;
+        }
+        device->applyAsync(batches[i].second, [shared, start, i](BatchResult batchResult) {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (shared->closed) {
+                return;
+            }
+            FanOutResult& result = shared->results[i];
+            result.success = batchResult.success;
+            result.timedOut = false;
+            result.latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            result.results = std::move(batchResult.results);
+            if (--shared->pending == 0) {
+                shared->cv.notify_one();
+            }
+        }, std::max(deadlineMs, 1));
+    }
+    
+    std::vector<FanOutResult> results;
+    {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->cv.wait_until(lock, deadline, [&shared]() { return shared->pending == 0; });
+        shared->closed = true;
+        results.swap(shared->results);
+    }
+    
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!devices[i]) {
+            continue;
+        }
+        if (results[i].timedOut) {
+            results[i].latencyMs = deadlineMs;
+            results[i].error = "Deadline exceeded";
+        } else if (!results[i].success && results[i].results.empty() &&
+                   devices[i]->getBreakerStatus().state != BreakerState::Closed) {
+            results[i].error = "Circuit open";
+        }
+        {
+            std::lock_guard<std::mutex> lock(poll_mutex_);
+            auto it = poll_intervals_.find(results[i].deviceId);
+            if (it != poll_intervals_.end()) {
+                it->second = kMinPollIntervalMs;
+                schedulePoll(results[i].deviceId, kMinPollIntervalMs);
+            }
+        }
+    }
+    publishSnapshot();
+    return results;
+}
+
 void DeviceManager::startMonitoring() {
     if (monitoring_active_) {
         return;
@@ -151,7 +366,11 @@ void DeviceManager::stopMonitoring() {
         return;
     }
     
-    should_stop_ = true;
+    {
+        std::lock_guard<std::mutex> lock(monitor_mutex_);
+        should_stop_ = true;
+    }
+    monitor_cv_.notify_all();
     if (monitoring_thread_.joinable()) {
         monitoring_thread_.join();
     }
@@ -162,54 +381,193 @@ bool DeviceManager::isMonitoring() {
     return monitoring_active_;
 }
 
+void DeviceManager::setPollRate(double pollsPerSecond) {
+    poll_rate_ = pollsPerSecond > 0 ? pollsPerSecond : kDefaultPollRate;
+}
+
+MonitorStats DeviceManager::getMonitorStats() {
+    std::lock_guard<std::mutex> lock(poll_mutex_);
+    return MonitorStats{poll_wheel_.size(), poll_backlog_.size(), polls_in_flight_, polls_sent_, poll_rate_};
+}
+
 DeviceInfo DeviceManager::getDeviceInfo(const std::string& deviceId) {
+    DeviceInfo info{};
+    state_store_->get(deviceId, info);
+    return info;
+}
+
+std::vector<DeviceInfo> DeviceManager::getOnlineDevices() {
+    return state_store_->withStatus(true);
+}
+
+std::vector<DeviceInfo> DeviceManager::getOfflineDevices() {
+    return state_store_->withStatus(false);
+}
+
+BreakerStatus DeviceManager::getBreakerStatus(const std::string& deviceId) {
     auto device = getDevice(deviceId);
     if (device) {
-        return device->getDeviceInfo();
+        return device->getBreakerStatus();
     }
-    return DeviceInfo{};
+    return BreakerStatus{BreakerState::Closed, 0, 0, 0};
 }
 
-std::vector<DeviceInfo> DeviceManager::getOnlineDevices() {
-    std::lock_guard<std::mutex> lock(devices_mutex_);
-    std::vector<DeviceInfo> onlineDevices;
-    
-    for (const auto& device : devices_) {
-        if (device->isOnline()) {
-            onlineDevices.push_back(device->getDeviceInfo());
+BreakerStats DeviceManager::getBreakerStats() {
+    BreakerStats stats{0, 0, {}};
+    for (const auto& device : registry_.all()) {
+        BreakerStatus status = device->getBreakerStatus();
+        stats.rejected += status.rejected;
+        if (status.state != BreakerState::Closed) {
+            stats.open++;
+            stats.tripped.push_back(BreakerReport{device->getDeviceInfo().deviceId, status});
         }
     }
-    
-    return onlineDevices;
+    return stats;
 }
 
-std::vector<DeviceInfo> DeviceManager::getOfflineDevices() {
-    std::lock_guard<std::mutex> lock(devices_mutex_);
-    std::vector<DeviceInfo> offlineDevices;
+std::shared_ptr<EventBus> DeviceManager::getEventBus() {
+    return event_bus_;
+}
+
+DeviceCounts DeviceManager::getDeviceCounts() {
+    return state_store_->counts();
+}
+
+size_t DeviceManager::getStateStoreMemory() {
+    return state_store_->memoryUsage();
+}
+
+IOPoolStats DeviceManager::getConnectionStats() {
+    return engine_->poolStats();
+}
+
+ExecutorStats DeviceManager::getExecutorStats() {
+    return executor_->stats();
+}
+
+std::shared_ptr<Executor> DeviceManager::getExecutor() {
+    return executor_;
+}
+
+void DeviceManager::monitoringLoop() {
+    // Polls are released from the backlog by a token bucket refilled at the
+    // poll rate and capped at one second's worth, so load stays flat however
+    // deadlines cluster. Engine callbacks only queue completions; all
+    // rescheduling happens on this thread.
+    double tokens = 0;
+    auto lastRefill = std::chrono::steady_clock::now();
+    auto lastPublish = lastRefill;
+    std::vector<std::string> due;
+    std::vector<PollCompletion> done;
     
-    for (const auto& device : devices_) {
-        if (!device->isOnline()) {
-            offlineDevices.push_back(device->getDeviceInfo());
+    std::unique_lock<std::mutex> lock(monitor_mutex_);
+    while (!should_stop_) {
+        lock.unlock();
+        
+        auto now = std::chrono::steady_clock::now();
+        double rate = poll_rate_;
+        tokens += rate * std::chrono::duration<double>(now - lastRefill).count();
+        tokens = std::min(tokens, std::max(rate, 1.0));
+        lastRefill = now;
+        
+        {
+            std::lock_guard<std::mutex> completionLock(poll_completions_->mutex);
+            done.swap(poll_completions_->done);
+        }
+        for (const auto& completion : done) {
+            polls_in_flight_--;
+            auto device = registry_.find(completion.deviceId);
+            if (device) {
+                pollCompleted(completion.deviceId,
+                              completion.success && state_store_->version(completion.deviceId) != completion.version);
+            }
         }
+        done.clear();
+        
+        {
+            std::lock_guard<std::mutex> pollLock(poll_mutex_);
+            poll_wheel_.advance(pollTick(), due);
+            poll_backlog_.insert(poll_backlog_.end(), due.begin(), due.end());
+        }
+        due.clear();
+        
+        while (tokens >= 1 && polls_in_flight_ < kMonitorConcurrency && !should_stop_) {
+            std::string deviceId;
+            {
+                std::lock_guard<std::mutex> pollLock(poll_mutex_);
+                if (poll_backlog_.empty()) {
+                    break;
+                }
+                deviceId = std::move(poll_backlog_.front());
+                poll_backlog_.pop_front();
+            }
+            auto device = registry_.find(deviceId);
+            if (!device) {
+                continue; // Removed while waiting
+            }
+            // A poll would only be failed fast; come back when the breaker
+            // lets a probe through, without spending budget on it
+            BreakerStatus breaker = device->getBreakerStatus();
+            if (breaker.state == BreakerState::Open && breaker.retryAfterMs > 0) {
+                std::lock_guard<std::mutex> pollLock(poll_mutex_);
+                if (poll_intervals_.count(deviceId)) {
+                    poll_wheel_.schedule(deviceId, pollTick() + breaker.retryAfterMs / kPollTickMs + 1);
+                }
+                continue;
+            }
+            
+            tokens -= 1;
+            polls_in_flight_++;
+            polls_sent_++;
+            auto completions = poll_completions_;
+            uint64_t version = state_store_->version(deviceId);
+            device->discoverAsync([completions, deviceId, version](bool success) {
+                std::lock_guard<std::mutex> completionLock(completions->mutex);
+                completions->done.push_back(PollCompletion{deviceId, version, success});
+            }, TaskPriority::Background);
+        }
+        
+        if (now - lastPublish >= std::chrono::seconds(1)) {
+            publishSnapshot();
+            lastPublish = now;
+        }
+        
+        lock.lock();
+        monitor_cv_.wait_for(lock, std::chrono::milliseconds(kPollTickMs),
+                             [this]() { return should_stop_.load(); });
     }
-    
-    return offlineDevices;
 }
 
-void DeviceManager::monitoringLoop() {
-    while (!should_stop_) {
-        updateDeviceStatus();
-        std::this_thread::sleep_for(std::chrono::seconds(30)); // Check every 30 seconds
+void DeviceManager::pollCompleted(const std::string& deviceId, bool changed) {
+    std::lock_guard<std::mutex> lock(poll_mutex_);
+    auto it = poll_intervals_.find(deviceId);
+    if (it == poll_intervals_.end() || poll_wheel_.contains(deviceId)) {
+        return; // Removed, or a command already brought the next poll forward
     }
+    it->second = changed ? kMinPollIntervalMs : std::min(it->second * 2, kMaxPollIntervalMs);
+    schedulePoll(deviceId, it->second);
 }
 
-void DeviceManager::updateDeviceStatus() {
-    std::lock_guard<std::mutex> lock(devices_mutex_);
-    
-    for (auto& device : devices_) {
-        // Try to reconnect and update status
-        if (!device->isOnline()) {
-            device->discover();
+void DeviceManager::schedulePoll(const std::string& deviceId, int intervalMs) {
+    // +/-20% so devices that share an interval drift apart
+    int jitter = intervalMs / 5;
+    int delayMs = intervalMs + std::uniform_int_distribution<int>(-jitter, jitter)(poll_rng_);
+    poll_wheel_.schedule(deviceId, pollTick() + std::max(delayMs / kPollTickMs, 1));
+}
+
+void DeviceManager::commandSent(const std::string& deviceId) {
+    {
+        std::lock_guard<std::mutex> lock(poll_mutex_);
+        auto it = poll_intervals_.find(deviceId);
+        if (it != poll_intervals_.end()) {
+            it->second = kMinPollIntervalMs;
+            schedulePoll(deviceId, kMinPollIntervalMs);
         }
     }
+    publishSnapshot();
+}
+
+uint64_t DeviceManager::pollTick() const {
+    auto elapsed = std::chrono::steady_clock::now() - poll_epoch_;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / kPollTickMs;
 }
@@ -0,0 +1,139 @@
+#include "device_registry.h"
+#include <algorithm>
+#include <functional>
+
+std::shared_ptr<const DeviceRegistry::Entry> DeviceRegistry::Index::find(const std::string& key) const {
+    const Shard& shard = shardFor(key);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    return it != shard.entries.end() ? it->second : nullptr;
+}
+
+void DeviceRegistry::Index::insert(const std::string& key, const std::shared_ptr<const Entry>& entry) {
+    Shard& shard = shardFor(key);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.entries[key] = entry;
+}
+
+void DeviceRegistry::Index::erase(const std::string& key) {
+    Shard& shard = shardFor(key);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.entries.erase(key);
+}
+
+void DeviceRegistry::Index::collect(std::vector<std::shared_ptr<const Entry>>& out) const {
+    for (const auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (const auto& item : shard.entries) {
+            out.push_back(item.second);
+        }
+    }
+}
+
+DeviceRegistry::Shard& DeviceRegistry::Index::shardFor(const std::string& key) {
+    return shards_[std::hash<std::string>()(key) % kShardCount];
+}
+
+const DeviceRegistry::Shard& DeviceRegistry::Index::shardFor(const std::string& key) const {
+    return shards_[std::hash<std::string>()(key) % kShardCount];
+}
+
+DeviceRegistry::DeviceRegistry() : size_(0), next_sequence_(0) {
+}
+
+std::string DeviceRegistry::addressKey(const std::string& ip, int port) {
+    return ip + ":" + std::to_string(port);
+}
+
+bool DeviceRegistry::insert(const std::shared_ptr<TPLinkDevice>& device) {
+    DeviceInfo info = device->getDeviceInfo();
+    auto entry = std::make_shared<Entry>();
+    entry->device = device;
+    entry->deviceId = info.deviceId;
+    entry->mac = info.mac;
+    entry->address = addressKey(info.ip, info.port);
+
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if ((!entry->deviceId.empty() && byId_.find(entry->deviceId)) ||
+        (!entry->mac.empty() && byMac_.find(entry->mac)) || byAddress_.find(entry->address)) {
+        return false;
+    }
+
+    entry->sequence = next_sequence_++;
+    if (!entry->deviceId.empty()) {
+        byId_.insert(entry->deviceId, entry);
+    }
+    if (!entry->mac.empty()) {
+        byMac_.insert(entry->mac, entry);
+    }
+    byAddress_.insert(entry->address, entry);
+    size_++;
+    return true;
+}
+
+bool DeviceRegistry::erase(const std::string& deviceId) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto entry = byId_.find(deviceId);
+    if (!entry) {
+        return false;
+    }
+
+    byId_.erase(entry->deviceId);
+    if (!entry->mac.empty()) {
+        byMac_.erase(entry->mac);
+    }
+    byAddress_.erase(entry->address);
+    size_--;
+    return true;
+}
+
+std::shared_ptr<TPLinkDevice> DeviceRegistry::find(const std::string& deviceId) const {
+    auto entry = byId_.find(deviceId);
+    return entry ? entry->device : nullptr;
+}
+
+std::shared_ptr<TPLinkDevice> DeviceRegistry::findByMac(const std::string& mac) const {
+    auto entry = byMac_.find(mac);
+    return entry ? entry->device : nullptr;
+}
+
+std::shared_ptr<TPLinkDevice> DeviceRegistry::findByAddress(const std::string& ip, int port) const {
+    auto entry = byAddress_.find(addressKey(ip, port));
+    return entry ? entry->device : nullptr;
+}
+
+std::shared_ptr<TPLinkDevice> DeviceRegistry::findAny(const std::string& deviceId, const std::string& mac,
+                                                      const std::string& ip, int port) const {
+    std::shared_ptr<TPLinkDevice> device;
+    if (!deviceId.empty()) {
+        device = find(deviceId);
+    }
+    if (!device && !mac.empty()) {
+        device = findByMac(mac);
+    }
+    if (!device) {
+        device = findByAddress(ip, port);
+    }
+    return device;
+}
+
+std::vector<std::shared_ptr<TPLinkDevice>> DeviceRegistry::all() const {
+    std::vector<std::shared_ptr<const Entry>> entries;
+    entries.reserve(size_);
+    byAddress_.collect(entries);
+    std::sort(entries.begin(), entries.end(),
+              [](const std::shared_ptr<const Entry>& a, const std::shared_ptr<const Entry>& b) {
+                  return a->sequence < b->sequence;
+              });
+
+    std::vector<std::shared_ptr<TPLinkDevice>> devices;
+    devices.reserve(entries.size());
+    for (const auto& entry : entries) {
+        devices.push_back(entry->device);
+    }
+    return devices;
+}
+
+size_t DeviceRegistry::size() const {
+    return size_;
+}
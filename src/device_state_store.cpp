@@ -0,0 +1,433 @@
+#include "device_state_store.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <mutex>
+
+namespace {
+
+const char kHexDigits[] = "0123456789ABCDEF";
+
+uint32_t hashId(const std::string& deviceId) {
+    size_t hash = std::hash<std::string>()(deviceId);
+    return static_cast<uint32_t>(hash ^ (uint64_t(hash) >> 32));
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Kasa device ids are 40 upper-case hex digits; anything else is kept as text
+bool parseId(const std::string& deviceId, uint8_t* bytes) {
+    if (deviceId.size() != 40) {
+        return false;
+    }
+    for (size_t i = 0; i < 20; i++) {
+        int high = hexValue(deviceId[2 * i]);
+        int low = hexValue(deviceId[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        bytes[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return true;
+}
+
+std::string formatId(const uint8_t* bytes) {
+    std::string deviceId(40, '0');
+    for (size_t i = 0; i < 20; i++) {
+        deviceId[2 * i] = kHexDigits[bytes[i] >> 4];
+        deviceId[2 * i + 1] = kHexDigits[bytes[i] & 0xF];
+    }
+    return deviceId;
+}
+
+bool parseMac(const std::string& mac, uint32_t& prefix, uint32_t& suffix) {
+    unsigned int bytes[6];
+    char trailing;
+    if (std::sscanf(mac.c_str(), "%2x%*1[:-]%2x%*1[:-]%2x%*1[:-]%2x%*1[:-]%2x%*1[:-]%2x%c",
+                    &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5], &trailing) != 6) {
+        return false;
+    }
+    prefix = (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+    suffix = (bytes[3] << 16) | (bytes[4] << 8) | bytes[5];
+    return true;
+}
+
+std::string formatMac(uint32_t prefix, uint32_t suffix) {
+    char text[18];
+    std::snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X",
+                  (prefix >> 16) & 0xFF, (prefix >> 8) & 0xFF, prefix & 0xFF,
+                  (suffix >> 16) & 0xFF, (suffix >> 8) & 0xFF, suffix & 0xFF);
+    return text;
+}
+
+template <typename T>
+size_t capacityBytes(const std::vector<T>& values) {
+    return values.capacity() * sizeof(T);
+}
+
+size_t stringBytes(const std::string& value) {
+    // Heap storage only; short strings live inside the object
+    return value.capacity() > std::string().capacity() ? value.capacity() + 1 : 0;
+}
+
+template <typename T>
+T clampTo(int value) {
+    return static_cast<T>(std::min<int>(std::max(value, 0), std::numeric_limits<T>::max()));
+}
+
+}
+
+template <typename Key>
+uint16_t DeviceStateStore::InternTable<Key>::intern(const Key& value) {
+    auto it = indexes.find(value);
+    if (it != indexes.end()) {
+        return it->second;
+    }
+    uint16_t index = static_cast<uint16_t>(values.size());
+    values.push_back(value);
+    indexes.emplace(value, index);
+    return index;
+}
+
+DeviceStateStore::DeviceStateStore() : next_version_(1), stale_name_bytes_(0), count_(0) {
+}
+
+uint32_t DeviceStateStore::insert(const DeviceInfo& info) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    uint32_t hash = hashId(info.deviceId);
+    uint32_t slot = find(info.deviceId, hash);
+    if (slot != kNoSlot) {
+        write(slot, info);
+        return slot;
+    }
+
+    if (!free_slots_.empty()) {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(id_hashes_.size());
+        size_t count = slot + 1;
+        size_t words = (count + 63) / 64;
+        used_.resize(words, 0);
+        online_.resize(words, 0);
+        on_.resize(words, 0);
+        brightness_.resize(count);
+        color_temp_.resize(count);
+        hue_.resize(count);
+        saturation_.resize(count);
+        versions_.resize(count);
+        ids_.resize(count * kIdBytes);
+        id_hashes_.resize(count);
+        name_offsets_.resize(count);
+        name_lengths_.resize(count, 0);
+        ips_.resize(count);
+        ports_.resize(count);
+        models_.resize(count);
+        mac_prefixes_.resize(count);
+        mac_suffixes_.resize(count);
+    }
+
+    if (!parseId(info.deviceId, &ids_[slot * kIdBytes])) {
+        std::fill(ids_.begin() + slot * kIdBytes, ids_.begin() + (slot + 1) * kIdBytes, 0);
+        id_text_[slot] = info.deviceId;
+    }
+    id_hashes_[slot] = hash;
+    setBit(used_, slot, true);
+    count_++;
+    indexInsert(slot);
+    write(slot, info);
+    return slot;
+}
+
+void DeviceStateStore::update(uint32_t slot, const DeviceInfo& info) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (slot < id_hashes_.size() && bit(used_, slot) && sameId(slot, info.deviceId, hashId(info.deviceId))) {
+        write(slot, info);
+    }
+}
+
+bool DeviceStateStore::erase(const std::string& deviceId) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    uint32_t slot = find(deviceId, hashId(deviceId));
+    if (slot == kNoSlot) {
+        return false;
+    }
+    indexErase(slot);
+    setBit(used_, slot, false);
+    setBit(online_, slot, false);
+    setBit(on_, slot, false);
+    id_text_.erase(slot);
+    ip_text_.erase(slot);
+    stale_name_bytes_ += name_lengths_[slot];
+    name_lengths_[slot] = 0;
+    count_--;
+    free_slots_.push_back(slot);
+    return true;
+}
+
+bool DeviceStateStore::get(const std::string& deviceId, DeviceInfo& info) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    uint32_t slot = find(deviceId, hashId(deviceId));
+    if (slot == kNoSlot) {
+        return false;
+    }
+    read(slot, info);
+    return true;
+}
+
+std::vector<DeviceInfo> DeviceStateStore::all() const {
+    return list(false, false);
+}
+
+std::vector<DeviceInfo> DeviceStateStore::withStatus(bool online) const {
+    return list(online, !online);
+}
+
+uint64_t DeviceStateStore::version(const std::string& deviceId) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    uint32_t slot = find(deviceId, hashId(deviceId));
+    return slot == kNoSlot ? 0 : versions_[slot];
+}
+
+std::vector<DeviceInfo> DeviceStateStore::list(bool onlineOnly, bool offlineOnly) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<DeviceInfo> devices;
+    devices.reserve(onlineOnly ? popcount(online_) : count_);
+    for (size_t word = 0; word < used_.size(); word++) {
+        uint64_t bits = used_[word];
+        if (onlineOnly) {
+            bits &= online_[word];
+        } else if (offlineOnly) {
+            bits &= ~online_[word];
+        }
+        while (bits) {
+            uint32_t slot = static_cast<uint32_t>(word * 64 + __builtin_ctzll(bits));
+            bits &= bits - 1;
+            devices.emplace_back();
+            read(slot, devices.back());
+        }
+    }
+    return devices;
+}
+
+void DeviceStateStore::read(uint32_t slot, DeviceInfo& info) const {
+    info.deviceId = idOf(slot);
+    info.name = names_.substr(name_offsets_[slot], name_lengths_[slot]);
+    auto text = ip_text_.find(slot);
+    if (text != ip_text_.end()) {
+        info.ip = text->second;
+    } else {
+        struct in_addr addr;
+        addr.s_addr = htonl(ips_[slot]);
+        char buffer[INET_ADDRSTRLEN];
+        info.ip = inet_ntop(AF_INET, &addr, buffer, sizeof(buffer)) ? buffer : "";
+    }
+    info.port = ports_[slot];
+    info.model = model_table_.values[models_[slot]];
+    info.mac = mac_prefixes_[slot] == kNoMac
+        ? "" : formatMac(mac_prefix_table_.values[mac_prefixes_[slot]], mac_suffixes_[slot]);
+    info.isOnline = bit(online_, slot);
+    info.isOn = bit(on_, slot);
+    info.brightness = brightness_[slot];
+    info.colorTemp = color_temp_[slot];
+    info.hue = hue_[slot];
+    info.saturation = saturation_[slot];
+}
+
+DeviceCounts DeviceStateStore::counts() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    // Freed slots have both bits cleared, so whole words can be counted
+    return DeviceCounts{count_, popcount(online_), popcount(on_)};
+}
+
+size_t DeviceStateStore::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return count_;
+}
+
+size_t DeviceStateStore::memoryUsage() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    size_t bytes = capacityBytes(used_) + capacityBytes(online_) + capacityBytes(on_) +
+                   capacityBytes(brightness_) + capacityBytes(color_temp_) + capacityBytes(hue_) +
+                   capacityBytes(saturation_) + capacityBytes(versions_) + capacityBytes(ids_) + capacityBytes(id_hashes_) +
+                   capacityBytes(name_offsets_) + capacityBytes(name_lengths_) + capacityBytes(ips_) +
+                   capacityBytes(ports_) + capacityBytes(models_) + capacityBytes(mac_prefixes_) +
+                   capacityBytes(mac_suffixes_) + capacityBytes(index_) + capacityBytes(free_slots_) +
+                   names_.capacity() + capacityBytes(model_table_.values) +
+                   capacityBytes(mac_prefix_table_.values);
+    for (const auto& model : model_table_.values) {
+        bytes += stringBytes(model);
+    }
+    for (const auto* table : {&id_text_, &ip_text_}) {
+        bytes += table->bucket_count() * sizeof(void*);
+        for (const auto& entry : *table) {
+            bytes += sizeof(entry) + sizeof(void*) + stringBytes(entry.second);
+        }
+    }
+    return bytes;
+}
+
+uint32_t DeviceStateStore::find(const std::string& deviceId, uint32_t hash) const {
+    if (index_.empty()) {
+        return kNoSlot;
+    }
+    size_t mask = index_.size() - 1;
+    for (size_t i = hash & mask; index_[i] != kNoSlot; i = (i + 1) & mask) {
+        if (sameId(index_[i], deviceId, hash)) {
+            return index_[i];
+        }
+    }
+    return kNoSlot;
+}
+
+bool DeviceStateStore::sameId(uint32_t slot, const std::string& deviceId, uint32_t hash) const {
+    if (id_hashes_[slot] != hash) {
+        return false;
+    }
+    auto text = id_text_.find(slot);
+    if (text != id_text_.end()) {
+        return text->second == deviceId;
+    }
+    uint8_t bytes[kIdBytes];
+    return parseId(deviceId, bytes) && std::memcmp(bytes, &ids_[slot * kIdBytes], kIdBytes) == 0;
+}
+
+std::string DeviceStateStore::idOf(uint32_t slot) const {
+    auto text = id_text_.find(slot);
+    return text != id_text_.end() ? text->second : formatId(&ids_[slot * kIdBytes]);
+}
+
+void DeviceStateStore::indexInsert(uint32_t slot) {
+    if (count_ * 2 > index_.size()) {
+        // Keep the load at or below one half; rebuild from the used slots
+        index_.assign(std::max<size_t>(index_.size() * 2, 16), kNoSlot);
+        for (uint32_t used = 0; used < id_hashes_.size(); used++) {
+            if (used != slot && bit(used_, used)) {
+                indexInsert(used);
+            }
+        }
+    }
+    size_t mask = index_.size() - 1;
+    size_t i = id_hashes_[slot] & mask;
+    while (index_[i] != kNoSlot) {
+        i = (i + 1) & mask;
+    }
+    index_[i] = slot;
+}
+
+void DeviceStateStore::indexErase(uint32_t slot) {
+    size_t mask = index_.size() - 1;
+    size_t i = id_hashes_[slot] & mask;
+    while (index_[i] != slot) {
+        i = (i + 1) & mask;
+    }
+
+    // Backward shift: pull later entries of the probe run into the hole
+    // unless their home bucket lies cyclically after it
+    for (size_t j = (i + 1) & mask; index_[j] != kNoSlot; j = (j + 1) & mask) {
+        size_t home = id_hashes_[index_[j]] & mask;
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            index_[i] = index_[j];
+            i = j;
+        }
+    }
+    index_[i] = kNoSlot;
+}
+
+void DeviceStateStore::write(uint32_t slot, const DeviceInfo& info) {
+    setName(slot, info.name);
+
+    struct in_addr addr;
+    if (inet_pton(AF_INET, info.ip.c_str(), &addr) == 1) {
+        ips_[slot] = ntohl(addr.s_addr);
+        ip_text_.erase(slot);
+    } else {
+        ips_[slot] = 0;
+        ip_text_[slot] = info.ip;
+    }
+    ports_[slot] = clampTo<uint16_t>(info.port);
+    models_[slot] = model_table_.intern(info.model);
+
+    uint32_t prefix = 0;
+    uint32_t suffix = 0;
+    if (parseMac(info.mac, prefix, suffix)) {
+        mac_prefixes_[slot] = mac_prefix_table_.intern(prefix);
+        mac_suffixes_[slot] = suffix;
+    } else {
+        mac_prefixes_[slot] = kNoMac;
+        mac_suffixes_[slot] = 0;
+    }
+
+    setBit(online_, slot, info.isOnline);
+    setBit(on_, slot, info.isOn);
+    brightness_[slot] = clampTo<uint8_t>(info.brightness);
+    color_temp_[slot] = clampTo<uint16_t>(info.colorTemp);
+    hue_[slot] = clampTo<uint16_t>(info.hue);
+    saturation_[slot] = clampTo<uint8_t>(info.saturation);
+    versions_[slot] = next_version_++;
+}
+
+void DeviceStateStore::setName(uint32_t slot, const std::string& name) {
+    size_t length = std::min<size_t>(name.size(), UINT16_MAX);
+    if (name_lengths_[slot] == length && names_.compare(name_offsets_[slot], length, name, 0, length) == 0) {
+        return;
+    }
+    stale_name_bytes_ += name_lengths_[slot];
+    name_offsets_[slot] = static_cast<uint32_t>(names_.size());
+    name_lengths_[slot] = static_cast<uint16_t>(length);
+    names_.append(name, 0, length);
+
+    if (stale_name_bytes_ > 4096 && stale_name_bytes_ * 2 > names_.size()) {
+        compactNames();
+    }
+}
+
+void DeviceStateStore::compactNames() {
+    std::string compacted;
+    compacted.reserve(names_.size() - stale_name_bytes_);
+    for (uint32_t slot = 0; slot < name_offsets_.size(); slot++) {
+        if (bit(used_, slot)) {
+            uint32_t offset = static_cast<uint32_t>(compacted.size());
+            compacted.append(names_, name_offsets_[slot], name_lengths_[slot]);
+            name_offsets_[slot] = offset;
+        }
+    }
+    names_.swap(compacted);
+    stale_name_bytes_ = 0;
+}
+
+void DeviceStateStore::setBit(std::vector<uint64_t>& bits, uint32_t slot, bool value) {
+    uint64_t mask = uint64_t(1) << (slot % 64);
+    if (value) {
+        bits[slot / 64] |= mask;
+    } else {
+        bits[slot / 64] &= ~mask;
+    }
+}
+
+bool DeviceStateStore::bit(const std::vector<uint64_t>& bits, uint32_t slot) {
+    return (bits[slot / 64] >> (slot % 64)) & 1;
+}
+
+size_t DeviceStateStore::popcount(const std::vector<uint64_t>& bits) {
+    // Becomes POPCNT/VPOPCNTQ on x86 and NEON CNT on ARM under the build
+    // scripts' -march=native; the loop has no dependencies to stop it
+    // from being vectorized
+    size_t count = 0;
+    for (uint64_t word : bits) {
+        count += static_cast<size_t>(__builtin_popcountll(word));
+    }
+    return count;
+}
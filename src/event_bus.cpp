@@ -0,0 +1,193 @@
+#include "event_bus.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+EventBus::EventBus()
+    : head_(&stub_), tail_(&stub_), sleeping_(false), stopping_(false),
+      subscribers_(std::make_shared<Subscribers>()), next_subscriber_(1),
+      published_(0), delivered_(0), next_sequence_(1) {
+    stub_.next = nullptr;
+    for (auto& count : by_type_) {
+        count = 0;
+    }
+    dispatcher_ = std::thread(&EventBus::run, this);
+}
+
+EventBus::~EventBus() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (dispatcher_.joinable()) {
+        dispatcher_.join();
+    }
+}
+
+void EventBus::publish(DeviceEventType type, std::shared_ptr<const DeviceInfo> state) {
+    Node* node = new Node();
+    node->event.sequence = 0;
+    node->event.type = type;
+    node->event.deviceId = state ? state->deviceId : "";
+    node->event.timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    node->event.state = std::move(state);
+    published_++;
+    push(node);
+
+    // Pairs with the sleeping_ store in run(): either this sees the
+    // dispatcher asleep or the dispatcher sees the node
+    if (sleeping_) {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        wake_.notify_one();
+    }
+}
+
+void EventBus::publishChanges(const std::shared_ptr<const DeviceInfo>& before,
+                              const std::shared_ptr<const DeviceInfo>& after) {
+    if (!after || after->deviceId.empty()) {
+        return;
+    }
+    const DeviceInfo* old = before.get();
+    if (!old || old->isOnline != after->isOnline) {
+        publish(after->isOnline ? DeviceEventType::Online : DeviceEventType::Offline, after);
+    }
+    if (!old || old->isOn != after->isOn) {
+        publish(DeviceEventType::Power, after);
+    }
+    if (!old || old->brightness != after->brightness) {
+        publish(DeviceEventType::Brightness, after);
+    }
+    if (!old || old->hue != after->hue || old->saturation != after->saturation) {
+        publish(DeviceEventType::Color, after);
+    }
+    if (!old || old->colorTemp != after->colorTemp) {
+        publish(DeviceEventType::ColorTemp, after);
+    }
+}
+
+uint64_t EventBus::subscribe(Handler handler) {
+    std::lock_guard<std::mutex> lock(subscribe_mutex_);
+    auto next = std::make_shared<Subscribers>(*std::atomic_load(&subscribers_));
+    uint64_t id = next_subscriber_++;
+    next->push_back(Subscriber{id, std::move(handler)});
+    std::atomic_store(&subscribers_, std::shared_ptr<const Subscribers>(std::move(next)));
+    return id;
+}
+
+bool EventBus::unsubscribe(uint64_t id) {
+    std::lock_guard<std::mutex> lock(subscribe_mutex_);
+    auto next = std::make_shared<Subscribers>(*std::atomic_load(&subscribers_));
+    size_t before = next->size();
+    next->erase(std::remove_if(next->begin(), next->end(),
+                               [id](const Subscriber& s) { return s.id == id; }), next->end());
+    if (next->size() == before) {
+        return false;
+    }
+    std::atomic_store(&subscribers_, std::shared_ptr<const Subscribers>(std::move(next)));
+    return true;
+}
+
+EventBusStats EventBus::stats() const {
+    EventBusStats stats{published_, delivered_, std::atomic_load(&subscribers_)->size(), {}};
+    for (size_t i = 0; i < kDeviceEventTypeCount; i++) {
+        stats.byType[i] = by_type_[i];
+    }
+    return stats;
+}
+
+const char* EventBus::typeName(DeviceEventType type) {
+    switch (type) {
+        case DeviceEventType::Online: return "online";
+        case DeviceEventType::Offline: return "offline";
+        case DeviceEventType::Power: return "power";
+        case DeviceEventType::Brightness: return "brightness";
+        case DeviceEventType::Color: return "color";
+        case DeviceEventType::ColorTemp: return "colorTemp";
+    }
+    return "unknown";
+}
+
+void EventBus::push(Node* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = head_.exchange(node);
+    // Between the exchange and this store the queue is briefly unlinked;
+    // pop() treats that as empty and the dispatcher comes back for it
+    prev->next.store(node, std::memory_order_release);
+}
+
+EventBus::Node* EventBus::pop() {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+        if (!next) {
+            return nullptr;
+        }
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+    if (tail != head_.load()) {
+        return nullptr;
+    }
+    // tail is the last node; put the stub behind it so it can be detached
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+bool EventBus::pending() const {
+    return tail_ != &stub_ || stub_.next.load(std::memory_order_acquire) != nullptr || head_.load() != &stub_;
+}
+
+void EventBus::run() {
+    std::vector<DeviceEvent> batch;
+    batch.reserve(kMaxBatch);
+    while (true) {
+        while (batch.size() < kMaxBatch) {
+            Node* node = pop();
+            if (!node) {
+                break;
+            }
+            node->event.sequence = next_sequence_++;
+            by_type_[static_cast<size_t>(node->event.type)]++;
+            batch.push_back(std::move(node->event));
+            delete node;
+        }
+
+        if (!batch.empty()) {
+            auto subscribers = std::atomic_load(&subscribers_);
+            for (const auto& subscriber : *subscribers) {
+                try {
+                    subscriber.handler(batch);
+                } catch (const std::exception& e) {
+                    std::cerr << "Event subscriber failed: " << e.what() << std::endl;
+                }
+            }
+            delivered_ += batch.size();
+            batch.clear();
+            continue;
+        }
+
+        // A push caught half done shows as pending, so this spins until the
+        // producer links its node instead of sleeping past it
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleeping_ = true;
+        if (!pending()) {
+            if (stopping_) {
+                return;
+            }
+            wake_.wait(lock);
+        }
+        sleeping_ = false;
+    }
+}
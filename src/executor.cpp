@@ -0,0 +1,120 @@
+#include "executor.h"
+
+namespace {
+
+// Worker identity of the current thread, so nested submits stay local
+thread_local const Executor* t_executor = nullptr;
+thread_local size_t t_worker = 0;
+
+}
+
+Executor::Executor(size_t workers)
+    : sleepers_(0), stopping_(false), next_worker_(0), executed_(0), steals_(0) {
+    if (workers == 0) {
+        workers = std::thread::hardware_concurrency();
+    }
+    if (workers == 0) {
+        workers = 1;
+    }
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        queued_[lane] = 0;
+    }
+
+    for (size_t i = 0; i < workers; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        threads_.emplace_back([this, i]() { run(i); });
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+void Executor::submit(std::function<void()> task, TaskPriority priority) {
+    size_t lane = static_cast<size_t>(priority);
+    size_t index = t_executor == this ? t_worker : next_worker_++ % workers_.size();
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->lanes[lane].push_back(std::move(task));
+    }
+
+    // Pairs with the sleepers_ increment in run(): either this sees the
+    // sleeper or the sleeper sees the task
+    queued_[lane]++;
+    if (sleepers_ > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        wake_.notify_one();
+    }
+}
+
+ExecutorStats Executor::stats() const {
+    return ExecutorStats{workers_.size(), queued_[0], queued_[1], executed_, steals_};
+}
+
+bool Executor::onWorkerThread() {
+    return t_executor != nullptr;
+}
+
+void Executor::run(size_t index) {
+    t_executor = this;
+    t_worker = index;
+
+    std::function<void()> task;
+    while (true) {
+        if (take(index, task)) {
+            task();
+            task = nullptr;
+            executed_++;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleepers_++;
+        wake_.wait(lock, [this]() { return stopping_ || queued_[0] > 0 || queued_[1] > 0; });
+        sleepers_--;
+        if (stopping_ && queued_[0] == 0 && queued_[1] == 0) {
+            return;
+        }
+    }
+}
+
+bool Executor::take(size_t index, std::function<void()>& task) {
+    size_t count = workers_.size();
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        if (queued_[lane] == 0) {
+            continue;
+        }
+
+        // Own queue first, oldest task; then siblings, newest task
+        for (size_t offset = 0; offset < count; ++offset) {
+            Worker& worker = *workers_[(index + offset) % count];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            auto& queue = worker.lanes[lane];
+            if (queue.empty()) {
+                continue;
+            }
+            if (offset == 0) {
+                task = std::move(queue.front());
+                queue.pop_front();
+            } else {
+                task = std::move(queue.back());
+                queue.pop_back();
+                steals_++;
+            }
+            queued_[lane]--;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,760 @@
+#include "io_engine.h"
+#include "kasa_frame.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int kMaxEvents = 256;
+
+// Engine whose loop the current thread runs, if any
+thread_local const IOEngine* t_engine = nullptr;
+
+std::string connectionKey(const std::string& ip, int port) {
+    return ip + ":" + std::to_string(port);
+}
+
+}
+
+// A submitted request waiting for, or occupying, a device connection
+struct IOEngine::Pending {
+    IORequest request;
+    Clock::time_point deadline;
+    bool retried;
+};
+
+struct IOEngine::Connection {
+    enum class State { Connecting, Idle, Writing, Reading };
+    int fd;
+    std::string key;
+    State state;
+    bool reused;          // Current request runs on a socket that served an earlier one
+    bool closeWhenDone;   // Released while busy; close instead of returning to the pool
+    uint64_t seq;         // Identifies the current request in the deadline heap
+
+    bool hasCurrent;
+    Pending current;
+    std::deque<Pending> queue;
+
+    FrameWriter writer;
+    FrameReader reader;
+
+    Clock::time_point lastUsed;
+    bool idleListed;
+    std::list<Connection*>::iterator idleIt;
+};
+
+struct IOEngine::Loop {
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::thread thread;
+
+    std::mutex incomingMutex;
+    std::vector<IORequest> incoming;
+    std::vector<std::string> releases;
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    std::unordered_map<std::string, Connection*> byKey;
+    std::list<Connection*> idle; // Least recently used at the front
+
+    // Min-heap of (deadline, request seq, fd); stale entries are skipped lazily
+    using Deadline = std::tuple<Clock::time_point, uint64_t, int>;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines;
+    uint64_t nextSeq = 1;
+};
+
+IOEngine::IOEngine(size_t threads)
+    : running_(true), in_flight_(0), max_connections_(1024), idle_timeout_ms_(60000),
+      max_frame_size_(FrameReader::kDefaultMaxFrameSize),
+      hits_(0), misses_(0), evictions_(0), idle_closes_(0), stale_closes_(0), reconnects_(0),
+      open_connections_(0), idle_connections_(0) {
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        auto loop = std::make_unique<Loop>();
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = loop->wakeFd;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &ev);
+
+        loops_.push_back(std::move(loop));
+    }
+
+    for (auto& loop : loops_) {
+        Loop* raw = loop.get();
+        raw->thread = std::thread([this, raw]() {
+            t_engine = this;
+            runLoop(*raw);
+        });
+    }
+}
+
+IOEngine::~IOEngine() {
+    stop();
+
+    for (auto& loop : loops_) {
+        if (loop->wakeFd >= 0) {
+            close(loop->wakeFd);
+        }
+        if (loop->epollFd >= 0) {
+            close(loop->epollFd);
+        }
+    }
+}
+
+std::shared_ptr<IOEngine> IOEngine::create(size_t threads) {
+    return std::shared_ptr<IOEngine>(new IOEngine(threads), [](IOEngine* engine) {
+        if (engine->onLoopThread()) {
+            std::thread([engine]() { delete engine; }).detach();
+        } else {
+            delete engine;
+        }
+    });
+}
+
+void IOEngine::stop() {
+    if (running_.exchange(false)) {
+        // enqueue() checks running_ under this lock, so once each loop's
+        // lock has been taken nothing more reaches incoming for the drain below
+        for (auto& loop : loops_) {
+            std::lock_guard<std::mutex> lock(loop->incomingMutex);
+        }
+
+        for (auto& loop : loops_) {
+            uint64_t one = 1;
+            (void)write(loop->wakeFd, &one, sizeof(one));
+        }
+    }
+
+    // The loops exit on their own; whoever destroys the engine joins them
+    if (onLoopThread()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    for (auto& loop : loops_) {
+        if (loop->thread.joinable()) {
+            loop->thread.join();
+        }
+    }
+
+    // Fail whatever was still queued or in flight
+    for (auto& loop : loops_) {
+        drainIncoming(*loop);
+        while (!loop->connections.empty()) {
+            Connection& conn = *loop->connections.begin()->second;
+            std::deque<Pending> queue;
+            queue.swap(conn.queue);
+            if (conn.hasCurrent) {
+                conn.hasCurrent = false;
+                queue.push_front(std::move(conn.current));
+            }
+            closeConnection(*loop, conn);
+            for (auto& pending : queue) {
+                fail(pending, "engine stopped");
+            }
+        }
+    }
+}
+
+bool IOEngine::isRunning() {
+    return running_;
+}
+
+void IOEngine::submit(IORequest request) {
+    if (!executor_.expired() && request.callback) {
+        std::weak_ptr<Executor> weakExecutor = executor_;
+        auto priority = request.priority;
+        IOCallback callback = std::move(request.callback);
+        request.callback = [weakExecutor, priority, callback](IOResult result) {
+            if (auto executor = weakExecutor.lock()) {
+                executor->submit([callback, result]() mutable { callback(std::move(result)); }, priority);
+            } else {
+                callback(std::move(result));
+            }
+        };
+    }
+    enqueue(std::move(request));
+}
+
+void IOEngine::enqueue(IORequest request) {
+    Loop& loop = loopFor(request.ip, request.port);
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(loop.incomingMutex);
+        if (running_) {
+            in_flight_++;
+            loop.incoming.push_back(std::move(request));
+            queued = true;
+        }
+    }
+    if (!queued) {
+        if (request.callback) {
+            request.callback(IOResult{false, "", "engine stopped"});
+        }
+        return;
+    }
+
+    uint64_t one = 1;
+    (void)write(loop.wakeFd, &one, sizeof(one));
+}
+
+IOResult IOEngine::execute(IORequest request) {
+    auto promise = std::make_shared<std::promise<IOResult>>();
+    auto future = promise->get_future();
+
+    request.callback = [promise](IOResult result) {
+        promise->set_value(std::move(result));
+    };
+    enqueue(std::move(request));
+
+    return future.get();
+}
+
+void IOEngine::release(const std::string& ip, int port) {
+    if (!running_) {
+        return;
+    }
+
+    Loop& loop = loopFor(ip, port);
+    {
+        std::lock_guard<std::mutex> lock(loop.incomingMutex);
+        loop.releases.push_back(connectionKey(ip, port));
+    }
+
+    uint64_t one = 1;
+    (void)write(loop.wakeFd, &one, sizeof(one));
+}
+
+void IOEngine::setConnectionBudget(size_t maxConnections) {
+    max_connections_ = maxConnections > 0 ? maxConnections : 1;
+}
+
+void IOEngine::setExecutor(std::shared_ptr<Executor> executor) {
+    executor_ = std::move(executor);
+}
+
+void IOEngine::setIdleTimeout(int idleTimeoutMs) {
+    idle_timeout_ms_ = idleTimeoutMs;
+}
+
+void IOEngine::setMaxFrameSize(size_t maxFrameSize) {
+    max_frame_size_ = maxFrameSize;
+}
+
+size_t IOEngine::inFlight() {
+    return in_flight_;
+}
+
+size_t IOEngine::threadCount() {
+    return loops_.size();
+}
+
+IOPoolStats IOEngine::poolStats() {
+    IOPoolStats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    stats.idleCloses = idle_closes_;
+    stats.staleCloses = stale_closes_;
+    stats.reconnects = reconnects_;
+    stats.openConnections = open_connections_;
+    stats.idleConnections = idle_connections_;
+    return stats;
+}
+
+std::shared_ptr<IOEngine> IOEngine::shared() {
+    static std::shared_ptr<IOEngine> engine = create();
+    return engine;
+}
+
+bool IOEngine::onLoopThread() const {
+    return t_engine == this;
+}
+
+IOEngine::Loop& IOEngine::loopFor(const std::string& ip, int port) {
+    // Pin each device to one loop so its pooled socket lives on a single thread
+    size_t hash = std::hash<std::string>()(ip) ^ static_cast<size_t>(port);
+    return *loops_[hash % loops_.size()];
+}
+
+void IOEngine::runLoop(Loop& loop) {
+    epoll_event events[kMaxEvents];
+
+    while (running_) {
+        int count = epoll_wait(loop.epollFd, events, kMaxEvents, nextTimeout(loop));
+        if (count < 0 && errno != EINTR) {
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == loop.wakeFd) {
+                uint64_t value;
+                while (read(loop.wakeFd, &value, sizeof(value)) > 0) {
+                }
+                drainIncoming(loop);
+                continue;
+            }
+
+            auto it = loop.connections.find(fd);
+            if (it != loop.connections.end()) {
+                handleEvent(loop, *it->second, events[i].events);
+            }
+        }
+
+        expireTimers(loop);
+    }
+}
+
+int IOEngine::nextTimeout(Loop& loop) {
+    auto now = Clock::now();
+    Clock::time_point next = Clock::time_point::max();
+
+    while (!loop.deadlines.empty()) {
+        const auto& top = loop.deadlines.top();
+        auto it = loop.connections.find(std::get<2>(top));
+        if (it == loop.connections.end() || !it->second->hasCurrent ||
+            it->second->seq != std::get<1>(top)) {
+            loop.deadlines.pop();
+            continue;
+        }
+        next = std::get<0>(top);
+        break;
+    }
+
+    if (!loop.idle.empty()) {
+        auto idleExpiry = loop.idle.front()->lastUsed + std::chrono::milliseconds(idle_timeout_ms_.load());
+        next = std::min(next, idleExpiry);
+    }
+
+    if (next == Clock::time_point::max()) {
+        return -1;
+    }
+
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count();
+    return remaining > 0 ? static_cast<int>(remaining) + 1 : 0;
+}
+
+void IOEngine::drainIncoming(Loop& loop) {
+    std::vector<IORequest> batch;
+    std::vector<std::string> releases;
+    {
+        std::lock_guard<std::mutex> lock(loop.incomingMutex);
+        batch.swap(loop.incoming);
+        releases.swap(loop.releases);
+    }
+
+    for (const auto& key : releases) {
+        auto it = loop.byKey.find(key);
+        if (it == loop.byKey.end()) {
+            continue;
+        }
+        if (it->second->state == Connection::State::Idle) {
+            closeConnection(loop, *it->second);
+        } else {
+            it->second->closeWhenDone = true;
+        }
+    }
+
+    auto now = Clock::now();
+    for (auto& request : batch) {
+        Pending pending;
+        pending.deadline = now + std::chrono::milliseconds(request.timeoutMs);
+        pending.retried = false;
+        pending.request = std::move(request);
+
+        if (!running_) {
+            fail(pending, "engine stopped");
+            continue;
+        }
+        dispatch(loop, std::move(pending));
+    }
+}
+
+void IOEngine::dispatch(Loop& loop, Pending pending) {
+    if (pending.deadline <= Clock::now()) {
+        fail(pending, "timed out");
+        return;
+    }
+
+    auto it = loop.byKey.find(connectionKey(pending.request.ip, pending.request.port));
+    if (it == loop.byKey.end()) {
+        openConnection(loop, std::move(pending));
+        return;
+    }
+
+    Connection& conn = *it->second;
+    if (conn.state != Connection::State::Idle) {
+        // One exchange per device at a time; the rest wait on the same socket
+        conn.queue.push_back(std::move(pending));
+        return;
+    }
+
+    // A peer that half-closed while we were idle shows up as EOF on a peek
+    char probe;
+    ssize_t n = recv(conn.fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        stale_closes_++;
+        closeConnection(loop, conn);
+        openConnection(loop, std::move(pending));
+        return;
+    }
+
+    hits_++;
+    beginRequest(loop, conn, std::move(pending));
+}
+
+void IOEngine::openConnection(Loop& loop, Pending pending) {
+    misses_++;
+
+    struct sockaddr_in server_addr{};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(pending.request.port);
+    if (inet_pton(AF_INET, pending.request.ip.c_str(), &server_addr.sin_addr) != 1) {
+        fail(pending, "invalid address " + pending.request.ip);
+        return;
+    }
+
+    enforceBudget(loop, 1);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fail(pending, std::string("socket: ") + strerror(errno));
+        return;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+
+    int rc = ::connect(fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
+    if (rc < 0 && errno != EINPROGRESS) {
+        std::string error = std::string("connect: ") + strerror(errno);
+        close(fd);
+        fail(pending, error);
+        return;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLOUT;
+    ev.data.fd = fd;
+    if (epoll_ctl(loop.epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        std::string error = std::string("epoll_ctl: ") + strerror(errno);
+        close(fd);
+        fail(pending, error);
+        return;
+    }
+
+    auto conn = std::make_unique<Connection>();
+    conn->fd = fd;
+    conn->key = connectionKey(pending.request.ip, pending.request.port);
+    conn->state = Connection::State::Connecting;
+    conn->reused = false;
+    conn->closeWhenDone = false;
+    conn->seq = loop.nextSeq++;
+    conn->hasCurrent = true;
+    conn->current = std::move(pending);
+    resetWriter(*conn);
+    conn->reader.setMaxFrameSize(max_frame_size_);
+    conn->lastUsed = Clock::now();
+    conn->idleListed = false;
+
+    loop.deadlines.emplace(conn->current.deadline, conn->seq, fd);
+    loop.byKey[conn->key] = conn.get();
+    Connection& ref = *conn;
+    loop.connections[fd] = std::move(conn);
+    open_connections_++;
+
+    if (rc == 0) {
+        ref.state = Connection::State::Writing;
+        flushWrite(loop, ref);
+    }
+}
+
+void IOEngine::beginRequest(Loop& loop, Connection& conn, Pending pending) {
+    if (conn.idleListed) {
+        loop.idle.erase(conn.idleIt);
+        conn.idleListed = false;
+        idle_connections_--;
+    }
+
+    conn.state = Connection::State::Writing;
+    conn.reused = true;
+    conn.seq = loop.nextSeq++;
+    conn.hasCurrent = true;
+    conn.current = std::move(pending);
+    resetWriter(conn);
+    conn.reader.reset();
+    conn.reader.setMaxFrameSize(max_frame_size_);
+
+    loop.deadlines.emplace(conn.current.deadline, conn.seq, conn.fd);
+    flushWrite(loop, conn);
+}
+
+void IOEngine::resetWriter(Connection& conn) {
+    const IORequest& request = conn.current.request;
+    if (request.staticFrame) {
+        conn.writer.reset(request.staticFrame, request.staticFrameSize);
+    } else {
+        conn.writer.reset(request.frame.data(), request.frame.size());
+    }
+}
+
+void IOEngine::handleEvent(Loop& loop, Connection& conn, uint32_t events) {
+    switch (conn.state) {
+    case Connection::State::Idle:
+        // Any readiness on an idle socket means the peer closed or misbehaved
+        stale_closes_++;
+        closeConnection(loop, conn);
+        return;
+
+    case Connection::State::Connecting: {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0) {
+            failConnection(loop, conn, std::string("connect: ") + strerror(error),
+                           Failure::ConnectFailed);
+            return;
+        }
+        conn.state = Connection::State::Writing;
+        flushWrite(loop, conn);
+        return;
+    }
+
+    case Connection::State::Writing:
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            failConnection(loop, conn, "connection reset", Failure::Broken);
+            return;
+        }
+        flushWrite(loop, conn);
+        return;
+
+    case Connection::State::Reading:
+        readResponse(loop, conn);
+        return;
+    }
+}
+
+void IOEngine::flushWrite(Loop& loop, Connection& conn) {
+    switch (conn.writer.writeTo(conn.fd)) {
+    case FrameWriter::Status::WouldBlock: {
+        epoll_event ev{};
+        ev.events = EPOLLOUT;
+        ev.data.fd = conn.fd;
+        epoll_ctl(loop.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+        return;
+    }
+    case FrameWriter::Status::Error:
+        failConnection(loop, conn, std::string("send: ") + strerror(conn.writer.lastError()), Failure::Broken);
+        return;
+    case FrameWriter::Status::Done:
+        break;
+    }
+
+    conn.state = Connection::State::Reading;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = conn.fd;
+    epoll_ctl(loop.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+}
+
+void IOEngine::readResponse(Loop& loop, Connection& conn) {
+    switch (conn.reader.readFrom(conn.fd)) {
+    case FrameReader::Status::NeedMore:
+        return;
+    case FrameReader::Status::Closed:
+        failConnection(loop, conn, "connection closed by peer", Failure::Broken);
+        return;
+    case FrameReader::Status::Error:
+        failConnection(loop, conn, std::string("recv: ") + strerror(conn.reader.lastError()), Failure::Broken);
+        return;
+    case FrameReader::Status::TooLarge:
+        // The stream can't be resynchronised after an oversized frame
+        failConnection(loop, conn, "response frame exceeds size limit", Failure::Protocol);
+        return;
+    case FrameReader::Status::Complete:
+        completeRequest(loop, conn);
+        return;
+    }
+}
+
+void IOEngine::completeRequest(Loop& loop, Connection& conn) {
+    IOCallback callback = std::move(conn.current.request.callback);
+    IOResult result{true, "", ""};
+    conn.reader.takeFrame(result.payload);
+    conn.hasCurrent = false;
+    in_flight_--;
+
+    // Unsolicited trailing bytes mean the stream is out of sync; don't reuse it
+    if (conn.reader.buffered() > 0) {
+        conn.closeWhenDone = true;
+    }
+
+    // Callbacks can only enqueue new work, so the connection outlives this call
+    if (callback) {
+        callback(std::move(result));
+    }
+
+    auto now = Clock::now();
+    while (!conn.queue.empty()) {
+        Pending next = std::move(conn.queue.front());
+        conn.queue.pop_front();
+        if (next.deadline <= now) {
+            fail(next, "timed out");
+            continue;
+        }
+        hits_++;
+        beginRequest(loop, conn, std::move(next));
+        return;
+    }
+
+    makeIdle(loop, conn);
+}
+
+void IOEngine::failConnection(Loop& loop, Connection& conn, const std::string& error,
+                              Failure failure) {
+    bool hadCurrent = conn.hasCurrent;
+    Pending current;
+    if (hadCurrent) {
+        current = std::move(conn.current);
+        conn.hasCurrent = false;
+    }
+    std::deque<Pending> queue;
+    queue.swap(conn.queue);
+
+    // A warm socket that died before any response byte arrived was most likely
+    // closed by the device while idle; retry once on a fresh connection.
+    bool retry = hadCurrent && failure == Failure::Broken && conn.reused &&
+                 !current.retried && conn.reader.buffered() == 0;
+    if (failure == Failure::TimedOut && conn.state == Connection::State::Connecting) {
+        failure = Failure::ConnectFailed;
+    }
+
+    closeConnection(loop, conn);
+
+    if (hadCurrent) {
+        if (retry) {
+            reconnects_++;
+            current.retried = true;
+            dispatch(loop, std::move(current));
+        } else {
+            fail(current, error);
+        }
+    }
+
+    for (auto& pending : queue) {
+        if (failure == Failure::ConnectFailed) {
+            fail(pending, error);
+        } else {
+            dispatch(loop, std::move(pending));
+        }
+    }
+}
+
+void IOEngine::makeIdle(Loop& loop, Connection& conn) {
+    if (conn.closeWhenDone || !running_) {
+        closeConnection(loop, conn);
+        return;
+    }
+
+    conn.state = Connection::State::Idle;
+    conn.lastUsed = Clock::now();
+    conn.reader.reset();
+    conn.idleIt = loop.idle.insert(loop.idle.end(), &conn);
+    conn.idleListed = true;
+    idle_connections_++;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = conn.fd;
+    epoll_ctl(loop.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+
+    enforceBudget(loop, 0);
+}
+
+void IOEngine::closeConnection(Loop& loop, Connection& conn) {
+    int fd = conn.fd;
+    epoll_ctl(loop.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+
+    if (conn.idleListed) {
+        loop.idle.erase(conn.idleIt);
+        idle_connections_--;
+    }
+
+    auto keyIt = loop.byKey.find(conn.key);
+    if (keyIt != loop.byKey.end() && keyIt->second == &conn) {
+        loop.byKey.erase(keyIt);
+    }
+
+    open_connections_--;
+    loop.connections.erase(fd);
+}
+
+void IOEngine::enforceBudget(Loop& loop, size_t reserve) {
+    // The budget is split evenly across loops; only idle sockets can be evicted
+    size_t budget = std::max<size_t>(1, max_connections_ / loops_.size());
+    while (!loop.idle.empty() && loop.connections.size() + reserve > budget) {
+        evictions_++;
+        closeConnection(loop, *loop.idle.front());
+    }
+}
+
+void IOEngine::expireTimers(Loop& loop) {
+    auto now = Clock::now();
+
+    while (!loop.deadlines.empty()) {
+        auto top = loop.deadlines.top();
+        if (std::get<0>(top) > now) {
+            break;
+        }
+        loop.deadlines.pop();
+
+        auto it = loop.connections.find(std::get<2>(top));
+        if (it != loop.connections.end() && it->second->hasCurrent && it->second->seq == std::get<1>(top)) {
+            failConnection(loop, *it->second, "timed out", Failure::TimedOut);
+        }
+    }
+
+    auto idleTimeout = std::chrono::milliseconds(idle_timeout_ms_.load());
+    while (!loop.idle.empty() && loop.idle.front()->lastUsed + idleTimeout <= now) {
+        idle_closes_++;
+        closeConnection(loop, *loop.idle.front());
+    }
+}
+
+void IOEngine::fail(Pending& pending, const std::string& error) {
+    in_flight_--;
+    if (pending.request.callback) {
+        pending.request.callback(IOResult{false, "", error});
+    }
+}
@@ -0,0 +1,137 @@
+#include "kasa_codec.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+const bool kLittleEndian = true;
+#else
+const bool kLittleEndian = false;
+#endif
+
+const uint64_t kBroadcast = 0x0101010101010101ULL;
+
+}
+
+uint8_t KasaCodec::encryptScalar(const uint8_t* in, uint8_t* out, size_t len, uint8_t key) {
+    for (size_t i = 0; i < len; ++i) {
+        key = static_cast<uint8_t>(key ^ in[i]);
+        out[i] = key;
+    }
+    return key;
+}
+
+uint8_t KasaCodec::decryptScalar(const uint8_t* in, uint8_t* out, size_t len, uint8_t key) {
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t c = in[i];
+        out[i] = static_cast<uint8_t>(c ^ key);
+        key = c;
+    }
+    return key;
+}
+
+uint8_t KasaCodec::encrypt(const uint8_t* in, uint8_t* out, size_t len, uint8_t key) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // c[i] = key ^ p[0] ^ ... ^ p[i]: a log-step prefix-XOR within the
+    // vector, then the carried-in key broadcast across all lanes. The carry
+    // stays in a vector register so blocks only chain through one XOR.
+    if (len >= 16) {
+        __m128i carry = _mm_set1_epi8(static_cast<char>(key));
+        for (; i + 16 <= len; i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            x = _mm_xor_si128(x, _mm_slli_si128(x, 1));
+            x = _mm_xor_si128(x, _mm_slli_si128(x, 2));
+            x = _mm_xor_si128(x, _mm_slli_si128(x, 4));
+            x = _mm_xor_si128(x, _mm_slli_si128(x, 8));
+            x = _mm_xor_si128(x, carry);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+
+            // Broadcast byte 15 to every lane for the next block
+            __m128i hi = _mm_unpackhi_epi8(x, x);
+            hi = _mm_shufflehi_epi16(hi, 0xFF);
+            carry = _mm_unpackhi_epi64(hi, hi);
+        }
+        key = static_cast<uint8_t>(_mm_cvtsi128_si32(carry));
+    }
+#endif
+
+    if (kLittleEndian) {
+        // Same formulation on 64-bit words for targets without SSE2
+        for (; i + 8 <= len; i += 8) {
+            uint64_t x;
+            memcpy(&x, in + i, sizeof(x));
+            x ^= x << 8;
+            x ^= x << 16;
+            x ^= x << 32;
+            x ^= kBroadcast * key;
+            memcpy(out + i, &x, sizeof(x));
+            key = static_cast<uint8_t>(x >> 56);
+        }
+    }
+
+    return encryptScalar(in + i, out + i, len - i, key);
+}
+
+uint8_t KasaCodec::decrypt(const uint8_t* in, uint8_t* out, size_t len, uint8_t key) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // p[i] = c[i] ^ c[i-1]: no serial dependency beyond the carried byte
+    for (; i + 16 <= len; i += 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i prev = _mm_or_si128(_mm_slli_si128(c, 1), _mm_cvtsi32_si128(key));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(c, prev));
+        key = static_cast<uint8_t>(_mm_extract_epi16(c, 7) >> 8);
+    }
+#endif
+
+    if (kLittleEndian) {
+        for (; i + 8 <= len; i += 8) {
+            uint64_t c;
+            memcpy(&c, in + i, sizeof(c));
+            uint64_t p = c ^ ((c << 8) | key);
+            memcpy(out + i, &p, sizeof(p));
+            key = static_cast<uint8_t>(c >> 56);
+        }
+    }
+
+    return decryptScalar(in + i, out + i, len - i, key);
+}
+
+size_t KasaCodec::encodeFrame(const char* plain, size_t len, uint8_t* out, size_t outCapacity) {
+    size_t total = frameSize(len);
+    if (outCapacity < total || len > UINT32_MAX) {
+        return 0;
+    }
+
+    out[0] = static_cast<uint8_t>(len >> 24);
+    out[1] = static_cast<uint8_t>(len >> 16);
+    out[2] = static_cast<uint8_t>(len >> 8);
+    out[3] = static_cast<uint8_t>(len);
+    encrypt(reinterpret_cast<const uint8_t*>(plain), out + kHeaderSize, len);
+
+    return total;
+}
+
+std::string KasaCodec::encodeFrame(const std::string& plain) {
+    std::string frame(frameSize(plain.size()), '\0');
+    encodeFrame(plain.data(), plain.size(), reinterpret_cast<uint8_t*>(&frame[0]), frame.size());
+    return frame;
+}
+
+std::string KasaCodec::encrypt(const std::string& plain) {
+    std::string cipher(plain.size(), '\0');
+    encrypt(reinterpret_cast<const uint8_t*>(plain.data()), reinterpret_cast<uint8_t*>(&cipher[0]), plain.size());
+    return cipher;
+}
+
+void KasaCodec::decryptInPlace(std::string& data) {
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(&data[0]);
+    decrypt(bytes, bytes, data.size());
+}
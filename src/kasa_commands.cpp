@@ -0,0 +1,116 @@
+#include "kasa_commands.h"
+#include "kasa_codec.h"
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+constexpr auto kGetSysinfo = KasaCodec::encodeConstant("{\"system\":{\"get_sysinfo\":null}}");
+constexpr auto kRelayOn = KasaCodec::encodeConstant("{\"system\":{\"set_relay_state\":{\"state\":1}}}");
+constexpr auto kRelayOff = KasaCodec::encodeConstant("{\"system\":{\"set_relay_state\":{\"state\":0}}}");
+constexpr auto kRelayToggle = KasaCodec::encodeConstant("{\"system\":{\"set_relay_state\":{\"state\":-1}}}");
+constexpr auto kLightOn = KasaCodec::encodeConstant(
+    "{\"smartlife.iot.smartbulb.lightingservice\":{\"set_light_state\":{\"on_off\":1}}}");
+constexpr auto kLightOff = KasaCodec::encodeConstant(
+    "{\"smartlife.iot.smartbulb.lightingservice\":{\"set_light_state\":{\"on_off\":0}}}");
+constexpr auto kGetSysinfoDatagram = KasaCodec::encryptConstant("{\"system\":{\"get_sysinfo\":null}}");
+
+// Constant prefixes of the light_state templates, up to the first numeric slot.
+// Brightness and color commands both start with the brightness field.
+constexpr auto kBrightnessPrefix = KasaCodec::encryptConstant(
+    "{\"smartlife.iot.smartbulb.lightingservice\":{\"set_light_state\":{\"brightness\":");
+constexpr auto kColorTempPrefix = KasaCodec::encryptConstant(
+    "{\"smartlife.iot.smartbulb.lightingservice\":{\"set_light_state\":{\"color_temp\":");
+
+// Plaintext tail of a template with its numeric slots filled in
+class Tail {
+public:
+    Tail() : len_(0) {}
+
+    Tail& text(const char* s) {
+        size_t n = strlen(s);
+        memcpy(buf_ + len_, s, n);
+        len_ += n;
+        return *this;
+    }
+
+    Tail& number(int value) {
+        auto result = std::to_chars(buf_ + len_, buf_ + sizeof(buf_), value);
+        len_ = static_cast<size_t>(result.ptr - buf_);
+        return *this;
+    }
+
+    const char* data() const { return buf_; }
+    size_t size() const { return len_; }
+
+private:
+    char buf_[96];
+    size_t len_;
+};
+
+// Header + copied prefix ciphertext + tail encrypted from the prefix's end key
+template <size_t N>
+std::string assemble(const KasaCodec::ConstantCipher<N>& prefix, const Tail& tail) {
+    size_t payload = N + tail.size();
+    std::string frame(KasaCodec::frameSize(payload), '\0');
+    uint8_t* out = reinterpret_cast<uint8_t*>(&frame[0]);
+
+    out[0] = static_cast<uint8_t>(payload >> 24);
+    out[1] = static_cast<uint8_t>(payload >> 16);
+    out[2] = static_cast<uint8_t>(payload >> 8);
+    out[3] = static_cast<uint8_t>(payload);
+    memcpy(out + KasaCodec::kHeaderSize, prefix.data, N);
+    KasaCodec::encrypt(reinterpret_cast<const uint8_t*>(tail.data()),
+                       out + KasaCodec::kHeaderSize + N, tail.size(), prefix.endKey);
+
+    return frame;
+}
+
+}
+
+FrameRef KasaCommands::getSysinfo() {
+    return FrameRef{kGetSysinfo.data, kGetSysinfo.size};
+}
+
+FrameRef KasaCommands::relayOn() {
+    return FrameRef{kRelayOn.data, kRelayOn.size};
+}
+
+FrameRef KasaCommands::relayOff() {
+    return FrameRef{kRelayOff.data, kRelayOff.size};
+}
+
+FrameRef KasaCommands::relayToggle() {
+    return FrameRef{kRelayToggle.data, kRelayToggle.size};
+}
+
+FrameRef KasaCommands::lightOn() {
+    return FrameRef{kLightOn.data, kLightOn.size};
+}
+
+FrameRef KasaCommands::lightOff() {
+    return FrameRef{kLightOff.data, kLightOff.size};
+}
+
+FrameRef KasaCommands::getSysinfoDatagram() {
+    return FrameRef{kGetSysinfoDatagram.data, kGetSysinfoDatagram.size};
+}
+
+std::string KasaCommands::setBrightness(int brightness) {
+    Tail tail;
+    tail.number(brightness).text(",\"on_off\":").number(brightness > 0 ? 1 : 0).text("}}}");
+    return assemble(kBrightnessPrefix, tail);
+}
+
+std::string KasaCommands::setColorTemp(int temp) {
+    Tail tail;
+    tail.number(temp).text(",\"on_off\":1}}}");
+    return assemble(kColorTempPrefix, tail);
+}
+
+std::string KasaCommands::setColor(int hue, int saturation, int value) {
+    Tail tail;
+    tail.number(value).text(",\"hue\":").number(hue)
+        .text(",\"on_off\":1,\"saturation\":").number(saturation).text("}}}");
+    return assemble(kBrightnessPrefix, tail);
+}
@@ -0,0 +1,187 @@
+#include "kasa_frame.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+const size_t kHeaderSize = 4;
+const size_t kInitialCapacity = 2048;
+const size_t kRetainedCapacity = 16384; // Larger buffers are released on reset()
+
+}
+
+FrameReader::FrameReader(size_t maxFrameSize)
+    : start_(0), end_(0), maxFrameSize_(maxFrameSize), lastError_(0) {
+}
+
+FrameReader::Status FrameReader::readFrom(int fd) {
+    while (true) {
+        Status status = parse();
+        if (status != Status::NeedMore) {
+            return status;
+        }
+
+        // Compact consumed bytes away; parse() already sized the buffer for a
+        // frame whose header has arrived, so only grow when completely full
+        if (start_ > 0) {
+            memmove(buffer_.data(), buffer_.data() + start_, end_ - start_);
+            end_ -= start_;
+            start_ = 0;
+        }
+        if (buffer_.size() == end_) {
+            buffer_.resize(std::max(kInitialCapacity, buffer_.size() * 2));
+        }
+
+        ssize_t n = recv(fd, buffer_.data() + end_, buffer_.size() - end_, 0);
+        if (n > 0) {
+            end_ += static_cast<size_t>(n);
+            continue;
+        }
+        if (n == 0) {
+            return Status::Closed;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return Status::NeedMore;
+        }
+        lastError_ = errno;
+        return Status::Error;
+    }
+}
+
+FrameReader::Status FrameReader::parse() {
+    size_t available = end_ - start_;
+    if (available < kHeaderSize) {
+        return Status::NeedMore;
+    }
+
+    const uint8_t* header = reinterpret_cast<const uint8_t*>(buffer_.data() + start_);
+    size_t length = (static_cast<size_t>(header[0]) << 24) | (static_cast<size_t>(header[1]) << 16) |
+                    (static_cast<size_t>(header[2]) << 8) | static_cast<size_t>(header[3]);
+    if (length > maxFrameSize_) {
+        return Status::TooLarge;
+    }
+
+    // Grow once to the exact frame size instead of doubling repeatedly
+    if (start_ + kHeaderSize + length > buffer_.size()) {
+        buffer_.resize(start_ + kHeaderSize + length);
+    }
+
+    return available >= kHeaderSize + length ? Status::Complete : Status::NeedMore;
+}
+
+bool FrameReader::takeFrame(std::string& out) {
+    if (parse() != Status::Complete) {
+        return false;
+    }
+
+    const uint8_t* header = reinterpret_cast<const uint8_t*>(buffer_.data() + start_);
+    size_t length = (static_cast<size_t>(header[0]) << 24) | (static_cast<size_t>(header[1]) << 16) |
+                    (static_cast<size_t>(header[2]) << 8) | static_cast<size_t>(header[3]);
+
+    out.assign(buffer_.data() + start_ + kHeaderSize, length);
+    start_ += kHeaderSize + length;
+    if (start_ == end_) {
+        start_ = 0;
+        end_ = 0;
+    }
+    return true;
+}
+
+void FrameReader::setMaxFrameSize(size_t maxFrameSize) {
+    maxFrameSize_ = maxFrameSize;
+}
+
+size_t FrameReader::buffered() const {
+    return end_ - start_;
+}
+
+int FrameReader::lastError() const {
+    return lastError_;
+}
+
+void FrameReader::reset() {
+    start_ = 0;
+    end_ = 0;
+    lastError_ = 0;
+    if (buffer_.size() > kRetainedCapacity) {
+        std::vector<char>().swap(buffer_);
+    }
+}
+
+FrameWriter::FrameWriter()
+    : segmentCount_(0), total_(0), written_(0), lastError_(0) {
+}
+
+void FrameWriter::reset(const char* frame, size_t len) {
+    segments_[0] = frame;
+    lengths_[0] = len;
+    segmentCount_ = 1;
+    total_ = len;
+    written_ = 0;
+    lastError_ = 0;
+}
+
+void FrameWriter::resetWithHeader(const char* payload, size_t len) {
+    header_[0] = static_cast<uint8_t>(len >> 24);
+    header_[1] = static_cast<uint8_t>(len >> 16);
+    header_[2] = static_cast<uint8_t>(len >> 8);
+    header_[3] = static_cast<uint8_t>(len);
+
+    segments_[0] = reinterpret_cast<const char*>(header_);
+    lengths_[0] = sizeof(header_);
+    segments_[1] = payload;
+    lengths_[1] = len;
+    segmentCount_ = 2;
+    total_ = sizeof(header_) + len;
+    written_ = 0;
+    lastError_ = 0;
+}
+
+FrameWriter::Status FrameWriter::writeTo(int fd) {
+    while (written_ < total_) {
+        // Rebuild the iovec list from the current offset
+        struct iovec iov[2];
+        int count = 0;
+        size_t skip = written_;
+        for (size_t i = 0; i < segmentCount_; ++i) {
+            if (skip >= lengths_[i]) {
+                skip -= lengths_[i];
+                continue;
+            }
+            iov[count].iov_base = const_cast<char*>(segments_[i] + skip);
+            iov[count].iov_len = lengths_[i] - skip;
+            skip = 0;
+            count++;
+        }
+
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        // sendmsg() is writev() with MSG_NOSIGNAL, so a dead peer can't raise SIGPIPE
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n > 0) {
+            written_ += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return Status::WouldBlock;
+        }
+        lastError_ = n < 0 ? errno : EPIPE;
+        return Status::Error;
+    }
+    return Status::Done;
+}
+
+int FrameWriter::lastError() const {
+    return lastError_;
+}
@@ -34,7 +34,16 @@ void printUsage(const char* programName) {
     std::cout << "  -h, --help             Show this help message" << std::endl;
     std::cout << "  -v, --verbose          Enable verbose logging" << std::endl;
     std::cout << "  --discover-only        Only discover devices and exit" << std::endl;
+    std::cout << "  --discovery-window MS  UDP discovery reply window (default: 1000)" << std::endl;
+    std::cout << "  --discovery-target IP  Also send discovery probes to IP (repeatable)" << std::endl;
+    std::cout << "  --discover-cidr CIDR   Sweep a range over TCP instead of broadcasting (repeatable)" << std::endl;
+    std::cout << "  --sweep-concurrency N  Probes in flight during a sweep (default: 256)" << std::endl;
+    std::cout << "  --poll-rate N          Monitoring polls per second across all devices (default: 50)" << std::endl;
     std::cout << "  --no-monitoring        Disable device monitoring" << std::endl;
+    std::cout << "  --history-days N       Keep raw state history and discovery records N days (default: 7)" << std::endl;
+    std::cout << "  --minute-rollup-days N Keep minute rollups N days (default: 30)" << std::endl;
+    std::cout << "  --hour-rollup-days N   Keep hour rollups N days (default: 365)" << std::endl;
+    std::cout << "  --check-cache          Compare every cached device read with the database (slow)" << std::endl;
 }
 
 void printBanner() {
@@ -54,6 +63,13 @@ int main(int argc, char* argv[]) {
     bool verbose = false;
     bool discoverOnly = false;
     bool enableMonitoring = true;
+    int discoveryWindowMs = UdpDiscovery::kDefaultWindowMs;
+    std::vector<std::string> discoveryTargets;
+    std::vector<std::string> sweepRanges;
+    size_t sweepConcurrency = NetworkSweep::kDefaultConcurrency;
+    double pollRate = DeviceManager::kDefaultPollRate;
+    HistoryRetention retention = Database::kDefaultRetention;
+    bool checkCache = false;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -80,8 +96,67 @@ int main(int argc, char* argv[]) {
             verbose = true;
         } else if (arg == "--discover-only") {
             discoverOnly = true;
+        } else if (arg == "--discovery-window") {
+            if (i + 1 < argc) {
+                discoveryWindowMs = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --discovery-window requires a value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--discovery-target") {
+            if (i + 1 < argc) {
+                discoveryTargets.push_back(argv[++i]);
+            } else {
+                std::cerr << "Error: --discovery-target requires a value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--discover-cidr") {
+            CidrRange range;
+            if (i + 1 < argc && CidrRange::parse(argv[i + 1], range)) {
+                sweepRanges.push_back(argv[++i]);
+            } else {
+                std::cerr << "Error: --discover-cidr requires a range like 192.168.1.0/24 (/16 or smaller)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--sweep-concurrency") {
+            if (i + 1 < argc) {
+                sweepConcurrency = std::stoul(argv[++i]);
+            } else {
+                std::cerr << "Error: --sweep-concurrency requires a value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--poll-rate") {
+            if (i + 1 < argc) {
+                pollRate = std::stod(argv[++i]);
+            } else {
+                std::cerr << "Error: --poll-rate requires a value" << std::endl;
+                return 1;
+            }
         } else if (arg == "--no-monitoring") {
             enableMonitoring = false;
+        } else if (arg == "--history-days") {
+            if (i + 1 < argc) {
+                retention.rawMs = std::stoll(argv[++i]) * Database::kDayMs;
+            } else {
+                std::cerr << "Error: --history-days requires a value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--minute-rollup-days") {
+            if (i + 1 < argc) {
+                retention.minuteMs = std::stoll(argv[++i]) * Database::kDayMs;
+            } else {
+                std::cerr << "Error: --minute-rollup-days requires a value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--hour-rollup-days") {
+            if (i + 1 < argc) {
+                retention.hourMs = std::stoll(argv[++i]) * Database::kDayMs;
+            } else {
+                std::cerr << "Error: --hour-rollup-days requires a value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--check-cache") {
+            checkCache = true;
         } else {
             std::cerr << "Unknown option: " << arg << std::endl;
             printUsage(argv[0]);
@@ -97,6 +172,8 @@ int main(int argc, char* argv[]) {
         // Initialize database
         std::cout << "Initializing database..." << std::endl;
         g_database = std::make_shared<Database>(dbPath);
+        g_database->setHistoryRetention(retention);
+        g_database->setCacheCheck(checkCache);
         if (!g_database->initialize()) {
             std::cerr << "Failed to initialize database" << std::endl;
             return 1;
@@ -106,6 +183,11 @@ int main(int argc, char* argv[]) {
         // Initialize device manager
         std::cout << "Initializing device manager..." << std::endl;
         g_deviceManager = std::make_shared<DeviceManager>();
+        g_deviceManager->setDiscoveryWindow(discoveryWindowMs);
+        g_deviceManager->setPollRate(pollRate);
+        for (const auto& target : discoveryTargets) {
+            g_deviceManager->addDiscoveryTarget(target);
+        }
         
         // Load existing devices from database
         auto existingDevices = g_database->getAllDevices();
@@ -120,8 +202,19 @@ int main(int argc, char* argv[]) {
         }
         
         // Discover new devices
-        std::cout << "Discovering TP-Link devices..." << std::endl;
-        auto discoveredDevices = g_deviceManager->discoverDevices();
+        std::vector<DeviceInfo> discoveredDevices;
+        if (sweepRanges.empty()) {
+            std::cout << "Discovering TP-Link devices..." << std::endl;
+            discoveredDevices = g_deviceManager->discoverDevices();
+        } else {
+            // Report devices as the sweep finds them
+            std::cout << "Sweeping " << sweepRanges.size() << " address range(s) for TP-Link devices..." << std::endl;
+            g_deviceManager->sweepDevices(sweepRanges, [&](const DeviceInfo& device) {
+                discoveredDevices.push_back(device);
+                std::cout << "  + " << device.name << " (" << device.ip << ") - " << device.model << std::endl;
+                return true;
+            }, sweepConcurrency);
+        }
         std::cout << "Discovered " << discoveredDevices.size() << " devices" << std::endl;
         
         if (verbose) {
@@ -159,11 +252,16 @@ int main(int argc, char* argv[]) {
         std::cout << "  POST http://localhost:" << port << "/api/discover" << std::endl;
         std::cout << "  GET  http://localhost:" << port << "/api/devices" << std::endl;
         std::cout << "  GET  http://localhost:" << port << "/api/devices/{deviceId}" << std::endl;
+        std::cout << "  GET  http://localhost:" << port << "/api/devices/{deviceId}/history" << std::endl;
         std::cout << "  POST http://localhost:" << port << "/api/devices/{deviceId}/power" << std::endl;
         std::cout << "  POST http://localhost:" << port << "/api/devices/{deviceId}/brightness" << std::endl;
         std::cout << "  POST http://localhost:" << port << "/api/devices/{deviceId}/color" << std::endl;
         std::cout << "  POST http://localhost:" << port << "/api/devices/{deviceId}/colortemp" << std::endl;
+        std::cout << "  POST http://localhost:" << port << "/api/groups/{groupId}/power" << std::endl;
+        std::cout << "  POST http://localhost:" << port << "/api/scenes/{sceneId}/apply" << std::endl;
         std::cout << "  GET  http://localhost:" << port << "/api/stats" << std::endl;
+        std::cout << "  GET  http://localhost:" << port << "/api/metrics" << std::endl;
+        std::cout << "  GET  http://localhost:" << port << "/api/events" << std::endl;
         std::cout << std::endl;
         std::cout << "Press Ctrl+C to stop the server" << std::endl;
         
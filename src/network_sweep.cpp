@@ -0,0 +1,142 @@
+#include "network_sweep.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <arpa/inet.h>
+
+bool CidrRange::parse(const std::string& text, CidrRange& range) {
+    size_t slash = text.find('/');
+    std::string address = text.substr(0, slash);
+    int prefix = 32;
+    if (slash != std::string::npos) {
+        std::string bits = text.substr(slash + 1);
+        if (bits.empty() || bits.size() > 2 || bits.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        prefix = std::stoi(bits);
+    }
+    if (prefix < kMinPrefix || prefix > 32) {
+        return false;
+    }
+
+    struct in_addr addr;
+    if (inet_pton(AF_INET, address.c_str(), &addr) != 1) {
+        return false;
+    }
+
+    uint32_t mask = ~uint32_t(0) << (32 - prefix);
+    uint32_t network = ntohl(addr.s_addr) & mask;
+    range.first = network;
+    range.last = network | ~mask;
+    if (prefix <= 30) {
+        range.first++;
+        range.last--;
+    }
+    return true;
+}
+
+NetworkSweep::NetworkSweep(std::shared_ptr<IOEngine> engine)
+    : engine_(std::move(engine)), concurrency_(kDefaultConcurrency),
+      probe_timeout_ms_(kDefaultProbeTimeoutMs), port_(9999) {
+}
+
+void NetworkSweep::setConcurrency(size_t concurrency) {
+    concurrency_ = concurrency > 0 ? concurrency : 1;
+}
+
+void NetworkSweep::setProbeTimeout(int timeoutMs) {
+    probe_timeout_ms_ = timeoutMs > 0 ? timeoutMs : 1;
+}
+
+void NetworkSweep::setPort(int port) {
+    port_ = port;
+}
+
+void NetworkSweep::setSkip(HostFilter skip) {
+    skip_ = std::move(skip);
+}
+
+bool NetworkSweep::addRange(const std::string& cidr) {
+    CidrRange range;
+    if (!CidrRange::parse(cidr, range)) {
+        return false;
+    }
+    ranges_.push_back(range);
+    return true;
+}
+
+size_t NetworkSweep::hostCount() const {
+    size_t count = 0;
+    for (const auto& range : ranges_) {
+        count += range.size();
+    }
+    return count;
+}
+
+size_t NetworkSweep::run(const DeviceCallback& onDevice) {
+    // Completions are queued by engine threads and consumed here, so the
+    // callback never runs on a loop thread.
+    struct Shared {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::shared_ptr<TPLinkDevice>> found;
+        size_t completed = 0;
+    };
+    auto shared = std::make_shared<Shared>();
+
+    size_t rangeIndex = 0;
+    uint64_t nextHost = ranges_.empty() ? 0 : ranges_[0].first;
+    size_t launched = 0;
+    size_t completed = 0;
+    size_t devices = 0;
+    bool stopped = false;
+
+    while (true) {
+        // Top up the in-flight window
+        while (!stopped && rangeIndex < ranges_.size() && launched - completed < concurrency_) {
+            struct in_addr addr;
+            addr.s_addr = htonl(static_cast<uint32_t>(nextHost));
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+            if (nextHost++ == ranges_[rangeIndex].last && ++rangeIndex < ranges_.size()) {
+                nextHost = ranges_[rangeIndex].first;
+            }
+            if (skip_ && skip_(ip, port_)) {
+                continue;
+            }
+
+            auto device = std::make_shared<TPLinkDevice>(ip, port_, engine_);
+            device->setTimeout(probe_timeout_ms_);
+            device->discoverAsync([shared, device](bool success) {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                if (success) {
+                    shared->found.push_back(device);
+                }
+                shared->completed++;
+                shared->cv.notify_one();
+            }, TaskPriority::Background);
+            launched++;
+        }
+
+        if (completed == launched && (stopped || rangeIndex >= ranges_.size())) {
+            break;
+        }
+
+        std::deque<std::shared_ptr<TPLinkDevice>> found;
+        {
+            std::unique_lock<std::mutex> lock(shared->mutex);
+            shared->cv.wait(lock, [&]() { return shared->completed > completed || !shared->found.empty(); });
+            completed = shared->completed;
+            found.swap(shared->found);
+        }
+
+        for (auto& device : found) {
+            devices++;
+            if (!stopped && onDevice && !onDevice(device)) {
+                stopped = true;
+            }
+        }
+    }
+
+    return devices;
+}
@@ -0,0 +1,343 @@
+#include "sysinfo_parser.h"
+#include "tplink_device.h"
+#include <climits>
+#include <cstring>
+
+namespace {
+
+const int kMaxDepth = 32;
+
+bool isHex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+unsigned hexValue(char c) {
+    if (c >= '0' && c <= '9') return static_cast<unsigned>(c - '0');
+    if (c >= 'a' && c <= 'f') return static_cast<unsigned>(c - 'a' + 10);
+    return static_cast<unsigned>(c - 'A' + 10);
+}
+
+// Forward-only cursor over the response. Every method returns false on
+// input it doesn't accept and leaves the cursor somewhere undefined.
+class Cursor {
+public:
+    explicit Cursor(std::string_view text) : p_(text.data()), end_(text.data() + text.size()) {}
+
+    void skipSpace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+            ++p_;
+        }
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return p_ == end_;
+    }
+
+    char peek() {
+        skipSpace();
+        return p_ < end_ ? *p_ : '\0';
+    }
+
+    bool consume(char c) {
+        if (peek() != c) {
+            return false;
+        }
+        ++p_;
+        return true;
+    }
+
+    // Raw contents between the quotes; escapes are checked but not decoded
+    bool string(std::string_view& out) {
+        if (!consume('"')) {
+            return false;
+        }
+        const char* start = p_;
+        while (p_ < end_) {
+            char c = *p_;
+            if (c == '"') {
+                out = std::string_view(start, static_cast<size_t>(p_ - start));
+                ++p_;
+                return true;
+            }
+            if (c == '\\') {
+                if (++p_ == end_) {
+                    return false;
+                }
+                if (*p_ == 'u') {
+                    if (end_ - p_ < 5 || !isHex(p_[1]) || !isHex(p_[2]) || !isHex(p_[3]) || !isHex(p_[4])) {
+                        return false;
+                    }
+                    p_ += 4;
+                } else if (*p_ == '\0' || !strchr("\"\\/bfnrt", *p_)) {
+                    return false;
+                }
+            }
+            ++p_;
+        }
+        return false;
+    }
+
+    // Integers only; fractions and exponents are left to the fallback
+    bool integer(int& out) {
+        skipSpace();
+        bool negative = p_ < end_ && *p_ == '-';
+        if (negative) {
+            ++p_;
+        }
+        long long value = 0;
+        int digits = 0;
+        while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+            if (++digits > 10) {
+                return false;
+            }
+            value = value * 10 + (*p_ - '0');
+            ++p_;
+        }
+        if (digits == 0 || (p_ < end_ && (*p_ == '.' || *p_ == 'e' || *p_ == 'E'))) {
+            return false;
+        }
+        value = negative ? -value : value;
+        if (value < INT_MIN || value > INT_MAX) {
+            return false;
+        }
+        out = static_cast<int>(value);
+        return true;
+    }
+
+    bool skipValue(int depth) {
+        if (depth > kMaxDepth) {
+            return false;
+        }
+        std::string_view ignored;
+        switch (peek()) {
+        case '{':
+            return members(depth, [&](std::string_view) { return skipValue(depth + 1); });
+        case '[':
+            return elements(depth);
+        case '"':
+            return string(ignored);
+        case 't':
+            return literal("true");
+        case 'f':
+            return literal("false");
+        case 'n':
+            return literal("null");
+        default:
+            return number();
+        }
+    }
+
+    // Calls onMember(key) with the cursor on each member's value; the
+    // callback must consume that value.
+    template <typename F>
+    bool members(int depth, F&& onMember) {
+        if (depth > kMaxDepth || !consume('{')) {
+            return false;
+        }
+        if (consume('}')) {
+            return true;
+        }
+        while (true) {
+            std::string_view key;
+            if (!string(key) || !consume(':') || !onMember(key)) {
+                return false;
+            }
+            if (consume('}')) {
+                return true;
+            }
+            if (!consume(',')) {
+                return false;
+            }
+        }
+    }
+
+private:
+    bool elements(int depth) {
+        if (!consume('[')) {
+            return false;
+        }
+        if (consume(']')) {
+            return true;
+        }
+        while (true) {
+            if (!skipValue(depth + 1)) {
+                return false;
+            }
+            if (consume(']')) {
+                return true;
+            }
+            if (!consume(',')) {
+                return false;
+            }
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t len = strlen(word);
+        if (static_cast<size_t>(end_ - p_) < len || memcmp(p_, word, len) != 0) {
+            return false;
+        }
+        p_ += len;
+        return true;
+    }
+
+    bool number() {
+        const char* start = p_;
+        if (p_ < end_ && *p_ == '-') {
+            ++p_;
+        }
+        while (p_ < end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '.' || *p_ == 'e' || *p_ == 'E' ||
+                             *p_ == '+' || *p_ == '-')) {
+            ++p_;
+        }
+        return p_ > start && p_[-1] >= '0' && p_[-1] <= '9';
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+void appendUtf8(std::string& out, unsigned cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+unsigned hex4(const char* p) {
+    return (hexValue(p[0]) << 12) | (hexValue(p[1]) << 8) | (hexValue(p[2]) << 4) | hexValue(p[3]);
+}
+
+// Escapes were validated by Cursor::string, so this can't run off the end.
+// assign() reuses the string's capacity, so steady-state updates of an
+// unchanged field don't allocate.
+void assignString(std::string& out, std::string_view raw) {
+    if (raw.find('\\') == std::string_view::npos) {
+        out.assign(raw.data(), raw.size());
+        return;
+    }
+
+    out.clear();
+    for (size_t i = 0; i < raw.size(); ++i) {
+        char c = raw[i];
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        c = raw[++i];
+        switch (c) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            unsigned cp = hex4(raw.data() + i + 1);
+            i += 4;
+            if (cp >= 0xD800 && cp < 0xDC00 && i + 6 < raw.size() && raw[i + 1] == '\\' &&
+                raw[i + 2] == 'u') {
+                unsigned low = hex4(raw.data() + i + 3);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+            }
+            if (cp >= 0xD800 && cp < 0xE000) {
+                cp = 0xFFFD; // Unpaired surrogate
+            }
+            appendUtf8(out, cp);
+            break;
+        }
+        default: out += c; break; // \" \\ \/
+        }
+    }
+}
+
+bool scanLightState(Cursor& cursor, SysinfoParser::Fields& fields, int depth) {
+    fields.hasLightState = true;
+    return cursor.members(depth, [&](std::string_view key) {
+        if (key == "on_off") return cursor.integer(fields.onOff);
+        if (key == "brightness") return cursor.integer(fields.brightness);
+        if (key == "color_temp") return cursor.integer(fields.colorTemp);
+        if (key == "hue") return cursor.integer(fields.hue);
+        if (key == "saturation") return cursor.integer(fields.saturation);
+        return cursor.skipValue(depth + 1);
+    });
+}
+
+bool scanSysinfo(Cursor& cursor, SysinfoParser::Fields& fields, int depth) {
+    return cursor.members(depth, [&](std::string_view key) {
+        if (key == "deviceId") return cursor.string(fields.deviceId);
+        if (key == "alias") return cursor.string(fields.alias);
+        if (key == "model") return cursor.string(fields.model);
+        if (key == "mac") return cursor.string(fields.mac);
+        if (key == "relay_state") {
+            fields.hasRelayState = true;
+            return cursor.integer(fields.relayState);
+        }
+        if (key == "light_state") return scanLightState(cursor, fields, depth + 1);
+        return cursor.skipValue(depth + 1);
+    });
+}
+
+}
+
+bool SysinfoParser::scan(std::string_view response, Fields& fields) {
+    fields = Fields();
+    Cursor cursor(response);
+    bool found = false;
+
+    bool ok = cursor.members(0, [&](std::string_view module) {
+        if (module != "system") {
+            return cursor.skipValue(1);
+        }
+        return cursor.members(1, [&](std::string_view method) {
+            if (method != "get_sysinfo") {
+                return cursor.skipValue(2);
+            }
+            found = true;
+            return scanSysinfo(cursor, fields, 2);
+        });
+    });
+
+    return ok && found && cursor.atEnd();
+}
+
+void SysinfoParser::apply(const Fields& fields, DeviceInfo& info) {
+    assignString(info.deviceId, fields.deviceId);
+    assignString(info.name, fields.alias);
+    assignString(info.model, fields.model);
+    assignString(info.mac, fields.mac);
+    info.isOnline = true;
+
+    if (fields.hasLightState) {
+        info.isOn = fields.onOff == 1;
+        info.brightness = fields.brightness;
+        info.colorTemp = fields.colorTemp;
+        info.hue = fields.hue;
+        info.saturation = fields.saturation;
+    } else if (fields.hasRelayState) {
+        info.isOn = fields.relayState == 1;
+    }
+}
+
+bool SysinfoParser::parse(std::string_view response, DeviceInfo& info) {
+    Fields fields;
+    if (!scan(response, fields)) {
+        return false;
+    }
+    apply(fields, info);
+    return true;
+}
@@ -0,0 +1,104 @@
+#include "timing_wheel.h"
+
+TimingWheel::TimingWheel() : slots_(), current_(0) {
+}
+
+void TimingWheel::schedule(const std::string& key, uint64_t deadline) {
+    if (deadline <= current_) {
+        deadline = current_ + 1;
+    } else if (deadline - current_ > kMaxDelay) {
+        deadline = current_ + kMaxDelay;
+    }
+
+    auto inserted = nodes_.emplace(key, Node());
+    Node& node = inserted.first->second;
+    if (inserted.second) {
+        node.key = &inserted.first->first;
+    } else {
+        unlink(node);
+    }
+    node.deadline = deadline;
+    link(node);
+}
+
+bool TimingWheel::cancel(const std::string& key) {
+    auto it = nodes_.find(key);
+    if (it == nodes_.end()) {
+        return false;
+    }
+    unlink(it->second);
+    nodes_.erase(it);
+    return true;
+}
+
+bool TimingWheel::contains(const std::string& key) const {
+    return nodes_.count(key) != 0;
+}
+
+void TimingWheel::advance(uint64_t tick, std::vector<std::string>& expired) {
+    if (nodes_.empty() && tick > current_) {
+        current_ = tick;
+        return;
+    }
+
+    while (current_ < tick) {
+        current_++;
+        for (int level = kLevels - 1; level > 0; --level) {
+            uint64_t lowerTicks = (uint64_t(1) << (level * kSlotBits)) - 1;
+            if ((current_ & lowerTicks) == 0) {
+                cascade(level);
+            }
+        }
+
+        Node*& head = slots_[0][current_ & (kSlots - 1)];
+        while (head) {
+            Node* node = head;
+            unlink(*node);
+            expired.push_back(*node->key);
+            nodes_.erase(expired.back()); // Not node->key, which the erase destroys
+        }
+    }
+}
+
+void TimingWheel::link(Node& node) {
+    // Coarsest level whose digit differs from now; the slot is reached again
+    // exactly when the wheel gets to that digit of the deadline
+    int level = 0;
+    for (int l = kLevels - 1; l > 0; --l) {
+        if ((node.deadline >> (l * kSlotBits)) != (current_ >> (l * kSlotBits))) {
+            level = l;
+            break;
+        }
+    }
+
+    Node** head = &slots_[level][(node.deadline >> (level * kSlotBits)) & (kSlots - 1)];
+    node.head = head;
+    node.prev = nullptr;
+    node.next = *head;
+    if (*head) {
+        (*head)->prev = &node;
+    }
+    *head = &node;
+}
+
+void TimingWheel::unlink(Node& node) {
+    if (node.prev) {
+        node.prev->next = node.next;
+    } else {
+        *node.head = node.next;
+    }
+    if (node.next) {
+        node.next->prev = node.prev;
+    }
+}
+
+void TimingWheel::cascade(int level) {
+    Node*& head = slots_[level][(current_ >> (level * kSlotBits)) & (kSlots - 1)];
+    Node* node = head;
+    head = nullptr;
+    while (node) {
+        Node* next = node->next;
+        link(*node);
+        node = next;
+    }
+}
@@ -1,29 +1,45 @@
 #include "tplink_device.h"
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <unistd.h>
+#include "kasa_codec.h"
+#include "kasa_commands.h"
+#include "sysinfo_parser.h"
 #include <cstring>
 #include <iostream>
 #include <sstream>
 #include <json/json.h>
-#include <openssl/aes.h>
-#include <openssl/rand.h>
 #include <algorithm>
+#include <future>
 
-// Kasa protocol encryption key and IV
-const uint8_t TPLinkDevice::kasa_key_[16] = {
-    0x09, 0x76, 0x28, 0x34, 0x3f, 0xe9, 0x9e, 0x23,
-    0x76, 0x5c, 0x15, 0x13, 0xac, 0xcf, 0x8b, 0x02
-};
+namespace {
 
-const uint8_t TPLinkDevice::kasa_iv_[16] = {
-    0x56, 0x2e, 0x17, 0x99, 0x6d, 0x09, 0x3d, 0x20,
-    0x56, 0x2e, 0x17, 0x99, 0x6d, 0x09, 0x3d, 0x20
-};
+std::atomic<uint64_t> g_commands_sent(0);
+std::atomic<uint64_t> g_commands_coalesced(0);
 
-TPLinkDevice::TPLinkDevice(const std::string& ip, int port) 
-    : ip_(ip), port_(port), socket_fd_(-1), connected_(false) {
+// The part of a batch result that answers one caller's operations
+BatchResult resultFor(const BatchResult& result, const std::vector<std::string>& operations) {
+    BatchResult own{true, {}};
+    for (const auto& op : result.results) {
+        if (std::find(operations.begin(), operations.end(), op.operation) != operations.end()) {
+            own.results.push_back(op);
+            own.success = own.success && op.success;
+        }
+    }
+    own.success = own.success && !own.results.empty();
+    return own;
+}
+
+bool sameState(const DeviceInfo& a, const DeviceInfo& b, bool bOnline) {
+    return a.isOnline == bOnline && a.isOn == b.isOn && a.brightness == b.brightness &&
+           a.colorTemp == b.colorTemp && a.hue == b.hue && a.saturation == b.saturation &&
+           a.port == b.port && a.deviceId == b.deviceId && a.name == b.name && a.model == b.model &&
+           a.mac == b.mac && a.ip == b.ip;
+}
+
+}
+
+TPLinkDevice::TPLinkDevice(const std::string& ip, int port, std::shared_ptr<IOEngine> engine) 
+    : ip_(ip), port_(port), timeout_ms_(kDefaultTimeoutMs),
+      engine_(engine ? engine : IOEngine::shared()), connected_(false), is_bulb_(false),
+      command_in_flight_(false), queued_timeout_ms_(0) {
     deviceInfo_.ip = ip;
     deviceInfo_.port = port;
     deviceInfo_.isOnline = false;
@@ -35,89 +51,138 @@ TPLinkDevice::TPLinkDevice(const std::string& ip, int port)
 }
 
 TPLinkDevice::~TPLinkDevice() {
-    disconnect();
+    // The pooled socket is keyed by address alone, so it may well be serving
+    // the managed device at this address (e.g. for a sweep probe); only
+    // failures give it up
 }
 
 bool TPLinkDevice::discover() {
-    if (connect()) {
-        std::string response = sendCommand("{\"system\":{\"get_sysinfo\":null}}");
-        if (!response.empty()) {
-            Json::Value root;
-            Json::Reader reader;
-            if (reader.parse(response, root)) {
-                if (root.isMember("system") && root["system"].isMember("get_sysinfo")) {
-                    Json::Value sysinfo = root["system"]["get_sysinfo"];
-                    
-                    deviceInfo_.deviceId = sysinfo.get("deviceId", "").asString();
-                    deviceInfo_.name = sysinfo.get("alias", "").asString();
-                    deviceInfo_.model = sysinfo.get("model", "").asString();
-                    deviceInfo_.mac = sysinfo.get("mac", "").asString();
-                    deviceInfo_.isOnline = true;
-                    
-                    // Parse device state
-                    if (sysinfo.isMember("light_state")) {
-                        Json::Value lightState = sysinfo["light_state"];
-                        deviceInfo_.isOn = lightState.get("on_off", 0).asInt() == 1;
-                        deviceInfo_.brightness = lightState.get("brightness", 0).asInt();
-                        deviceInfo_.colorTemp = lightState.get("color_temp", 4000).asInt();
-                        deviceInfo_.hue = lightState.get("hue", 0).asInt();
-                        deviceInfo_.saturation = lightState.get("saturation", 0).asInt();
-                    } else if (sysinfo.isMember("relay_state")) {
-                        deviceInfo_.isOn = sysinfo.get("relay_state", 0).asInt() == 1;
-                    }
-                    
-                    return true;
-                }
-            }
-        }
-        disconnect();
+    std::string response = execute(buildRequest(KasaCommands::getSysinfo()));
+    if (!response.empty() && applySysinfo(response)) {
+        return true;
     }
+    disconnect();
     return false;
 }
 
-bool TPLinkDevice::connect() {
-    if (connected_) {
+void TPLinkDevice::discoverAsync(std::function<void(bool)> callback, TaskPriority priority) {
+    auto self = shared_from_this();
+    IORequest request = buildRequest(KasaCommands::getSysinfo());
+    request.priority = priority;
+    executeAsync(std::move(request), [self, callback](std::string response) {
+        bool success = !response.empty() && self->applySysinfo(response);
+        if (!success) {
+            self->disconnect();
+        }
+        if (callback) {
+            callback(success);
+        }
+    });
+}
+
+bool TPLinkDevice::applySysinfo(const std::string& response) {
+    SysinfoParser::Fields fields;
+    if (SysinfoParser::scan(response, fields)) {
+        {
+            std::lock_guard<std::mutex> lock(info_mutex_);
+            SysinfoParser::apply(fields, deviceInfo_);
+            if (fields.hasLightState) {
+                is_bulb_ = true;
+            }
+        }
+        stateChanged();
         return true;
     }
-    
-    socket_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_fd_ < 0) {
+    if (applySysinfoJson(response)) {
+        stateChanged();
+        return true;
+    }
+    return false;
+}
+
+bool TPLinkDevice::applySysinfoJson(const std::string& response) {
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(response, root) || !root.isObject() || !root["system"].isObject() ||
+        !root["system"]["get_sysinfo"].isObject()) {
         return false;
     }
+    const Json::Value& sysinfo = root["system"]["get_sysinfo"];
     
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port_);
-    inet_pton(AF_INET, ip_.c_str(), &server_addr.sin_addr);
-    
-    if (::connect(socket_fd_, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        close(socket_fd_);
-        socket_fd_ = -1;
+    // Built on a copy: jsoncpp throws on values of the wrong type, and a
+    // reply that fails halfway must leave the device as it was
+    DeviceInfo info = getDeviceInfo();
+    bool bulb = false;
+    try {
+        info.deviceId = sysinfo.get("deviceId", "").asString();
+        info.name = sysinfo.get("alias", "").asString();
+        info.model = sysinfo.get("model", "").asString();
+        info.mac = sysinfo.get("mac", "").asString();
+        info.isOnline = true;
+        
+        // Parse device state
+        if (sysinfo["light_state"].isObject()) {
+            const Json::Value& lightState = sysinfo["light_state"];
+            info.isOn = lightState.get("on_off", 0).asInt() == 1;
+            info.brightness = lightState.get("brightness", 0).asInt();
+            info.colorTemp = lightState.get("color_temp", 4000).asInt();
+            info.hue = lightState.get("hue", 0).asInt();
+            info.saturation = lightState.get("saturation", 0).asInt();
+            bulb = true;
+        } else if (sysinfo.isMember("relay_state")) {
+            info.isOn = sysinfo.get("relay_state", 0).asInt() == 1;
+        }
+    } catch (const Json::Exception&) {
         return false;
     }
     
-    connected_ = true;
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    deviceInfo_ = info;
+    if (bulb) {
+        is_bulb_ = true;
+    }
     return true;
 }
 
-void TPLinkDevice::disconnect() {
-    if (socket_fd_ >= 0) {
-        close(socket_fd_);
-        socket_fd_ = -1;
+bool TPLinkDevice::connect() {
+    // Sockets are pooled by the I/O engine; "connecting" means proving the
+    // device answers a sysinfo probe, which also warms its pooled socket.
+    if (connected_) {
+        return true;
     }
+    return discover();
+}
+
+void TPLinkDevice::disconnect() {
     connected_ = false;
+    engine_->release(ip_, port_);
+    {
+        std::lock_guard<std::mutex> lock(info_mutex_);
+        deviceInfo_.isOnline = false;
+    }
+    stateChanged();
+}
+
+void TPLinkDevice::setTimeout(int timeoutMs) {
+    timeout_ms_ = timeoutMs;
+}
+
+BreakerStatus TPLinkDevice::getBreakerStatus() {
+    return breaker_.status();
 }
 
 bool TPLinkDevice::turnOn() {
-    return sendCommand("{\"system\":{\"set_relay_state\":{\"state\":1}}}") != "";
+    return apply(CommandBatch().setPower(true)).success;
 }
 
 bool TPLinkDevice::turnOff() {
-    return sendCommand("{\"system\":{\"set_relay_state\":{\"state\":0}}}") != "";
+    return apply(CommandBatch().setPower(false)).success;
 }
 
 bool TPLinkDevice::toggle() {
-    return sendCommand("{\"system\":{\"set_relay_state\":{\"state\":-1}}}") != "";
+    // Depends on the state the device is in, so it can't be merged and
+    // bypasses the command queue
+    return execute(buildRequest(KasaCommands::relayToggle())) != "";
 }
 
 bool TPLinkDevice::setBrightness(int brightness) {
@@ -125,17 +190,7 @@ bool TPLinkDevice::setBrightness(int brightness) {
         return false;
     }
     
-    Json::Value params;
-    params["brightness"] = brightness;
-    params["on_off"] = brightness > 0 ? 1 : 0;
-    
-    Json::Value command;
-    command["smartlife.iot.smartbulb.lightingservice"]["set_light_state"] = params;
-    
-    Json::StreamWriterBuilder builder;
-    std::string commandStr = Json::writeString(builder, command);
-    
-    return sendCommand(commandStr) != "";
+    return apply(CommandBatch().setBrightness(brightness)).success;
 }
 
 bool TPLinkDevice::setColorTemp(int temp) {
@@ -143,17 +198,7 @@ bool TPLinkDevice::setColorTemp(int temp) {
         return false;
     }
     
-    Json::Value params;
-    params["color_temp"] = temp;
-    params["on_off"] = 1;
-    
-    Json::Value command;
-    command["smartlife.iot.smartbulb.lightingservice"]["set_light_state"] = params;
-    
-    Json::StreamWriterBuilder builder;
-    std::string commandStr = Json::writeString(builder, command);
-    
-    return sendCommand(commandStr) != "";
+    return apply(CommandBatch().setColorTemp(temp)).success;
 }
 
 bool TPLinkDevice::setColor(int hue, int saturation, int value) {
@@ -161,98 +206,321 @@ bool TPLinkDevice::setColor(int hue, int saturation, int value) {
         return false;
     }
     
-    Json::Value params;
-    params["hue"] = hue;
-    params["saturation"] = saturation;
-    params["brightness"] = value;
-    params["on_off"] = 1;
-    
-    Json::Value command;
-    command["smartlife.iot.smartbulb.lightingservice"]["set_light_state"] = params;
-    
-    Json::StreamWriterBuilder builder;
-    std::string commandStr = Json::writeString(builder, command);
-    
-    return sendCommand(commandStr) != "";
+    return apply(CommandBatch().setColor(hue, saturation, value)).success;
+}
+
+BatchResult TPLinkDevice::apply(const CommandBatch& batch) {
+    if (Executor::onWorkerThread()) {
+        // Waiting here would hold a worker the completion may need
+        BatchResult refused{false, {}};
+        for (const auto& operation : batch.operationNames()) {
+            refused.results.push_back(OperationResult{operation, false, -1, "blocking apply() on an executor worker"});
+        }
+        return refused;
+    }
+    auto done = std::make_shared<std::promise<BatchResult>>();
+    std::future<BatchResult> result = done->get_future();
+    applyAsync(batch, [done](BatchResult r) { done->set_value(std::move(r)); });
+    return result.get();
+}
+
+void TPLinkDevice::applyAsync(const CommandBatch& batch, std::function<void(BatchResult)> callback, int timeoutMs) {
+    if (batch.empty() || !batch.valid()) {
+        if (callback) {
+            callback(BatchResult{false, {}});
+        }
+        return;
+    }
+
+    CommandWaiter waiter{batch.operationNames(), std::move(callback)};
+    {
+        std::lock_guard<std::mutex> lock(command_mutex_);
+        if (command_in_flight_) {
+            if (queued_waiters_.empty()) {
+                queued_batch_ = batch;
+                queued_timeout_ms_ = timeoutMs;
+            } else {
+                queued_batch_.merge(batch);
+                if (timeoutMs > 0 && (queued_timeout_ms_ <= 0 || timeoutMs < queued_timeout_ms_)) {
+                    queued_timeout_ms_ = timeoutMs;
+                }
+                g_commands_coalesced++;
+            }
+            queued_waiters_.push_back(std::move(waiter));
+            return;
+        }
+        command_in_flight_ = true;
+    }
+
+    std::vector<CommandWaiter> waiters;
+    waiters.push_back(std::move(waiter));
+    dispatchBatch(batch, timeoutMs, std::move(waiters));
+}
+
+uint64_t TPLinkDevice::commandsSent() {
+    return g_commands_sent;
+}
+
+uint64_t TPLinkDevice::commandsCoalesced() {
+    return g_commands_coalesced;
+}
+
+void TPLinkDevice::dispatchBatch(CommandBatch batch, int timeoutMs, std::vector<CommandWaiter> waiters) {
+    g_commands_sent++;
+
+    bool bulb = is_bulb_;
+    IORequest request = buildRequest(batch, bulb);
+    if (timeoutMs > 0 && timeoutMs < request.timeoutMs) {
+        request.timeoutMs = timeoutMs;
+    }
+    auto self = shared_from_this();
+    auto pending = std::make_shared<std::vector<CommandWaiter>>(std::move(waiters));
+    executeAsync(std::move(request), [self, batch, bulb, pending](std::string response) {
+        BatchResult result = batch.parseResponse(response, bulb);
+        if (batch.hasRefresh() && !response.empty()) {
+            self->applySysinfo(response);
+        } else {
+            self->applyCommandResult(batch, result);
+        }
+        // Start the next batch before handing out results, so a caller that
+        // resubmits from its callback queues behind it instead of racing it
+        self->commandFinished();
+        for (auto& waiter : *pending) {
+            if (waiter.callback) {
+                waiter.callback(pending->size() == 1 ? result : resultFor(result, waiter.operations));
+            }
+        }
+    });
+}
+
+void TPLinkDevice::commandFinished() {
+    CommandBatch batch;
+    int timeoutMs = 0;
+    std::vector<CommandWaiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(command_mutex_);
+        if (queued_waiters_.empty()) {
+            command_in_flight_ = false;
+            return;
+        }
+        batch = std::move(queued_batch_);
+        queued_batch_ = CommandBatch();
+        timeoutMs = queued_timeout_ms_;
+        waiters.swap(queued_waiters_);
+    }
+    dispatchBatch(std::move(batch), timeoutMs, std::move(waiters));
 }
 
 DeviceInfo TPLinkDevice::getDeviceInfo() {
+    std::lock_guard<std::mutex> lock(info_mutex_);
     return deviceInfo_;
 }
 
+std::shared_ptr<const DeviceInfo> TPLinkDevice::getDeviceState() {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    if (!state_) {
+        auto state = std::make_shared<DeviceInfo>(deviceInfo_);
+        state->isOnline = connected_ && deviceInfo_.isOnline;
+        state_ = std::move(state);
+    }
+    return state_;
+}
+
+void TPLinkDevice::setStateListener(StateListener listener) {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    state_listener_ = std::move(listener);
+}
+
+void TPLinkDevice::setConnected(bool connected) {
+    if (connected_.exchange(connected) != connected) {
+        stateChanged();
+    }
+}
+
+void TPLinkDevice::stateChanged() {
+    // Keeps listener calls in the order the states were built
+    std::lock_guard<std::mutex> notifyLock(notify_mutex_);
+    StateListener listener;
+    std::shared_ptr<const DeviceInfo> before;
+    std::shared_ptr<const DeviceInfo> after;
+    {
+        std::lock_guard<std::mutex> lock(info_mutex_);
+        // Routine polls mostly confirm what was already published
+        bool online = connected_ && deviceInfo_.isOnline;
+        if (state_ && sameState(*state_, deviceInfo_, online)) {
+            return;
+        }
+        before = state_;
+        if (state_listener_) {
+            auto state = std::make_shared<DeviceInfo>(deviceInfo_);
+            state->isOnline = online;
+            state_ = after = std::move(state);
+            listener = state_listener_;
+        } else {
+            state_.reset(); // Built on demand by getDeviceState()
+        }
+    }
+    if (listener) {
+        listener(before, after);
+    }
+}
+
+void TPLinkDevice::applyCommandResult(const CommandBatch& batch, const BatchResult& result) {
+    // The device accepted these settings, so the cached state can follow
+    // without waiting for the next poll
+    BatchTarget target = batch.target();
+    bool applied = false;
+    {
+        std::lock_guard<std::mutex> lock(info_mutex_);
+        for (const auto& op : result.results) {
+            if (!op.success) {
+                continue;
+            }
+            if (op.operation == "power" || op.operation == "brightness" ||
+                op.operation == "colorTemp" || op.operation == "color") {
+                applied = true;
+                if (target.on >= 0) {
+                    deviceInfo_.isOn = target.on == 1;
+                }
+            }
+            if (op.operation == "brightness" && target.brightness >= 0) {
+                deviceInfo_.brightness = target.brightness;
+            } else if (op.operation == "colorTemp" && target.colorTemp >= 0) {
+                deviceInfo_.colorTemp = target.colorTemp;
+            } else if (op.operation == "color" && target.hue >= 0) {
+                deviceInfo_.hue = target.hue;
+                deviceInfo_.saturation = target.saturation;
+                deviceInfo_.brightness = target.brightness;
+                deviceInfo_.colorTemp = 0; // Bulbs report color mode as temperature 0
+            }
+        }
+    }
+    if (applied) {
+        stateChanged();
+    }
+}
+
 bool TPLinkDevice::isOnline() {
+    std::lock_guard<std::mutex> lock(info_mutex_);
     return connected_ && deviceInfo_.isOnline;
 }
 
 bool TPLinkDevice::isOn() {
+    std::lock_guard<std::mutex> lock(info_mutex_);
     return deviceInfo_.isOn;
 }
 
 int TPLinkDevice::getBrightness() {
+    std::lock_guard<std::mutex> lock(info_mutex_);
     return deviceInfo_.brightness;
 }
 
 int TPLinkDevice::getColorTemp() {
+    std::lock_guard<std::mutex> lock(info_mutex_);
     return deviceInfo_.colorTemp;
 }
 
 std::string TPLinkDevice::sendCommand(const std::string& command) {
-    if (!connect()) {
-        return "";
-    }
-    
-    std::string encrypted = encrypt(command);
-    if (encrypted.empty()) {
-        return "";
-    }
-    
-    // Send command length first (4 bytes, big-endian)
-    uint32_t length = htonl(encrypted.length());
-    if (send(socket_fd_, &length, 4, 0) != 4) {
-        return "";
+    return execute(buildRequest(KasaCodec::encodeFrame(command)));
+}
+
+void TPLinkDevice::sendCommandAsync(const std::string& command, std::function<void(std::string)> callback) {
+    executeAsync(buildRequest(KasaCodec::encodeFrame(command)), std::move(callback));
+}
+
+IORequest TPLinkDevice::buildRequest(const CommandBatch& batch, bool isBulb) {
+    // A lone operation, the usual case, goes out as a prebuilt frame or
+    // template; only merged batches are written out as JSON and encrypted
+    std::vector<std::string> names = batch.operationNames();
+    if (names.size() == 1) {
+        BatchTarget target = batch.target();
+        if (names[0] == "power") {
+            if (isBulb) {
+                return buildRequest(target.on ? KasaCommands::lightOn() : KasaCommands::lightOff());
+            }
+            return buildRequest(target.on ? KasaCommands::relayOn() : KasaCommands::relayOff());
+        }
+        if (names[0] == "brightness") {
+            return buildRequest(KasaCommands::setBrightness(target.brightness));
+        }
+        if (names[0] == "colorTemp") {
+            return buildRequest(KasaCommands::setColorTemp(target.colorTemp));
+        }
+        if (names[0] == "color") {
+            return buildRequest(KasaCommands::setColor(target.hue, target.saturation, target.brightness));
+        }
+        if (names[0] == "refresh") {
+            return buildRequest(KasaCommands::getSysinfo());
+        }
     }
-    
-    // Send encrypted command
-    if (send(socket_fd_, encrypted.c_str(), encrypted.length(), 0) != (ssize_t)encrypted.length()) {
+    return buildRequest(KasaCodec::encodeFrame(batch.toJson(isBulb)));
+}
+
+IORequest TPLinkDevice::buildRequest(std::string frame) {
+    IORequest request;
+    request.ip = ip_;
+    request.port = port_;
+    request.frame = std::move(frame);
+    request.timeoutMs = timeout_ms_;
+    return request;
+}
+
+IORequest TPLinkDevice::buildRequest(FrameRef frame) {
+    IORequest request;
+    request.ip = ip_;
+    request.port = port_;
+    request.staticFrame = frame.data;
+    request.staticFrameSize = frame.size;
+    request.timeoutMs = timeout_ms_;
+    return request;
+}
+
+std::string TPLinkDevice::execute(IORequest request) {
+    if (!breaker_.allow()) {
         return "";
     }
-    
-    // Receive response length
-    uint32_t responseLength;
-    if (recv(socket_fd_, &responseLength, 4, 0) != 4) {
-        return "";
+    IOResult result = engine_->execute(std::move(request));
+    if (result.success) {
+        breaker_.recordSuccess();
+    } else {
+        requestFailed();
     }
-    responseLength = ntohl(responseLength);
-    
-    // Receive encrypted response
-    std::string encryptedResponse(responseLength, 0);
-    if (recv(socket_fd_, &encryptedResponse[0], responseLength, 0) != (ssize_t)responseLength) {
+    setConnected(result.success);
+    if (!result.success) {
         return "";
     }
-    
-    return decrypt(encryptedResponse);
+    KasaCodec::decryptInPlace(result.payload);
+    return std::move(result.payload);
 }
 
-std::string TPLinkDevice::encrypt(const std::string& data) {
-    std::string result;
-    result.reserve(data.length() + 16);
-    
-    // Simple XOR encryption (Kasa protocol uses a more complex scheme, but this is simplified)
-    for (size_t i = 0; i < data.length(); ++i) {
-        result += data[i] ^ kasa_key_[i % 16];
+void TPLinkDevice::requestFailed() {
+    breaker_.recordFailure();
+    if (breaker_.status().state == BreakerState::Open) {
+        engine_->release(ip_, port_);
     }
-    
-    return result;
 }
 
-std::string TPLinkDevice::decrypt(const std::string& data) {
-    std::string result;
-    result.reserve(data.length());
-    
-    // Simple XOR decryption (same as encryption for XOR)
-    for (size_t i = 0; i < data.length(); ++i) {
-        result += data[i] ^ kasa_key_[i % 16];
+void TPLinkDevice::executeAsync(IORequest request, std::function<void(std::string)> callback) {
+    if (!breaker_.allow()) {
+        if (callback) {
+            callback(std::string());
+        }
+        return;
     }
-    
-    return result;
+    auto self = shared_from_this();
+    request.callback = [self, callback](IOResult result) {
+        if (result.success) {
+            self->breaker_.recordSuccess();
+        } else {
+            self->requestFailed();
+        }
+        self->setConnected(result.success);
+        if (result.success) {
+            KasaCodec::decryptInPlace(result.payload);
+        }
+        if (callback) {
+            callback(result.success ? std::move(result.payload) : std::string());
+        }
+    };
+    engine_->submit(std::move(request));
 }
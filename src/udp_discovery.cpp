@@ -0,0 +1,206 @@
+#include "udp_discovery.h"
+#include "kasa_codec.h"
+#include "kasa_commands.h"
+#include "sysinfo_parser.h"
+#include "tplink_device.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int kProbeCount = 3;
+const size_t kMaxDatagram = 65536;
+const int kReceiveBufferSize = 4 << 20;
+
+}
+
+UdpDiscovery::UdpDiscovery() : window_ms_(kDefaultWindowMs), port_(kDefaultPort) {
+}
+
+void UdpDiscovery::setWindow(int windowMs) {
+    window_ms_ = windowMs;
+}
+
+void UdpDiscovery::setPort(int port) {
+    port_ = port;
+}
+
+void UdpDiscovery::addTarget(const std::string& address) {
+    targets_.push_back(address);
+}
+
+std::vector<std::string> UdpDiscovery::broadcastAddresses() {
+    std::vector<std::string> addresses;
+    struct ifaddrs* interfaces = nullptr;
+    if (getifaddrs(&interfaces) != 0) {
+        return addresses;
+    }
+
+    for (struct ifaddrs* ifa = interfaces; ifa; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET || !ifa->ifa_broadaddr) {
+            continue;
+        }
+        if (!(ifa->ifa_flags & IFF_UP) || !(ifa->ifa_flags & IFF_BROADCAST) || (ifa->ifa_flags & IFF_LOOPBACK)) {
+            continue;
+        }
+
+        char buffer[INET_ADDRSTRLEN];
+        auto* broadcast = reinterpret_cast<struct sockaddr_in*>(ifa->ifa_broadaddr);
+        if (inet_ntop(AF_INET, &broadcast->sin_addr, buffer, sizeof(buffer))) {
+            std::string address(buffer);
+            if (std::find(addresses.begin(), addresses.end(), address) == addresses.end()) {
+                addresses.push_back(address);
+            }
+        }
+    }
+
+    freeifaddrs(interfaces);
+    return addresses;
+}
+
+std::vector<DiscoveryReply> UdpDiscovery::run() {
+    std::vector<DiscoveryReply> replies;
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Discovery socket failed: " << strerror(errno) << std::endl;
+        return replies;
+    }
+
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+
+    // Replies from a large fleet arrive in one burst; the kernel caps this
+    // at net.core.rmem_max
+    int receiveBuffer = kReceiveBufferSize;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
+    // Destinations: every interface broadcast plus configured targets. With
+    // neither, fall back to the limited broadcast address.
+    std::vector<std::string> addresses = broadcastAddresses();
+    addresses.insert(addresses.end(), targets_.begin(), targets_.end());
+    if (addresses.empty()) {
+        addresses.push_back("255.255.255.255");
+    }
+
+    std::vector<struct sockaddr_in> destinations;
+    for (const auto& address : addresses) {
+        struct sockaddr_in dest;
+        memset(&dest, 0, sizeof(dest));
+        dest.sin_family = AF_INET;
+        dest.sin_port = htons(static_cast<uint16_t>(port_));
+        if (inet_pton(AF_INET, address.c_str(), &dest.sin_addr) == 1) {
+            destinations.push_back(dest);
+        }
+    }
+
+    FrameRef probe = KasaCommands::getSysinfoDatagram();
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::milliseconds(window_ms_);
+    int probesSent = 0;
+
+    std::unordered_set<std::string> seen;
+    std::vector<char> buffer(kMaxDatagram);
+
+    while (true) {
+        auto now = Clock::now();
+        if (now >= deadline) {
+            break;
+        }
+
+        // Probes go out at 0, 1/4 and 1/2 of the window
+        auto nextProbe = start + std::chrono::milliseconds(window_ms_ * probesSent / (kProbeCount + 1));
+        if (probesSent < kProbeCount && now >= nextProbe) {
+            for (const auto& dest : destinations) {
+                sendto(fd, probe.data, probe.size, 0,
+                       reinterpret_cast<const struct sockaddr*>(&dest), sizeof(dest));
+            }
+            probesSent++;
+            continue;
+        }
+
+        auto wakeAt = deadline;
+        if (probesSent < kProbeCount) {
+            wakeAt = std::min(deadline, nextProbe);
+        }
+        int timeoutMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            wakeAt - now).count()) + 1;
+
+        struct pollfd pfd{fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeoutMs);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "Discovery poll failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        // Drain everything that has arrived
+        while (true) {
+            struct sockaddr_in from;
+            socklen_t fromLen = sizeof(from);
+            ssize_t n = recvfrom(fd, buffer.data(), buffer.size(), 0,
+                                 reinterpret_cast<struct sockaddr*>(&from), &fromLen);
+            if (n < 0) {
+                break;
+            }
+            if (n == 0) {
+                continue;
+            }
+
+            uint8_t* data = reinterpret_cast<uint8_t*>(buffer.data());
+            size_t len = static_cast<size_t>(n);
+            KasaCodec::decrypt(data, data, len);
+            std::string_view payload(buffer.data(), len);
+            if (payload.front() != '{') {
+                continue; // Not a Kasa reply
+            }
+
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &from.sin_addr, ip, sizeof(ip));
+
+            DiscoveryReply reply;
+            reply.ip = ip;
+            reply.port = ntohs(from.sin_port);
+
+            // Unrecognised replies are still reported; the TCP probe that
+            // follows parses them fully.
+            SysinfoParser::Fields fields;
+            if (SysinfoParser::scan(payload, fields)) {
+                DeviceInfo info;
+                SysinfoParser::apply(fields, info);
+                reply.deviceId = info.deviceId;
+                reply.mac = info.mac;
+            }
+
+            if (!reply.deviceId.empty()) {
+                reply.key = reply.deviceId;
+            } else if (!reply.mac.empty()) {
+                reply.key = reply.mac;
+            } else {
+                reply.key = reply.ip + ":" + std::to_string(reply.port);
+            }
+
+            if (seen.insert(reply.key).second) {
+                replies.push_back(std::move(reply));
+            }
+        }
+    }
+
+    close(fd);
+    return replies;
+}
@@ -0,0 +1,801 @@
+#include "kasa_codec.h"
+#include "kasa_frame.h"
+#include <json/json.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+
+// Emulates a fleet of Kasa plugs and bulbs on loopback for load and latency
+// testing. Every device listens for the length-framed TCP protocol on its own
+// port (ports mode) or its own 127.x address (addresses mode) and answers UDP
+// discovery probes, either sent to it directly or to the shared discovery
+// socket. Responses can be delayed, jittered and dropped per request.
+//
+// Everything runs on one epoll loop; responses wait in a deadline heap until
+// their simulated latency has elapsed.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char* kLightModule = "smartlife.iot.smartbulb.lightingservice";
+
+std::atomic<bool> g_stop{false};
+
+void signalHandler(int) {
+    g_stop = true;
+}
+
+struct Options {
+    size_t devices = 100;
+    double bulbRatio = 0.5;
+    bool addressMode = false;
+    int basePort = 20000;
+    std::string baseAddress = "127.0.1.1";
+    int port = 9999;
+    int discoveryPort = 9999;
+    int latencyMs = 0;
+    int latencySpreadMs = 0;
+    int jitterMs = 0;
+    double dropRate = 0.0;
+    std::string state = "random";
+    unsigned seed = 1;
+    int statsSeconds = 0;
+};
+
+struct Device {
+    bool bulb;
+    std::string ip;
+    int port;
+    std::string deviceId;
+    std::string mac;
+    std::string alias;
+    int latencyMs; // Base latency plus this device's fixed share of the spread
+
+    bool on;
+    int brightness;
+    int colorTemp;
+    int hue;
+    int saturation;
+    time_t onSince;
+
+    int listenFd;
+    int udpFd;
+};
+
+struct Connection {
+    int fd;
+    size_t device;
+    FrameReader reader;
+    FrameWriter writer;
+    std::deque<std::string> outbox; // Encrypted payloads, front is being written
+    Clock::time_point lastReadyAt;  // Keeps responses in request order
+    bool writable;
+};
+
+// Response waiting for its simulated latency
+struct Scheduled {
+    Clock::time_point readyAt;
+    uint64_t seq;
+    uint64_t connection;     // 0 for UDP replies
+    size_t device;
+    struct sockaddr_in peer; // UDP destination
+    std::string data;        // Encrypted payload, no header
+
+    bool operator>(const Scheduled& other) const {
+        return readyAt != other.readyAt ? readyAt > other.readyAt : seq > other.seq;
+    }
+};
+
+// epoll_event.data.u64 layout: kind in the top byte, index or id below
+enum Kind : uint64_t { kListener = 1, kDeviceUdp = 2, kDiscovery = 3, kConnection = 4 };
+
+uint64_t tag(Kind kind, uint64_t value) {
+    return (static_cast<uint64_t>(kind) << 56) | value;
+}
+
+class Simulator {
+public:
+    explicit Simulator(const Options& options)
+        : options_(options), rng_(options.seed), epollFd_(-1), discoveryFd_(-1), nextConnectionId_(1),
+          nextSeq_(0), requests_(0), responses_(0), drops_(0), accepted_(0), probes_(0) {
+    }
+
+    ~Simulator() {
+        for (auto& entry : connections_) {
+            close(entry.second->fd);
+        }
+        for (auto& device : devices_) {
+            if (device.listenFd >= 0) close(device.listenFd);
+            if (device.udpFd >= 0) close(device.udpFd);
+        }
+        if (discoveryFd_ >= 0) close(discoveryFd_);
+        if (epollFd_ >= 0) close(epollFd_);
+    }
+
+    bool setup() {
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd_ < 0) {
+            std::cerr << "epoll_create1 failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        struct in_addr base;
+        if (options_.addressMode && inet_pton(AF_INET, options_.baseAddress.c_str(), &base) != 1) {
+            std::cerr << "Invalid base address: " << options_.baseAddress << std::endl;
+            return false;
+        }
+
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::uniform_int_distribution<int> spread(0, std::max(0, options_.latencySpreadMs));
+        devices_.resize(options_.devices);
+
+        for (size_t i = 0; i < devices_.size(); ++i) {
+            Device& device = devices_[i];
+            device.bulb = unit(rng_) < options_.bulbRatio;
+            if (options_.addressMode) {
+                struct in_addr addr;
+                addr.s_addr = htonl(ntohl(base.s_addr) + static_cast<uint32_t>(i));
+                char buffer[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &addr, buffer, sizeof(buffer));
+                device.ip = buffer;
+                device.port = options_.port;
+            } else {
+                device.ip = "127.0.0.1";
+                device.port = options_.basePort + static_cast<int>(i);
+            }
+
+            char id[41];
+            snprintf(id, sizeof(id), "8006%036zX", i);
+            device.deviceId = id;
+            char mac[18];
+            snprintf(mac, sizeof(mac), "50:C7:BF:%02zX:%02zX:%02zX", (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF);
+            device.mac = mac;
+            device.alias = std::string(device.bulb ? "Sim Bulb " : "Sim Plug ") + std::to_string(i);
+            device.latencyMs = options_.latencyMs + spread(rng_);
+
+            if (options_.state == "on") {
+                device.on = true;
+            } else if (options_.state == "off") {
+                device.on = false;
+            } else {
+                device.on = unit(rng_) < 0.5;
+            }
+            device.brightness = 100;
+            device.colorTemp = 2700;
+            device.hue = 0;
+            device.saturation = 0;
+            device.onSince = time(nullptr);
+
+            device.listenFd = openSocket(SOCK_STREAM, device.ip, device.port);
+            device.udpFd = openSocket(SOCK_DGRAM, device.ip, device.port);
+            if (device.listenFd < 0 || device.udpFd < 0) {
+                std::cerr << "Cannot bind device " << i << " on " << device.ip << ":" << device.port
+                          << ": " << strerror(errno) << std::endl;
+                return false;
+            }
+            listen(device.listenFd, 128);
+            watch(device.listenFd, tag(kListener, i));
+            watch(device.udpFd, tag(kDeviceUdp, i));
+        }
+
+        // Shared discovery socket, unless a device already owns that address
+        if (options_.discoveryPort > 0 && (options_.addressMode || options_.discoveryPort < options_.basePort ||
+                                           options_.discoveryPort >= options_.basePort + static_cast<int>(devices_.size()))) {
+            discoveryFd_ = openSocket(SOCK_DGRAM, "127.0.0.1", options_.discoveryPort);
+            if (discoveryFd_ < 0) {
+                std::cerr << "Cannot bind discovery port " << options_.discoveryPort << ": "
+                          << strerror(errno) << std::endl;
+                return false;
+            }
+            watch(discoveryFd_, tag(kDiscovery, 0));
+        }
+
+        return true;
+    }
+
+    void run() {
+        std::vector<struct epoll_event> events(256);
+        auto nextStats = Clock::now() + std::chrono::seconds(options_.statsSeconds);
+
+        while (!g_stop) {
+            int timeoutMs = 100;
+            if (!scheduled_.empty()) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    scheduled_.top().readyAt - Clock::now()).count();
+                timeoutMs = static_cast<int>(std::max<long long>(0, std::min<long long>(wait, timeoutMs)));
+            }
+
+            int n = epoll_wait(epollFd_, events.data(), static_cast<int>(events.size()), timeoutMs);
+            if (n < 0 && errno != EINTR) {
+                std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+                break;
+            }
+
+            for (int i = 0; i < n; ++i) {
+                uint64_t data = events[i].data.u64;
+                uint64_t value = data & ((uint64_t(1) << 56) - 1);
+                switch (static_cast<Kind>(data >> 56)) {
+                case kListener:
+                    acceptConnections(value);
+                    break;
+                case kDeviceUdp:
+                    readDatagrams(devices_[value].udpFd, static_cast<long long>(value));
+                    break;
+                case kDiscovery:
+                    readDatagrams(discoveryFd_, -1);
+                    break;
+                case kConnection:
+                    handleConnection(value, events[i].events);
+                    break;
+                }
+            }
+
+            releaseDue();
+
+            if (options_.statsSeconds > 0 && Clock::now() >= nextStats) {
+                printStats();
+                nextStats += std::chrono::seconds(options_.statsSeconds);
+            }
+        }
+    }
+
+    void printStats() {
+        std::cout << "connections=" << connections_.size() << " accepted=" << accepted_
+                  << " requests=" << requests_ << " responses=" << responses_ << " dropped=" << drops_
+                  << " discoveryProbes=" << probes_ << std::endl;
+    }
+
+private:
+    int openSocket(int type, const std::string& ip, int port) {
+        int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+        if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        return fd;
+    }
+
+    void watch(int fd, uint64_t data, uint32_t events = EPOLLIN) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.u64 = data;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void acceptConnections(size_t device) {
+        while (true) {
+            int fd = accept4(devices_[device].listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    std::cerr << "accept failed: " << strerror(errno) << std::endl;
+                }
+                return;
+            }
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+            uint64_t id = nextConnectionId_++;
+            auto connection = std::make_unique<Connection>();
+            connection->fd = fd;
+            connection->device = device;
+            connection->writable = true;
+            connections_[id] = std::move(connection);
+            watch(fd, tag(kConnection, id), EPOLLIN | EPOLLRDHUP);
+            accepted_++;
+        }
+    }
+
+    void handleConnection(uint64_t id, uint32_t events) {
+        auto it = connections_.find(id);
+        if (it == connections_.end()) {
+            return;
+        }
+        Connection& connection = *it->second;
+
+        if (events & EPOLLOUT) {
+            connection.writable = true;
+            if (!flush(id, connection)) {
+                return;
+            }
+        }
+
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            std::string payload;
+            while (true) {
+                FrameReader::Status status = connection.reader.readFrom(connection.fd);
+                if (status == FrameReader::Status::Complete) {
+                    connection.reader.takeFrame(payload);
+                    handleRequest(id, connection, payload);
+                    continue;
+                }
+                if (status != FrameReader::Status::NeedMore) {
+                    closeConnection(id);
+                }
+                return;
+            }
+        }
+    }
+
+    void handleRequest(uint64_t id, Connection& connection, std::string& payload) {
+        requests_++;
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        if (options_.dropRate > 0 && unit(rng_) < options_.dropRate) {
+            drops_++;
+            return;
+        }
+
+        KasaCodec::decryptInPlace(payload);
+        std::string response = KasaCodec::encrypt(respond(devices_[connection.device], payload));
+
+        Scheduled entry;
+        entry.readyAt = std::max(readyTime(devices_[connection.device]), connection.lastReadyAt);
+        connection.lastReadyAt = entry.readyAt;
+        entry.seq = nextSeq_++;
+        entry.connection = id;
+        entry.device = connection.device;
+        entry.data = std::move(response);
+        scheduled_.push(std::move(entry));
+    }
+
+    // target is the device a probe was addressed to, or -1 for the shared
+    // discovery socket, which answers on behalf of every device
+    void readDatagrams(int fd, long long target) {
+        char buffer[2048];
+        while (true) {
+            struct sockaddr_in peer;
+            socklen_t peerLen = sizeof(peer);
+            ssize_t n = recvfrom(fd, buffer, sizeof(buffer), 0, reinterpret_cast<struct sockaddr*>(&peer), &peerLen);
+            if (n < 0) {
+                return;
+            }
+            probes_++;
+
+            std::string request(buffer, static_cast<size_t>(n));
+            KasaCodec::decryptInPlace(request);
+
+            size_t first = target < 0 ? 0 : static_cast<size_t>(target);
+            size_t last = target < 0 ? devices_.size() : first + 1;
+            for (size_t i = first; i < last; ++i) {
+                Scheduled entry;
+                entry.readyAt = readyTime(devices_[i]);
+                entry.seq = nextSeq_++;
+                entry.connection = 0;
+                entry.device = i;
+                entry.peer = peer;
+                entry.data = KasaCodec::encrypt(respond(devices_[i], request));
+                scheduled_.push(std::move(entry));
+            }
+        }
+    }
+
+    Clock::time_point readyTime(const Device& device) {
+        int delay = device.latencyMs;
+        if (options_.jitterMs > 0) {
+            std::uniform_int_distribution<int> jitter(0, options_.jitterMs);
+            delay += jitter(rng_);
+        }
+        return Clock::now() + std::chrono::milliseconds(delay);
+    }
+
+    void releaseDue() {
+        auto now = Clock::now();
+        while (!scheduled_.empty() && scheduled_.top().readyAt <= now) {
+            Scheduled entry = std::move(const_cast<Scheduled&>(scheduled_.top()));
+            scheduled_.pop();
+
+            if (entry.connection == 0) {
+                // UDP replies leave from the device's own socket so the
+                // source address and port identify it
+                sendto(devices_[entry.device].udpFd, entry.data.data(), entry.data.size(), 0,
+                       reinterpret_cast<const struct sockaddr*>(&entry.peer), sizeof(entry.peer));
+                responses_++;
+                continue;
+            }
+
+            auto it = connections_.find(entry.connection);
+            if (it == connections_.end()) {
+                continue; // Client went away
+            }
+            Connection& connection = *it->second;
+            connection.outbox.push_back(std::move(entry.data));
+            if (connection.outbox.size() == 1) {
+                connection.writer.resetWithHeader(connection.outbox.front().data(), connection.outbox.front().size());
+            }
+            if (connection.writable) {
+                flush(entry.connection, connection);
+            }
+        }
+    }
+
+    // Returns false if the connection was closed
+    bool flush(uint64_t id, Connection& connection) {
+        while (!connection.outbox.empty()) {
+            FrameWriter::Status status = connection.writer.writeTo(connection.fd);
+            if (status == FrameWriter::Status::WouldBlock) {
+                if (connection.writable) {
+                    connection.writable = false;
+                    modify(connection.fd, id, EPOLLIN | EPOLLRDHUP | EPOLLOUT);
+                }
+                return true;
+            }
+            if (status == FrameWriter::Status::Error) {
+                closeConnection(id);
+                return false;
+            }
+
+            responses_++;
+            connection.outbox.pop_front();
+            if (!connection.outbox.empty()) {
+                connection.writer.resetWithHeader(connection.outbox.front().data(), connection.outbox.front().size());
+            }
+        }
+        modify(connection.fd, id, EPOLLIN | EPOLLRDHUP);
+        return true;
+    }
+
+    void modify(int fd, uint64_t id, uint32_t events) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.u64 = tag(kConnection, id);
+        epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    void closeConnection(uint64_t id) {
+        auto it = connections_.find(id);
+        if (it == connections_.end()) {
+            return;
+        }
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, it->second->fd, nullptr);
+        close(it->second->fd);
+        connections_.erase(it);
+    }
+
+    // Request/response handling, shaped after HS1xx plug and KL/LB bulb firmware
+
+    std::string respond(Device& device, const std::string& request) {
+        Json::Value root;
+        Json::CharReaderBuilder readerBuilder;
+        std::unique_ptr<Json::CharReader> reader(readerBuilder.newCharReader());
+        std::string errors;
+        if (!reader->parse(request.data(), request.data() + request.size(), &root, &errors) || !root.isObject()) {
+            return "{\"err_code\":-1,\"err_msg\":\"json decode error\"}";
+        }
+
+        // jsoncpp doesn't keep member order, so setters run before getters
+        // to match firmware handling a request in document order
+        Json::Value response(Json::objectValue);
+        for (bool getters : {false, true}) {
+            for (const auto& module : root.getMemberNames()) {
+                const Json::Value& methods = root[module];
+                if (!methods.isObject()) {
+                    response[module] = error(-1, "module not support");
+                    continue;
+                }
+                if (response.isMember(module) && response[module].isMember("err_code")) {
+                    continue; // Module already failed
+                }
+                for (const auto& method : methods.getMemberNames()) {
+                    if ((method.compare(0, 4, "get_") == 0) != getters) {
+                        continue;
+                    }
+                    Json::Value result = call(device, module, method, methods[method]);
+                    if (result.isMember("module_error")) {
+                        response[module] = result["module_error"];
+                        break;
+                    }
+                    response[module][method] = result;
+                }
+            }
+        }
+
+        Json::StreamWriterBuilder writerBuilder;
+        writerBuilder["indentation"] = "";
+        return Json::writeString(writerBuilder, response);
+    }
+
+    Json::Value call(Device& device, const std::string& module, const std::string& method, const Json::Value& args) {
+        if (module == "system") {
+            if (method == "get_sysinfo") {
+                return sysinfo(device);
+            }
+            if (method == "set_relay_state" && !device.bulb) {
+                int state = args.get("state", -2).asInt();
+                if (state != 0 && state != 1) {
+                    return error(-3, "invalid argument");
+                }
+                setPower(device, state == 1);
+                return error(0, nullptr);
+            }
+            return error(-2, "member not support");
+        }
+
+        if (module == kLightModule) {
+            if (!device.bulb) {
+                Json::Value wrapped;
+                wrapped["module_error"] = error(-1, "module not support");
+                return wrapped;
+            }
+            if (method == "set_light_state") {
+                if (args.isMember("hue") || args.isMember("saturation")) {
+                    device.colorTemp = 0; // Color mode unless a temperature is given too
+                }
+                if (args.isMember("brightness")) device.brightness = std::clamp(args["brightness"].asInt(), 0, 100);
+                if (args.isMember("color_temp")) device.colorTemp = args["color_temp"].asInt();
+                if (args.isMember("hue")) device.hue = std::clamp(args["hue"].asInt(), 0, 360);
+                if (args.isMember("saturation")) device.saturation = std::clamp(args["saturation"].asInt(), 0, 100);
+                if (args.isMember("on_off")) setPower(device, args["on_off"].asInt() == 1);
+                Json::Value state = lightState(device);
+                state["err_code"] = 0;
+                return state;
+            }
+            if (method == "get_light_state") {
+                Json::Value state = lightState(device);
+                state["err_code"] = 0;
+                return state;
+            }
+            return error(-2, "member not support");
+        }
+
+        Json::Value wrapped;
+        wrapped["module_error"] = error(-1, "module not support");
+        return wrapped;
+    }
+
+    void setPower(Device& device, bool on) {
+        if (on && !device.on) {
+            device.onSince = time(nullptr);
+        }
+        device.on = on;
+    }
+
+    static Json::Value error(int code, const char* message) {
+        Json::Value value;
+        value["err_code"] = code;
+        if (message) {
+            value["err_msg"] = message;
+        }
+        return value;
+    }
+
+    // Bulbs report the full state only while on; when off the last state
+    // moves into dft_on_state
+    static Json::Value lightState(const Device& device) {
+        Json::Value state;
+        state["mode"] = "normal";
+        state["hue"] = device.hue;
+        state["saturation"] = device.saturation;
+        state["color_temp"] = device.colorTemp;
+        state["brightness"] = device.brightness;
+
+        Json::Value result;
+        result["on_off"] = device.on ? 1 : 0;
+        if (device.on) {
+            for (const auto& key : state.getMemberNames()) {
+                result[key] = state[key];
+            }
+        } else {
+            result["dft_on_state"] = state;
+        }
+        return result;
+    }
+
+    Json::Value sysinfo(const Device& device) {
+        std::uniform_int_distribution<int> rssi(-70, -40);
+        Json::Value info;
+        info["alias"] = device.alias;
+        info["deviceId"] = device.deviceId;
+        info["hwId"] = "A0E3CC8F5C1166B27A16D56BE262A6D3";
+        info["oemId"] = "FFF22CFF774A0B89F7624BFC6F50D5DE";
+        info["hw_ver"] = device.bulb ? "1.0" : "2.0";
+        info["rssi"] = rssi(rng_);
+        info["err_code"] = 0;
+
+        if (device.bulb) {
+            info["sw_ver"] = "1.8.11 Build 191113 Rel.105336";
+            info["model"] = "KL130(US)";
+            info["description"] = "Smart Wi-Fi LED Bulb with Color Changing";
+            info["mic_type"] = "IOT.SMARTBULB";
+            info["mic_mac"] = device.mac;
+            info["mac"] = device.mac;
+            info["dev_state"] = "normal";
+            info["is_dimmable"] = 1;
+            info["is_color"] = 1;
+            info["is_variable_color_temp"] = 1;
+            info["light_state"] = lightState(device);
+        } else {
+            info["sw_ver"] = "1.5.6 Build 191125 Rel.083657";
+            info["model"] = "HS103(US)";
+            info["type"] = "IOT.SMARTPLUGSWITCH";
+            info["dev_name"] = "Smart Wi-Fi Plug Mini";
+            info["mac"] = device.mac;
+            info["relay_state"] = device.on ? 1 : 0;
+            info["on_time"] = device.on ? static_cast<Json::Int64>(time(nullptr) - device.onSince) : 0;
+            info["led_off"] = 0;
+            info["active_mode"] = "none";
+            info["feature"] = "TIM";
+            info["updating"] = 0;
+        }
+        return info;
+    }
+
+    Options options_;
+    std::mt19937 rng_;
+    int epollFd_;
+    int discoveryFd_;
+    std::vector<Device> devices_;
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+    std::priority_queue<Scheduled, std::vector<Scheduled>, std::greater<Scheduled>> scheduled_;
+    uint64_t nextConnectionId_;
+    uint64_t nextSeq_;
+
+    uint64_t requests_;
+    uint64_t responses_;
+    uint64_t drops_;
+    uint64_t accepted_;
+    uint64_t probes_;
+};
+
+void printUsage(const char* programName) {
+    std::cout << "Usage: " << programName << " [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -n, --devices N          Number of simulated devices (default: 100)" << std::endl;
+    std::cout << "  --bulbs RATIO            Fraction of devices that are bulbs (default: 0.5)" << std::endl;
+    std::cout << "  --mode ports|addresses   One port per device on 127.0.0.1, or one address per" << std::endl;
+    std::cout << "                           device on a shared port (default: ports)" << std::endl;
+    std::cout << "  --base-port PORT         First device port in ports mode (default: 20000)" << std::endl;
+    std::cout << "  --base-address ADDR      First device address in addresses mode (default: 127.0.1.1)" << std::endl;
+    std::cout << "  --port PORT              Device port in addresses mode (default: 9999)" << std::endl;
+    std::cout << "  --discovery-port PORT    UDP port on 127.0.0.1 answering for every device (default: 9999, 0 = off)" << std::endl;
+    std::cout << "  --latency MS             Response latency (default: 0)" << std::endl;
+    std::cout << "  --latency-spread MS      Extra fixed latency per device, uniform in [0, MS] (default: 0)" << std::endl;
+    std::cout << "  --jitter MS              Extra random latency per request, uniform in [0, MS] (default: 0)" << std::endl;
+    std::cout << "  --drop RATE              Probability that a request is never answered (default: 0)" << std::endl;
+    std::cout << "  --state on|off|random    Initial power state (default: random)" << std::endl;
+    std::cout << "  --seed N                 Random seed (default: 1)" << std::endl;
+    std::cout << "  --stats SECONDS          Print counters periodically (default: off)" << std::endl;
+    std::cout << "  -h, --help               Show this help message" << std::endl;
+}
+
+void raiseFileLimit(size_t needed) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < needed) {
+        std::cerr << "Warning: open file limit " << limit.rlim_cur << " is below the " << needed
+                  << " descriptors this fleet needs" << std::endl;
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        std::string value = hasValue ? argv[i + 1] : "";
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        }
+        if (!hasValue) {
+            std::cerr << "Error: " << arg << " requires a value" << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        i++;
+
+        if (arg == "-n" || arg == "--devices") {
+            options.devices = std::stoul(value);
+        } else if (arg == "--bulbs") {
+            options.bulbRatio = std::stod(value);
+        } else if (arg == "--mode") {
+            if (value != "ports" && value != "addresses") {
+                std::cerr << "Error: --mode must be ports or addresses" << std::endl;
+                return 1;
+            }
+            options.addressMode = value == "addresses";
+        } else if (arg == "--base-port") {
+            options.basePort = std::stoi(value);
+        } else if (arg == "--base-address") {
+            options.baseAddress = value;
+        } else if (arg == "--port") {
+            options.port = std::stoi(value);
+        } else if (arg == "--discovery-port") {
+            options.discoveryPort = std::stoi(value);
+        } else if (arg == "--latency") {
+            options.latencyMs = std::stoi(value);
+        } else if (arg == "--latency-spread") {
+            options.latencySpreadMs = std::stoi(value);
+        } else if (arg == "--jitter") {
+            options.jitterMs = std::stoi(value);
+        } else if (arg == "--drop") {
+            options.dropRate = std::stod(value);
+        } else if (arg == "--state") {
+            if (value != "on" && value != "off" && value != "random") {
+                std::cerr << "Error: --state must be on, off or random" << std::endl;
+                return 1;
+            }
+            options.state = value;
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::stoul(value));
+        } else if (arg == "--stats") {
+            options.statsSeconds = std::stoi(value);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!options.addressMode && options.basePort + static_cast<long>(options.devices) > 65536) {
+        std::cerr << "Error: not enough ports above " << options.basePort << " for " << options.devices
+                  << " devices; use --mode addresses" << std::endl;
+        return 1;
+    }
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Two sockets per device plus client connections
+    raiseFileLimit(options.devices * 3 + 64);
+
+    Simulator simulator(options);
+    if (!simulator.setup()) {
+        return 1;
+    }
+
+    std::cout << "Simulating " << options.devices << " devices ";
+    if (options.addressMode) {
+        std::cout << "on " << options.baseAddress << "+ port " << options.port;
+    } else {
+        std::cout << "on 127.0.0.1 ports " << options.basePort << "-" << options.basePort + options.devices - 1;
+    }
+    std::cout << std::endl;
+
+    simulator.run();
+    simulator.printStats();
+    return 0;
+}